@@ -4,20 +4,27 @@ PROGRAM=${1:-./build/repcrec}
 shift
 INDIR=${1:-./inputs}
 shift
-OUTDIR=${1:-./outputs}
-echo "program=<$PROGRAM> indir=<$INDIR> outdir=<$OUTDIR>"
-
-INS="`seq 1 26`" 
-INPRE="test"
-OUTPRE="out"
+OUTDIR=${1:-./build/outputs}
+shift
+GOLDEN=${1:-./outputs}
+shift
+JOBS=${1:-0}
+echo "program=<$PROGRAM> indir=<$INDIR> outdir=<$OUTDIR> golden=<$GOLDEN> jobs=<$JOBS>"
 
 
 ############################################################################
 #  NO TRACING 
 ############################################################################
 
-for f in ${INS}; do
-	echo "${PROGRAM} ${INDIR}/${INPRE}${f} > ${OUTDIR}/${OUTPRE}${f}"
-	${PROGRAM} ${INDIR}/${INPRE}${f} > ${OUTDIR}/${OUTPRE}${f} &
-done
+# every ${INDIR}/testN is simulated in-process on a pool of ${JOBS} threads
+# (0: one per core), written to ${OUTDIR}/outN and compared with ${GOLDEN}/outN
+mkdir -p ${OUTDIR}
+${PROGRAM} --run-dir ${INDIR} ${OUTDIR} --golden ${GOLDEN} --jobs ${JOBS} || FAILED=1
 
+# ${INDIR}/sched-<policy> holds the scenarios of the other scheduling policies
+for POLICY in priority oldest; do
+    mkdir -p ${OUTDIR}/sched-${POLICY}
+    ${PROGRAM} --sched ${POLICY} --run-dir ${INDIR}/sched-${POLICY} ${OUTDIR}/sched-${POLICY} \
+        --golden ${GOLDEN}/sched-${POLICY} --jobs ${JOBS} || FAILED=1
+done
+exit ${FAILED:-0}
@@ -0,0 +1,106 @@
+/**
+ * Date: 2026-10-18
+ * Description: Allocation schemes for the transaction bookkeeping, see Arena.h
+ *
+**/
+#include "Arena.h"
+
+#include <cstdint>
+
+Arena::Arena() {
+    _chunks = nullptr;
+    _cur = _inline;
+    _end = _inline + INLINE_SIZE;
+}
+
+Arena::~Arena() {
+    Reset();
+}
+
+void *
+Arena::Allocate(size_t size, size_t align) {
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t) (align - 1);
+    if (aligned + size > reinterpret_cast<uintptr_t>(_end)) {
+        // start a new chunk, big enough for this allocation
+        size_t chunk_size = sizeof(chunk_t) + align + (size > CHUNK_SIZE ? size : (size_t) CHUNK_SIZE);
+        chunk_t *chunk = static_cast<chunk_t *>(::operator new(chunk_size));
+        chunk->next = _chunks;
+        _chunks = chunk;
+        _cur = reinterpret_cast<char *>(chunk + 1);
+        _end = reinterpret_cast<char *>(chunk) + chunk_size;
+        aligned = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t) (align - 1);
+    }
+    _cur = reinterpret_cast<char *>(aligned + size);
+    return reinterpret_cast<void *>(aligned);
+}
+
+void
+Arena::Reset() {
+    while (_chunks != nullptr) {
+        chunk_t *next = _chunks->next;
+        ::operator delete(_chunks);
+        _chunks = next;
+    }
+    _cur = _inline;
+    _end = _inline + INLINE_SIZE;
+}
+
+ArenaPool::~ArenaPool() {
+    for (Arena *arena : _all) {
+        delete arena;
+    }
+}
+
+Arena *
+ArenaPool::Acquire() {
+    if (_free.empty()) {
+        Arena *arena = new Arena();
+        _all.push_back(arena);
+        return arena;
+    }
+    Arena *arena = _free.back();
+    _free.pop_back();
+    return arena;
+}
+
+void
+ArenaPool::Release(Arena *arena) {
+    arena->Reset();
+    _free.push_back(arena);
+}
+
+NodePool::NodePool() {
+    for (free_node *&head : _free) {
+        head = nullptr;
+    }
+}
+
+NodePool::~NodePool() {
+    for (void *block : _blocks) {
+        ::operator delete(block);
+    }
+}
+
+void *
+NodePool::Allocate(size_t size) {
+    size_t size_class = (size + 15) / 16 - 1;
+    if (_free[size_class] == nullptr) {
+        size_t node_size = (size_class + 1) * 16;
+        char *block = static_cast<char *>(::operator new(node_size * NODES_PER_BLOCK));
+        _blocks.push_back(block);
+        for (size_t i = 0; i < NODES_PER_BLOCK; ++i) {
+            Deallocate(block + i * node_size, node_size);
+        }
+    }
+    free_node *node = _free[size_class];
+    _free[size_class] = node->next;
+    return node;
+}
+
+void
+NodePool::Deallocate(void *p, size_t size) {
+    size_t size_class = (size + 15) / 16 - 1;
+    free_node *node = static_cast<free_node *>(p);
+    node->next = _free[size_class];
+    _free[size_class] = node;
+}
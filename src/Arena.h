@@ -0,0 +1,195 @@
+/**
+ * Date: 2026-10-18
+ * Description: Allocation schemes for the transaction bookkeeping.
+ * - Arena: a bump allocator owned by one transaction. Everything the transaction allocates on a TM or a site
+ *   is carved from it and handed back at once when the transaction commits or aborts.
+ * - NodePool: free lists of small fixed-size nodes for the shared queues (queued ops, lock queues), whose nodes
+ *   belong to many transactions at the same time. Owned by the TM or the site holding the queues, its blocks go
+ *   back to the heap with it.
+ *
+**/
+#pragma once
+
+#include<cstddef>
+#include<functional>
+#include<list>
+#include<new>
+#include<unordered_map>
+#include<unordered_set>
+#include<vector>
+
+class Arena {
+public:
+    Arena();
+
+    ~Arena();
+
+    void *Allocate(size_t size, size_t align);
+
+    // Give back everything allocated so far
+    void Reset();
+
+private:
+    // most transactions fit in the inline block, larger ones chain more chunks
+    enum {
+        INLINE_SIZE = 512,
+        CHUNK_SIZE = 4096
+    };
+
+    struct chunk_t {
+        chunk_t *next;
+    };
+
+    alignas(16) char _inline[INLINE_SIZE];
+    chunk_t *_chunks;
+    char *_cur;
+    char *_end;
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+};
+
+// Hands out arenas to transactions and recycles them once released
+class ArenaPool {
+public:
+    ~ArenaPool();
+
+    Arena *Acquire();
+
+    // Reset the arena and keep it for the next transaction
+    void Release(Arena *arena);
+
+private:
+    std::vector<Arena *> _free;
+    std::vector<Arena *> _all;
+};
+
+// Allocates from an arena, or from the heap when it has none
+template<class T>
+struct arena_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena *arena;
+
+    arena_allocator() : arena(nullptr) {}
+
+    explicit arena_allocator(Arena *_arena) : arena(_arena) {}
+
+    template<class U>
+    arena_allocator(const arena_allocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) {
+        if (arena == nullptr) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, size_t) {
+        // arena memory only goes back with the whole arena
+        if (arena == nullptr) {
+            ::operator delete(p);
+        }
+    }
+
+    template<class U>
+    bool operator==(const arena_allocator<U> &other) const {
+        return arena == other.arena;
+    }
+
+    template<class U>
+    bool operator!=(const arena_allocator<U> &other) const {
+        return arena != other.arena;
+    }
+};
+
+template<class T>
+using arena_set = std::unordered_set<T, std::hash<T>, std::equal_to<T>, arena_allocator<T>>;
+
+template<class K, class V>
+using arena_map = std::unordered_map<K, V, std::hash<K>, std::equal_to<K>, arena_allocator<std::pair<const K, V>>>;
+
+// Free lists of nodes, one per size class of 16 bytes. Nodes are allocated in blocks, which only go back to the heap
+// when the pool is destroyed: until then it stays at the peak number of nodes in use. Not thread-safe, a pool is used
+// by whoever holds its owner
+class NodePool {
+public:
+    enum {
+        MAX_NODE_SIZE = 256
+    };
+
+    NodePool();
+
+    ~NodePool();
+
+    // size at most MAX_NODE_SIZE
+    void *Allocate(size_t size);
+
+    void Deallocate(void *p, size_t size);
+
+private:
+    struct free_node {
+        free_node *next;
+    };
+
+    enum {
+        NODES_PER_BLOCK = 64
+    };
+
+    free_node *_free[MAX_NODE_SIZE / 16];
+    std::vector<void *> _blocks;
+
+    NodePool(const NodePool &) = delete;
+
+    NodePool &operator=(const NodePool &) = delete;
+};
+
+// Single nodes come from a node pool, anything bigger (or without a pool) from the heap
+template<class T>
+struct pool_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    NodePool *pool;
+
+    pool_allocator() : pool(nullptr) {}
+
+    explicit pool_allocator(NodePool *_pool) : pool(_pool) {}
+
+    template<class U>
+    pool_allocator(const pool_allocator<U> &other) : pool(other.pool) {}
+
+    T *allocate(size_t n) {
+        if (pool != nullptr && n == 1 && sizeof(T) <= NodePool::MAX_NODE_SIZE) {
+            return static_cast<T *>(pool->Allocate(sizeof(T)));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) {
+        if (pool != nullptr && n == 1 && sizeof(T) <= NodePool::MAX_NODE_SIZE) {
+            pool->Deallocate(p, sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template<class U>
+    bool operator==(const pool_allocator<U> &other) const {
+        return pool == other.pool;
+    }
+
+    template<class U>
+    bool operator!=(const pool_allocator<U> &other) const {
+        return pool != other.pool;
+    }
+};
+
+template<class T>
+using pool_list = std::list<T, pool_allocator<T>>;
@@ -0,0 +1,74 @@
+/**
+ * Date: 2026-10-18
+ * Description: A cluster is one transaction manager together with its data sites.
+ *
+**/
+#include "Cluster.h"
+
+#include <cstdlib>
+#include <iostream>
+
+#include <unistd.h>
+
+#include "DataMng.h"
+
+Cluster::Cluster(const cluster_options_t &options, std::ostream &out) {
+    // initialize TM
+    _tm = new TransMng(out);
+    _tm->SetWriteBatching(options.write_batch);
+    _tm->SetReadCache(options.read_cache);
+    _tm->SetSnapshotCache(options.snapshot_cache);
+    if (!options.dump_path.empty()) {
+        _tm->SetDumpExport(options.dump_path, options.dump_format);
+    }
+    _tm->SetFreeRunning(options.free_running);
+    _tm->SetDeadlockInterval(options.deadlock_interval);
+    _tm->SetDeadlockThreshold(options.deadlock_threshold);
+    _tm->SetSchedPolicy(options.sched_policy);
+    _tm->SetAdmissionControl(options.admission_control);
+    _tm->SetTracer(options.tracer);
+    _tm->SetTransStats(options.trans_stats);
+
+    if (options.multi_process) {
+        char dir_template[] = "/tmp/repcrec.XXXXXX";
+        if (mkdtemp(dir_template) == nullptr) {
+            std::cout << "ERROR: Cannot create the stable storage directory\n";
+            std::exit(-1);
+        }
+        _stable_dir = dir_template;
+    }
+
+    // initialize DM(s), either in this process or one process per site
+    SiteProcStats *stats = options.site_stats != nullptr ? options.site_stats : &_own_stats;
+    _sites[0] = nullptr;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; ++site_id) {
+        if (options.multi_process) {
+            std::string stable_path = _stable_dir + "/site" + std::to_string(site_id);
+            _sites[site_id] = new SiteProxy(site_id, _tm, out, stable_path, stats, options.escalation_threshold,
+                                            options.hot_versions, options.cold_dir);
+        } else {
+            DataMng *site = new DataMng(site_id, _tm, out);
+            site->SetEscalationThreshold(options.escalation_threshold);
+            site->SetColdTier(options.cold_dir, options.hot_versions);
+            site->SetTracer(options.tracer);
+            _sites[site_id] = site;
+        }
+        _tm->AttachSite(site_id, _sites[site_id]);
+    }
+}
+
+Cluster::~Cluster() {
+    delete _tm;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; ++site_id) {
+        delete _sites[site_id];
+    }
+
+    if (!_stable_dir.empty()) {
+        rmdir(_stable_dir.c_str());
+    }
+}
+
+TransMng &
+Cluster::GetTM() {
+    return *_tm;
+}
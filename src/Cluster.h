@@ -0,0 +1,101 @@
+/**
+ * Date: 2026-10-18
+ * Description: A cluster is one transaction manager together with its data sites. There is no global state, so
+ * several clusters can live in the same process, each of them writing to its own output stream.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include"DataSite.h"
+#include"SiteProc.h"
+#include"TransMng.h"
+#include<ostream>
+#include<string>
+
+struct cluster_options_t {
+    // send the consecutive writes of a transaction to each site as one request
+    bool write_batch;
+
+    // answer the repeated reads of a transaction without asking a site
+    bool read_cache;
+
+    // serve the reads of read-only transactions that began in the same tick from one shared snapshot
+    bool snapshot_cache;
+
+    // dump() writes to this file instead of printing, if not empty (see TransMng::SetDumpExport)
+    std::string dump_path;
+    dump_format_t dump_format;
+
+    // run every site as its own process
+    bool multi_process;
+
+    // where the site processes report their messaging latency, may be null
+    SiteProcStats *site_stats;
+
+    // process the commands as a stream of events instead of one tick per line, see TransMng::SetFreeRunning
+    bool free_running;
+
+    // free running: when deadlocks are detected, in events, 0 to disable
+    int deadlock_interval;
+    int deadlock_threshold;
+
+    // escalate the item locks of a transaction on a site to a site lock past this many, 0 to disable
+    int escalation_threshold;
+
+    // versions of an item kept in memory by each site, the older ones go to segment files in cold_dir
+    // (see DataMng::SetColdTier). 0 keeps all of them in memory
+    int hot_versions;
+    std::string cold_dir;
+
+    // the order of the op queue and of the lock queues, see TransMng::SetSchedPolicy
+    sched_policy_t sched_policy;
+
+    // cap the read-write transactions running at once, see TransMng::SetAdmissionControl
+    bool admission_control;
+
+    // where the timeline of the run is recorded, may be null. The sites record theirs only when they run in this process
+    Tracer *tracer;
+
+    // record the latency and the waits of every transaction, see TransMng::SetTransStats
+    bool trans_stats;
+
+    cluster_options_t() {
+        write_batch = true;
+        read_cache = true;
+        snapshot_cache = true;
+        dump_format = DUMP_CSV;
+        multi_process = false;
+        site_stats = nullptr;
+        free_running = false;
+        deadlock_interval = 0;
+        deadlock_threshold = 16;
+        escalation_threshold = 0;
+        hot_versions = 0;
+        cold_dir = "/tmp";
+        sched_policy = POLICY_FIFO;
+        admission_control = false;
+        tracer = nullptr;
+        trans_stats = false;
+    }
+};
+
+class Cluster {
+public:
+    // Everything the cluster reports is written to out
+    Cluster(const cluster_options_t &options, std::ostream &out);
+
+    ~Cluster();
+
+    TransMng &GetTM();
+
+private:
+    TransMng *_tm;
+
+    // For simplicity we deal with the annoying 1-index here
+    DataSite *_sites[SITE_COUNT + 1];
+
+    // The stable storage of the site processes (multi-process only)
+    std::string _stable_dir;
+    SiteProcStats _own_stats;
+};
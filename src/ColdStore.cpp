@@ -0,0 +1,323 @@
+/**
+ * Date: 2026-10-18
+ * Description: The cold tier of the versions of a site, see ColdStore.h
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  Append                |item_id, value, ts    |
+ *  -----------------------------------------------------------------------------------------
+ *  Find                  |item_id, ts, value,...|true if a version was committed at or before ts
+ *  -----------------------------------------------------------------------------------------
+ *  ForEach               |visit                 |
+ *  -----------------------------------------------------------------------------------------
+ *  Clear                 |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  new_segment           |capacity              |a mapped segment file
+ *  -----------------------------------------------------------------------------------------
+ *  seal                  |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  maybe_merge           |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  collect_merge         |                      |true if a merge was put in place
+ *  -----------------------------------------------------------------------------------------
+ *  find_sealed           |segment, item_id, ts  |the position of the version, -1 if none
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "ColdStore.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    // versions per segment as it is appended to, a key in the sparse index every INDEX_STRIDE versions, and the
+    // number of sealed segments of a level that are merged into one of the next level
+    const size_t SEGMENT_VERSIONS = 64 * 1024;
+    const size_t INDEX_STRIDE = 64;
+    const size_t MERGE_FANIN = 4;
+
+    bool key_less(const cold_version_t &lhs, const cold_version_t &rhs) {
+        return lhs.item_id != rhs.item_id ? lhs.item_id < rhs.item_id : lhs.commit_time < rhs.commit_time;
+    }
+
+    void err_segment(const std::string &dir) {
+        std::cout << "ERROR: Cannot create a cold version segment in " << dir << "\n";
+        std::exit(-1);
+    }
+}
+
+ColdStore::segment_t::segment_t() {
+    fd = -1;
+    records = nullptr;
+    capacity = 0;
+    count = 0;
+    level = 0;
+}
+
+ColdStore::segment_t::~segment_t() {
+    if (records != nullptr) {
+        munmap(records, capacity * sizeof(cold_version_t));
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+ColdStore::ColdStore(const std::string &dir) {
+    _dir = dir;
+    _merging = false;
+    _merge_done = false;
+    _versions = 0;
+    _merges = 0;
+}
+
+ColdStore::~ColdStore() {
+    wait_merge();
+}
+
+void
+ColdStore::Append(itemid_t item_id, int value, timestamp_t commit_time) {
+    collect_merge();
+    if (_active == nullptr) {
+        _active = new_segment(SEGMENT_VERSIONS);
+    } else if (_active->count == _active->capacity) {
+        seal();
+        _active = new_segment(SEGMENT_VERSIONS);
+    }
+
+    int32_t position = static_cast<int32_t>(_active->count++);
+    cold_version_t &version = _active->records[position];
+    version.item_id = item_id;
+    version.value = value;
+    version.commit_time = commit_time;
+    auto head = _active_head.find(item_id);
+    version.prev = head != _active_head.end() ? head->second : -1;
+    _active_head[item_id] = position;
+    _versions++;
+}
+
+bool
+ColdStore::Find(itemid_t item_id, timestamp_t ts, int &value, timestamp_t &commit_time) {
+    collect_merge();
+
+    // the newest versions are in the active segment, then in the sealed ones from the newest
+    auto head = _active_head.find(item_id);
+    if (head != _active_head.end()) {
+        for (int32_t i = head->second; i >= 0; i = _active->records[i].prev) {
+            if (_active->records[i].commit_time <= ts) {
+                value = _active->records[i].value;
+                commit_time = _active->records[i].commit_time;
+                return true;
+            }
+        }
+    }
+    for (auto it = _sealed.rbegin(); it != _sealed.rend(); ++it) {
+        long i = find_sealed(**it, item_id, ts);
+        if (i >= 0) {
+            value = (*it)->records[i].value;
+            commit_time = (*it)->records[i].commit_time;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+ColdStore::ForEach(const std::function<void(const cold_version_t &)> &visit) {
+    collect_merge();
+    for (const segment_ptr &segment : _sealed) {
+        for (size_t i = 0; i < segment->count; ++i) {
+            visit(segment->records[i]);
+        }
+    }
+    if (_active != nullptr) {
+        for (size_t i = 0; i < _active->count; ++i) {
+            visit(_active->records[i]);
+        }
+    }
+}
+
+void
+ColdStore::Clear() {
+    wait_merge();
+    _sealed.clear();
+    _active.reset();
+    _active_head.clear();
+    _versions = 0;
+}
+
+long
+ColdStore::Versions() const {
+    return _versions;
+}
+
+size_t
+ColdStore::Segments() const {
+    return _sealed.size() + (_active != nullptr ? 1 : 0);
+}
+
+size_t
+ColdStore::MappedBytes() const {
+    size_t bytes = _active != nullptr ? _active->capacity * sizeof(cold_version_t) : 0;
+    for (const segment_ptr &segment : _sealed) {
+        bytes += segment->capacity * sizeof(cold_version_t);
+    }
+    return bytes;
+}
+
+long
+ColdStore::Merges() const {
+    return _merges;
+}
+
+ColdStore::segment_ptr
+ColdStore::new_segment(size_t capacity) {
+    std::string path = _dir + "/repcrec-cold-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    segment_ptr segment = std::make_shared<segment_t>();
+    segment->fd = mkstemp(name.data());
+    if (segment->fd < 0) {
+        err_segment(_dir);
+    }
+    // nobody else needs the name, the file goes with its last mapping
+    unlink(name.data());
+    if (ftruncate(segment->fd, static_cast<off_t>(capacity * sizeof(cold_version_t))) != 0) {
+        err_segment(_dir);
+    }
+    void *records = mmap(nullptr, capacity * sizeof(cold_version_t), PROT_READ | PROT_WRITE, MAP_SHARED,
+                         segment->fd, 0);
+    if (records == MAP_FAILED) {
+        err_segment(_dir);
+    }
+    segment->records = static_cast<cold_version_t *>(records);
+    segment->capacity = capacity;
+    return segment;
+}
+
+void
+ColdStore::seal() {
+    std::sort(_active->records, _active->records + _active->count, key_less);
+    build_index(*_active);
+    _sealed.push_back(_active);
+    _active.reset();
+    _active_head.clear();
+    maybe_merge();
+}
+
+void
+ColdStore::maybe_merge() {
+    if (_merging || _sealed.size() < MERGE_FANIN) {
+        return;
+    }
+    int level = _sealed.back()->level;
+    for (size_t i = _sealed.size() - MERGE_FANIN; i < _sealed.size(); ++i) {
+        if (_sealed[i]->level != level) {
+            return;
+        }
+    }
+
+    // the output is created here, a failure stops the run from this thread and not from under the merge
+    _merge_inputs.assign(_sealed.end() - MERGE_FANIN, _sealed.end());
+    std::vector<segment_ptr> inputs = _merge_inputs;
+    size_t total = 0;
+    for (const segment_ptr &input : inputs) {
+        total += input->count;
+    }
+    segment_ptr output = new_segment(total);
+    output->level = level + 1;
+
+    // the inputs are sealed, nothing writes to them any more: the merge reads them on its own thread
+    _merging = true;
+    _merger = std::thread([this, inputs, output, total]() {
+        // the inputs do not overlap in time, so there are no equal keys
+        std::vector<size_t> next(inputs.size(), 0);
+        while (output->count < total) {
+            size_t pick = inputs.size();
+            for (size_t k = 0; k < inputs.size(); ++k) {
+                if (next[k] == inputs[k]->count) {
+                    continue;
+                }
+                if (pick == inputs.size() || key_less(inputs[k]->records[next[k]], inputs[pick]->records[next[pick]])) {
+                    pick = k;
+                }
+            }
+            output->records[output->count++] = inputs[pick]->records[next[pick]++];
+        }
+        build_index(*output);
+
+        std::lock_guard<std::mutex> guard(_merge_mutex);
+        _merge_output = output;
+        _merge_done = true;
+    });
+}
+
+bool
+ColdStore::collect_merge() {
+    if (!_merging || !_merge_done.load()) {
+        return false;
+    }
+    _merger.join();
+    _merging = false;
+    _merge_done = false;
+    _merges++;
+
+    segment_ptr output;
+    {
+        std::lock_guard<std::mutex> guard(_merge_mutex);
+        output.swap(_merge_output);
+    }
+    // the inputs are still where they were, the segments sealed since then come after them
+    auto first = std::find(_sealed.begin(), _sealed.end(), _merge_inputs.front());
+    first = _sealed.erase(first, first + _merge_inputs.size());
+    _sealed.insert(first, output);
+    _merge_inputs.clear();
+
+    maybe_merge();
+    return true;
+}
+
+void
+ColdStore::wait_merge() {
+    if (_merging) {
+        _merger.join();
+        _merging = false;
+        _merge_done = false;
+        _merge_output.reset();
+        _merge_inputs.clear();
+    }
+}
+
+void
+ColdStore::build_index(segment_t &segment) {
+    segment.index.clear();
+    for (size_t i = 0; i < segment.count; i += INDEX_STRIDE) {
+        segment.index.push_back(std::make_pair(segment.records[i].item_id, segment.records[i].commit_time));
+    }
+}
+
+long
+ColdStore::find_sealed(const segment_t &segment, itemid_t item_id, timestamp_t ts) {
+    // the last indexed key at or before (item, ts), the version is in the stride that starts there
+    auto key = std::make_pair(item_id, ts);
+    auto it = std::upper_bound(segment.index.begin(), segment.index.end(), key);
+    if (it == segment.index.begin()) {
+        return -1;
+    }
+    size_t begin = static_cast<size_t>(it - segment.index.begin() - 1) * INDEX_STRIDE;
+    size_t end = std::min(begin + INDEX_STRIDE, segment.count);
+
+    long found = -1;
+    for (size_t i = begin; i < end; ++i) {
+        const cold_version_t &version = segment.records[i];
+        if (version.item_id > item_id || (version.item_id == item_id && version.commit_time > ts)) {
+            break;
+        }
+        found = static_cast<long>(i);
+    }
+    return found >= 0 && segment.records[found].item_id == item_id ? found : -1;
+}
@@ -0,0 +1,118 @@
+/**
+ * Date: 2026-10-18
+ * Description: The cold tier of the versions of a site (see DataMng::SetColdTier). The versions that fall out of the
+ * in-memory version lists are appended to a segment file mapped into memory. A full segment is sorted by item and
+ * commit time and sealed with a sparse index, and runs of sealed segments are merged into larger ones on a background
+ * thread, so that a lookup only visits a few of them. The files are unlinked as soon as they are created, they live
+ * as long as their mapping.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include<atomic>
+#include<cstddef>
+#include<cstdint>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+// One version in a segment file
+struct cold_version_t {
+    int32_t item_id;
+    int32_t value;
+    int32_t commit_time;
+    // in the active segment: the previous version of the same item in it, -1 if none
+    int32_t prev;
+};
+
+class ColdStore {
+public:
+    // The segment files are created in dir
+    ColdStore(const std::string &dir);
+
+    // Waits for the running merge, if any
+    ~ColdStore();
+
+    // A version older than every version of the item left in memory. Versions come in commit order
+    void Append(itemid_t item_id, int value, timestamp_t commit_time);
+
+    // The latest version of the item committed at or before ts, Ret: false if there is none here
+    bool Find(itemid_t item_id, timestamp_t ts, int &value, timestamp_t &commit_time);
+
+    // Every version, the older ones of an item before the newer ones
+    void ForEach(const std::function<void(const cold_version_t &)> &visit);
+
+    // Drop every version
+    void Clear();
+
+    long Versions() const;
+
+    size_t Segments() const;
+
+    size_t MappedBytes() const;
+
+    long Merges() const;
+
+private:
+    // A mapped segment file, unmapped once the last reference goes
+    struct segment_t {
+        int fd;
+        cold_version_t *records;
+        size_t capacity;
+        size_t count;
+        // 0 when sealed from the active segment, one more than its inputs when merged
+        int level;
+        // sealed: the key (item, commit time) of every INDEX_STRIDE-th record
+        std::vector<std::pair<itemid_t, timestamp_t>> index;
+
+        segment_t();
+
+        ~segment_t();
+    };
+
+    typedef std::shared_ptr<segment_t> segment_ptr;
+
+    std::string _dir;
+
+    // sealed segments, the oldest versions first. Their time ranges do not overlap
+    std::vector<segment_ptr> _sealed;
+
+    // the segment versions are appended to, and the last version of each item in it
+    segment_ptr _active;
+    std::unordered_map<itemid_t, int32_t> _active_head;
+
+    // the background merge: its inputs (the newest sealed segments when it started) and its output once done
+    std::thread _merger;
+    bool _merging;
+    std::vector<segment_ptr> _merge_inputs;
+    std::mutex _merge_mutex;
+    segment_ptr _merge_output;
+    std::atomic<bool> _merge_done;
+
+    long _versions;
+    long _merges;
+
+    segment_ptr new_segment(size_t capacity);
+
+    // Sort the full active segment and add it to the sealed ones
+    void seal();
+
+    // Start a merge if the newest sealed segments are enough of the same level
+    void maybe_merge();
+
+    // Put the output of a finished merge in place of its inputs, Ret: true if there was one
+    bool collect_merge();
+
+    void wait_merge();
+
+    static void build_index(segment_t &segment);
+
+    // the latest version of the item at or before ts in a sealed segment, Ret: its position, or -1
+    static long find_sealed(const segment_t &segment, itemid_t item_id, timestamp_t ts);
+};
@@ -1,6 +1,10 @@
 #pragma once
 #define SITE_COUNT 10
+
+// The benchmarks are built with a larger catalog
+#ifndef ITEM_COUNT
 #define ITEM_COUNT 20
+#endif
 
 typedef int transid_t;
 typedef int siteid_t;
@@ -12,7 +16,27 @@ typedef int timestamp_t;
 enum op_type_t {
     OP_READ,
     OP_WRITE,
-    OP_RONLY
+    OP_RONLY,
+    // RR(T, xlo, xhi) and MW(T, [x=v, ...]): the items live in the TM, see TransMng::multi_op_t
+    OP_READ_RANGE,
+    OP_WRITE_MULTI,
+    // SUM(T, xlo, xhi) and SCAN(T, xlo, xhi) of read-only transactions, see s_param_t
+    OP_SUM,
+    OP_SCAN,
+    // INC(T, x, delta): a w_param_t, the value is the delta
+    OP_INC
+};
+
+// The order in which waiting work is served, both the op queue of the TM and the lock queue of each item
+enum sched_policy_t {
+    // arrival order (the default)
+    POLICY_FIFO,
+    // the transaction that began first
+    POLICY_OLDEST,
+    // the transaction with the fewest locks taken or waited for so far (the shortest one so far)
+    POLICY_FEWEST_LOCKS,
+    // the highest priority given by beginP(Tn, prio), begin(Tn) is priority 0
+    POLICY_PRIORITY
 };
 
 // A write operation have two params: x, v 
@@ -26,9 +50,16 @@ struct r_param_t {
     itemid_t item_id;
 };
 
+// A snapshot scan covers the items [first, last]
+struct s_param_t {
+    itemid_t first;
+    itemid_t last;
+};
+
 union op_param_t {
     w_param_t w_param;
     r_param_t r_param;
+    s_param_t s_param;
 };
 
 // An operation looks like: W1(x, v) or R1(x)
@@ -6,27 +6,89 @@
  *  -----------------------------------------------------------------------------------------
  *          name          |         Inputs       |                  output
  *  -----------------------------------------------------------------------------------------
+ *  SaveStable            |out                   |
+ *  -----------------------------------------------------------------------------------------
+ *  LogCommit             |out, trans_ids, ts    |
+ *  -----------------------------------------------------------------------------------------
+ *  LoadStable            |in                    |true if the stable log is well formed
+ *  -----------------------------------------------------------------------------------------
  *  GetReadLock           |trans_id, item_id     |true if read lock granted, otherwise false
  *  -----------------------------------------------------------------------------------------
  *  GetWriteLock          |trans_id, item_id     |true if write lock granted, otherwise false
  *  -----------------------------------------------------------------------------------------
+ *  GetIncrementLock      |trans_id, item_id     |true if increment lock granted, otherwise false
+ *  -----------------------------------------------------------------------------------------
+ *  Export                |ts, path, format      |the number of records written
+ *  -----------------------------------------------------------------------------------------
  *  Abort                 |trans_id              |
  *  -----------------------------------------------------------------------------------------
  *  Read                  |op                    |true if data could be readed, otherwise false
  *  -----------------------------------------------------------------------------------------
  *  Ronly                 |op, ts                |true if data could be readed, otherwise false
  *  -----------------------------------------------------------------------------------------
+ *  SnapshotScan          |first, last, ts, ...  |the items served and missed
+ *  -----------------------------------------------------------------------------------------
  *  Write                 |op                    |
  *  -----------------------------------------------------------------------------------------
+ *  LockAndWrite          |op                    |true if write lock granted and written
+ *  -----------------------------------------------------------------------------------------
+ *  LockAndReadBatch      |ops                   |GetReadLock and Read result of each op
+ *  -----------------------------------------------------------------------------------------
+ *  LockAndWriteBatch     |ops                   |LockAndWrite result of each op
+ *  -----------------------------------------------------------------------------------------
+ *  LockAndIncrement      |op                    |applied, wait or stale
+ *  -----------------------------------------------------------------------------------------
  *  Commit                |trans_id, conmmit_time|
  *  -----------------------------------------------------------------------------------------
+ *  GroupCommit           |trans_ids, commit_time|
+ *  -----------------------------------------------------------------------------------------
  *  GetWaitingGraph       |                      |
  *  -----------------------------------------------------------------------------------------
+ *  SetEscalationThreshold|threshold             |
+ *  -----------------------------------------------------------------------------------------
+ *  SetTransRank          |trans_id, rank        |
+ *  -----------------------------------------------------------------------------------------
+ *  SetTracer             |tracer                |
+ *  -----------------------------------------------------------------------------------------
+ *  SetColdTier           |dir, hot_versions     |
+ *  -----------------------------------------------------------------------------------------
+ *  site_covers           |trans_id, lock_type   |true if the site lock covers the item lock
+ *  -----------------------------------------------------------------------------------------
+ *  get_intention_lock    |trans_id, lock_type   |true if IS/IX granted, otherwise false
+ *  -----------------------------------------------------------------------------------------
+ *  note_item_lock        |trans_id, is_new, type|
+ *  -----------------------------------------------------------------------------------------
+ *  release_site_lock     |trans_id              |
+ *  -----------------------------------------------------------------------------------------
+ *  build_columns         |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  update_column         |item_id, value, ts    |
+ *  -----------------------------------------------------------------------------------------
+ *  install_version       |item_id, value, ts    |
+ *  -----------------------------------------------------------------------------------------
+ *  push_version          |item_id, version      |
+ *  -----------------------------------------------------------------------------------------
+ *  versions_of           |item_id               |the version list of the item
+ *  -----------------------------------------------------------------------------------------
+ *  version_at            |item_id, ts, version  |true if a version was committed at or before ts
+ *  -----------------------------------------------------------------------------------------
+ *  latest_value          |item_id               |the latest committed value
+ *  -----------------------------------------------------------------------------------------
+ *  readable              |item_id               |true if the item can be read here
+ *  -----------------------------------------------------------------------------------------
+ *  get_trans             |trans_id              |the trans table entry
+ *  -----------------------------------------------------------------------------------------
+ *  drop_trans            |trans_id              |
+ *  -----------------------------------------------------------------------------------------
+ *  drop_all_trans        |                      |
+ *  -----------------------------------------------------------------------------------------
  *  try_resolve_lock_table|                      |
  *  -----------------------------------------------------------------------------------------
  *  check_lock_queue      |                      |true if its in lock queue, otherwise false
  *  -----------------------------------------------------------------------------------------
- *  check_item_conflict   |_lhs, _rhs            |true if conflicted, otherwise false
+ *  check_item_compatible |_lhs, _rhs            |true if compatible, otherwise false
+ *  -----------------------------------------------------------------------------------------
+ *  granted_type          |held, requested       |the lock type after the grant
  *  -----------------------------------------------------------------------------------------
  *  check_already_hold    |item_id, _rhs         |true if it's locked, otherwise false
  *  -----------------------------------------------------------------------------------------
@@ -34,21 +96,57 @@
  *  -----------------------------------------------------------------------------------------
  *  check_queued_conflict |item_id, _rhs         |true if conflicted, otherwise false
  *  -----------------------------------------------------------------------------------------
+ *  make_request          |trans_id, lock_type   |the lock queue item with the rank of the transaction
+ *  -----------------------------------------------------------------------------------------
+ *  enqueue               |lock_item, item       |
+ *  -----------------------------------------------------------------------------------------
+ *  lock_item_of          |item_id               |the lock table entry of the item
+ *  -----------------------------------------------------------------------------------------
 **/
 #include "DataMng.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <queue>
-
-#include "TransMng.h"
-
-extern TransMng *TM;
+#include <string>
 
 namespace {
+    // a dump export is written in chunks of this size, a record takes at most EXPORT_RECORD_MAX bytes
+    const size_t EXPORT_CHUNK = 64 * 1024;
+    const size_t EXPORT_RECORD_MAX = 48;
+
+    // write n in decimal at out, Ret: the number of chars written
+    size_t format_int(char *out, int n) {
+        char digits[12];
+        size_t count = 0;
+        unsigned magnitude = n < 0 ? 0u - static_cast<unsigned>(n) : static_cast<unsigned>(n);
+        do {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+        size_t length = 0;
+        if (n < 0) {
+            out[length++] = '-';
+        }
+        while (count > 0) {
+            out[length++] = digits[--count];
+        }
+        return length;
+    }
+
     bool is_replicated(itemid_t item_id) {
         return item_id % 2 == 0;
     }
 
+    // the value of an item before its first commit
+    int initial_value(itemid_t item_id) {
+        return item_id * 10;
+    }
+
     void err_invalid_case() {
         std::cout << "ERROR: Invalid Switch Case\n";
         std::exit(-1);
@@ -60,41 +158,130 @@ namespace {
     };
 } // helper functions
 
-DataMng::DataMng(siteid_t site_id) {
+DataMng::DataMng(siteid_t site_id, SiteListener *listener, std::ostream &out) : _out(out) {
     // basic stuff
     _site_id = site_id;
     _is_up = true;
+    _listener = listener;
+    _tracer = nullptr;
+    _escalation_threshold = 0;
+    _escalations = 0;
 
-    // initialize the data items
-    for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
-        if ((item_id % 2 == 0) || (1 + (item_id % 10) == site_id)) {
-            // commit time = -1 means initial values
-            _disk[item_id].push_back(disk_item(item_id * 10, -1));
+    // the data items are initialized lazily (see versions_of), at first every item is readable
+    _replicas_stale = false;
+
+    _hot_versions = 0;
+    _hot_count = 0;
+}
+
+void
+DataMng::SaveStable(std::ostream &out) {
+    for (timestamp_t ts : _last_fail_time) {
+        out << "fail " << ts << "\n";
+    }
+    for (timestamp_t ts : _last_up_time) {
+        out << "up " << ts << "\n";
+    }
+
+    // the oldest version first, so that replaying the log rebuilds the version lists. The initial versions are implied
+    if (_cold != nullptr) {
+        _cold->ForEach([&out](const cold_version_t &version) {
+            out << "v " << version.item_id << " " << version.value << " " << version.commit_time << "\n";
+        });
+    }
+    for (const auto &p : _disk) {
+        for (auto it = p.second.rbegin(); it != p.second.rend(); ++it) {
+            if (it->commit_time != -1) {
+                out << "v " << p.first << " " << it->value << " " << it->commit_time << "\n";
+            }
+        }
+    }
+}
+
+void
+DataMng::LogCommit(std::ostream &out, const std::vector<transid_t> &trans_ids, timestamp_t commit_time) {
+    // an increment adds to whatever the transactions before it in the group leave
+    std::unordered_map<itemid_t, int> latest;
+    for (transid_t trans_id : trans_ids) {
+        auto it = _trans_table.find(trans_id);
+        if (it == _trans_table.end()) {
+            continue;
+        }
+        for (const auto &write : it->second.write_buffer) {
+            out << "v " << write.first << " " << write.second << " " << commit_time << "\n";
+            latest[write.first] = write.second;
+        }
+        for (const auto &increment : it->second.increments) {
+            auto value = latest.find(increment.first);
+            int base = value != latest.end() ? value->second : latest_value(increment.first);
+            out << "v " << increment.first << " " << base + increment.second << " " << commit_time << "\n";
+            latest[increment.first] = base + increment.second;
+        }
+    }
+}
 
-            // since we have small number of data items, we can cache all of them in memory
-            _memory[item_id] = mem_item(item_id * 10);
-            _readable[item_id] = true;
+bool
+DataMng::LoadStable(std::istream &in) {
+    _last_fail_time.clear();
+    _last_up_time.clear();
+    _disk.clear();
+    _hot_count = 0;
+    if (_cold != nullptr) {
+        _cold->Clear();
+    }
 
+    std::string tag;
+    while (in >> tag) {
+        timestamp_t ts;
+        if (tag == "fail" && in >> ts) {
+            _last_fail_time.push_back(ts);
+        } else if (tag == "up" && in >> ts) {
+            _last_up_time.push_back(ts);
+        } else if (tag == "v") {
+            itemid_t item_id;
+            disk_item version;
+            if (!(in >> item_id >> version.value >> version.commit_time)) {
+                return false;
+            }
+            if (version.commit_time != -1) {
+                push_version(item_id, version);
+            }
+        } else {
+            return false;
         }
     }
+
+    build_columns();
+
+    // nothing in memory survives, the site has to recover first
+    _is_up = false;
+    _memory.clear();
+    _readable.clear();
+    _replicas_stale = true;
+    _lock_table.clear();
+    drop_all_trans();
+    return true;
 }
 
 void
 DataMng::Abort(transid_t trans_id) {
-    const auto &trans_info = _trans_table[trans_id];
-
     // clean up the locks
     for (auto &p : _lock_table) {
         lock_table_item_t &lock_item = p.second;
+
+        // clean up the lock queue, including the items it waits for without holding them. A request left behind
+        // would later be granted to a transaction nobody releases
+        if (_tracer != nullptr) {
+            _tracer->LockWaitEnd(_site_id, trans_id, p.first, "aborted");
+        }
+        lock_item.lock_queue.remove_if([trans_id](const lock_queue_item_t &item) {
+            return item.trans_id == trans_id;
+        });
+
         if (lock_item.trans_holding.count(trans_id)) {
             // clean up the lock table
             lock_item.trans_holding.erase(trans_id);
 
-            // clean up the lock queue
-            lock_item.lock_queue.remove_if([trans_id](const lock_queue_item_t &item) {
-                return item.trans_id == trans_id;
-            });
-
             // free up the lock
             if (lock_item.trans_holding.empty()) {
                 lock_item.lock_type = NONE;
@@ -102,13 +289,9 @@ DataMng::Abort(transid_t trans_id) {
         }
     }
 
-    // recover the modifed data
-    for (itemid_t item_id : _trans_table[trans_id].modified_item) {
-        _memory[item_id].value = _disk[item_id].front().value;
-    }
-
-    // clean up trans table
-    _trans_table.erase(trans_id);
+    // clean up trans table, its writes never left its write buffer
+    drop_trans(trans_id);
+    release_site_lock(trans_id);
 
     // now we freed up some locks, hopefully we can execute some commands
     try_resolve_lock_table();
@@ -116,17 +299,85 @@ DataMng::Abort(transid_t trans_id) {
 
 void
 DataMng::Dump() {
-    std::cout << "site " << _site_id << " - ";
-    for (const auto &p : _disk) {
-        std::cout << "x" << p.first << ": " << p.second.front().value << ", ";
+    _out << "site " << _site_id << " - ";
+    auto it = _disk.begin();
+    for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
+        if (!is_replicated(item_id) && 1 + (item_id % 10) != _site_id) {
+            continue;
+        }
+        while (it != _disk.end() && it->first < item_id) {
+            ++it;
+        }
+        int value = (it != _disk.end() && it->first == item_id) ? it->second.front().value : initial_value(item_id);
+        _out << "x" << item_id << ": " << value << ", ";
     }
-    std::cout << std::endl;
+    _out << std::endl;
 }
 
 void
 DataMng::DumpItem(itemid_t item_id) {
-    std::cout << "site " << _site_id << " - ";
-    std::cout << "x" << item_id << ": " << _disk[item_id].front().value << std::endl;
+    _out << "site " << _site_id << " - ";
+    _out << "x" << item_id << ": " << latest_value(item_id) << std::endl;
+}
+
+long
+DataMng::Export(timestamp_t ts, const std::string &path, dump_format_t format) {
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        std::cout << "ERROR: Cannot write the export of Site " << _site_id << "\n";
+        std::exit(-1);
+    }
+
+    // the records go out a chunk at a time, whatever the size of the catalog
+    char chunk[EXPORT_CHUNK];
+    size_t used = 0;
+    long records = 0;
+    // the latest versions come from the column copy, in item order, _disk is only walked for the items
+    // committed after ts
+    size_t next[2] = {0, 0};
+    for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
+        bool replicated = is_replicated(item_id);
+        if (!replicated && 1 + (item_id % 10) != _site_id) {
+            continue;
+        }
+        const column_set_t &columns = _columns[replicated ? 1 : 0];
+        size_t &i = next[replicated ? 1 : 0];
+        int value = initial_value(item_id);
+        if (i < columns.items.size() && columns.items[i] == item_id) {
+            disk_item version;
+            if (columns.commit_times[i] <= ts) {
+                value = columns.values[i];
+            } else if (version_at(item_id, ts, version)) {
+                value = version.value;
+            }
+            i++;
+        }
+
+        if (EXPORT_CHUNK - used < EXPORT_RECORD_MAX) {
+            std::fwrite(chunk, 1, used, file);
+            used = 0;
+        }
+        if (format == DUMP_BINARY) {
+            int32_t record[3] = {_site_id, item_id, value};
+            std::memcpy(chunk + used, record, sizeof(record));
+            used += sizeof(record);
+        } else {
+            // snprintf would cost more than the rest of the export
+            int fields[4] = {ts, _site_id, item_id, value};
+            for (int field = 0; field < 4; ++field) {
+                used += format_int(chunk + used, fields[field]);
+                chunk[used++] = field < 3 ? ',' : '\n';
+            }
+        }
+        records++;
+    }
+    std::fwrite(chunk, 1, used, file);
+
+    if (std::fclose(file) != 0) {
+        std::cout << "ERROR: Cannot write the export of Site " << _site_id << "\n";
+        std::exit(-1);
+    }
+    return records;
 }
 
 void
@@ -138,7 +389,9 @@ DataMng::Fail(timestamp_t _ts) {
     _memory.clear();
     _readable.clear();
     _lock_table.clear();
-    _trans_table.clear();
+    _site_holders.clear();
+    _site_waiters.clear();
+    drop_all_trans();
 }
 
 void
@@ -147,11 +400,18 @@ DataMng::Recover(timestamp_t _ts) {
     _last_up_time.push_back(_ts);
 
     // we don't allow to read replicated data until we COMMIT a write on it
+    _memory.clear();
     for (const auto &p : _disk) {
-        itemid_t item_id = p.first;
-        disk_item latest_val = p.second.front();
-        _memory[item_id] = mem_item(latest_val.value);
-        _readable[item_id] = !is_replicated(item_id);
+        _memory[p.first] = mem_item(p.second.front().value);
+    }
+    _readable.clear();
+    _replicas_stale = true;
+
+    // recovering a site that is up reloads the writes of its transactions from disk as well
+    for (auto &p : _trans_table) {
+        for (auto &write : p.second.write_buffer) {
+            write.second = latest_value(write.first);
+        }
     }
 }
 
@@ -159,28 +419,46 @@ DataMng::Recover(timestamp_t _ts) {
 bool
 DataMng::GetReadLock(transid_t trans_id, itemid_t item_id) {
 
-    if (!_readable[item_id]) {
+    if (!readable(item_id)) {
+        if (_tracer != nullptr) {
+            _tracer->Unreadable(_site_id, trans_id, item_id);
+        }
         return false;
     }
 
-    lock_queue_item_t new_queue_item(trans_id, S);
-    lock_table_item_t &lock_item = _lock_table[item_id];
+    // with escalation, the site level is locked first
+    if (_escalation_threshold > 0) {
+        if (site_covers(trans_id, S)) {
+            return true;
+        }
+        if (!get_intention_lock(trans_id, S)) {
+            return false;
+        }
+    }
+
+    lock_queue_item_t new_queue_item = make_request(trans_id, S);
+    lock_table_item_t &lock_item = lock_item_of(item_id);
 
     if (check_already_hold(item_id, new_queue_item) ||
         (check_holding_conflict(item_id, new_queue_item) &&
          check_queued_conflict(item_id, new_queue_item))) {
+        bool held = lock_item.trans_holding.count(trans_id) > 0;
+
         // update the lock table
-        if (lock_item.lock_type == NONE) {
-            lock_item.lock_type = S;
-        }
+        lock_item.lock_type = granted_type(lock_item.lock_type, S);
         lock_item.trans_holding.insert(trans_id);
 
         // grant lock
+        if (_escalation_threshold > 0) {
+            note_item_lock(trans_id, !held, S);
+        }
         return true;
     } else {
         // append this operation to the end of the lock queue
-        if (!lock_item.check_exist(new_queue_item)) {
-            lock_item.lock_queue.push_back(new_queue_item);
+        enqueue(lock_item, new_queue_item);
+        _listener->ReceiveLockWait(trans_id, _site_id);
+        if (_tracer != nullptr) {
+            _tracer->LockWaitBegin(_site_id, trans_id, item_id, false);
         }
 
         // update the transaction table
@@ -196,19 +474,31 @@ DataMng::Read(op_t op) {
     itemid_t item_id = op.param.r_param.item_id;
     transid_t trans_id = op.trans_id;
 
-    if (!_readable[item_id]) {
+    if (!readable(item_id)) {
         return false;
     }
 
-    if (_lock_table[item_id].trans_holding.count(trans_id)) {
-        // execute the operation
-        int value = _memory[item_id].value;
+    if (site_covers(trans_id, S) || lock_item_of(item_id).trans_holding.count(trans_id)) {
+        // execute the operation, a transaction reads its own write
+        auto committed = _memory.find(item_id);
+        int value = committed != _memory.end() ? committed->second.value : initial_value(item_id);
+        auto it = _trans_table.find(trans_id);
+        if (it != _trans_table.end()) {
+            auto write = it->second.write_buffer.find(item_id);
+            if (write != it->second.write_buffer.end()) {
+                value = write->second;
+            }
+            auto increment = it->second.increments.find(item_id);
+            if (increment != it->second.increments.end()) {
+                value += increment->second;
+            }
+        }
 
         // send the result back to TM
-        TM->ReceiveReadResponse(op, _site_id, value);
+        _listener->ReceiveReadResponse(op, _site_id, value);
         return true;
     } else {
-        std::cout << "ERROR: Unsafe to read\n";
+        _out << "ERROR: Unsafe to read\n";
     }
 
     return false;
@@ -220,56 +510,158 @@ DataMng::Ronly(op_t op, timestamp_t ts) {
     transid_t trans_id = op.trans_id;
 
     // go through the disk, find the latest commit before this ts
-    const auto &value_list = _disk[item_id];
-    for (auto it = value_list.begin(); it != value_list.end(); it++) {
-        if (it->commit_time <= ts) {
-            // for r-only transactions, we have a different logic of "non-readable":
-            // We need the to the version that was last to commit to before transaction begins
-            if (is_replicated(item_id)) {
-                for(timestamp_t last_fail_time: _last_fail_time){
-                    if (ts >= last_fail_time && it->commit_time < last_fail_time) {
-                        return false;
-                    }
-                }
-                TM->ReceiveReadResponse(op, _site_id, it->value);
-                return true;
-            } else {
-                TM->ReceiveReadResponse(op, _site_id, it->value);
-                return true;
+    disk_item version;
+    if (!version_at(item_id, ts, version)) {
+        err_inconsist();
+        return false;
+    }
+
+    // for r-only transactions, we have a different logic of "non-readable":
+    // We need the to the version that was last to commit to before transaction begins
+    if (is_replicated(item_id)) {
+        for (timestamp_t last_fail_time: _last_fail_time) {
+            if (ts >= last_fail_time && version.commit_time < last_fail_time) {
+                return false;
             }
         }
     }
+    _listener->ReceiveReadResponse(op, _site_id, version.value);
+    return true;
+}
 
-    err_inconsist();
-    return false;
+snapshot_t
+DataMng::SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts, bool with_values) {
+    snapshot_t result;
+
+    // the items of this kind hosted here in [first, last]: every other item if replicated, else every tenth
+    // item (and only on the even sites)
+    itemid_t step = replicated ? 2 : 10;
+    itemid_t next = replicated ? first + first % 2 : first + ((_site_id - 1 - first % 10) % 10 + 10) % 10;
+    if ((!replicated && _site_id % 2 == 1) || next > last) {
+        return result;
+    }
+    long long hosted = (last - next) / step + 1;
+
+    const column_set_t &columns = _columns[replicated ? 1 : 0];
+    size_t begin = std::lower_bound(columns.items.begin(), columns.items.end(), first) - columns.items.begin();
+    size_t end = std::upper_bound(columns.items.begin(), columns.items.end(), last) - columns.items.begin();
+
+    // a replicated version older than a failure of this site before ts may have missed writes (see Ronly),
+    // so a version is served only if it is not older than the last such failure
+    timestamp_t oldest = std::numeric_limits<timestamp_t>::min();
+    if (replicated) {
+        for (timestamp_t fail_time : _last_fail_time) {
+            if (fail_time <= ts && fail_time > oldest) {
+                oldest = fail_time;
+            }
+        }
+    }
+
+    const itemid_t *items = columns.items.data();
+    const int *values = columns.values.data();
+    const timestamp_t *commit_times = columns.commit_times.data();
+    if (!with_values) {
+        // the latest versions committed at or before ts, without branches so that it is vectorized
+        long long sum = 0;
+        long long item_sum = 0;
+        int count = 0;
+        for (size_t i = begin; i < end; ++i) {
+            bool visible = (commit_times[i] <= ts) & (commit_times[i] >= oldest);
+            sum += visible ? values[i] : 0;
+            count += visible;
+            item_sum += items[i];
+        }
+
+        // the items never committed are still at their initial version (committed at -1), in closed form
+        if (oldest <= -1) {
+            long long untouched_sum = hosted * next + step * hosted * (hosted - 1) / 2 - item_sum;
+            sum += 10 * untouched_sum;
+            count += static_cast<int>(hosted - (end - begin));
+        }
+        result.sum = sum;
+        result.count = count;
+        if (count == hosted) {
+            return result;
+        }
+    }
+
+    // the items left out above, or all of them if the values are asked for
+    size_t i = begin;
+    for (itemid_t item_id = next; item_id <= last; item_id += step) {
+        int value = initial_value(item_id);
+        timestamp_t commit_time = -1;
+        if (i < end && items[i] == item_id) {
+            value = values[i];
+            commit_time = commit_times[i];
+            ++i;
+        }
+        if (!with_values && commit_time <= ts && commit_time >= oldest) {
+            continue;
+        }
+        if (commit_time > ts) {
+            // written since ts, find the version that was the latest at ts
+            disk_item version;
+            if (!version_at(item_id, ts, version)) {
+                err_inconsist();
+            }
+            value = version.value;
+            commit_time = version.commit_time;
+        }
+        if (commit_time < oldest) {
+            result.missed.push_back(item_id);
+            continue;
+        }
+
+        if (with_values) {
+            result.items.push_back(item_id);
+            result.values.push_back(value);
+        }
+        result.sum += value;
+        result.count++;
+    }
+    return result;
 }
 
 bool
 DataMng::GetWriteLock(transid_t trans_id, itemid_t item_id) {
 
-    lock_queue_item_t new_queue_item(trans_id, X);
-    lock_table_item_t &lock_item = _lock_table[item_id];
+    // with escalation, the site level is locked first
+    if (_escalation_threshold > 0) {
+        if (site_covers(trans_id, X)) {
+            return true;
+        }
+        if (!get_intention_lock(trans_id, X)) {
+            return false;
+        }
+    }
+
+    lock_queue_item_t new_queue_item = make_request(trans_id, X);
+    lock_table_item_t &lock_item = lock_item_of(item_id);
 
     if (check_already_hold(item_id, new_queue_item) ||
         (check_holding_conflict(item_id, new_queue_item) &&
          check_queued_conflict(item_id, new_queue_item))) {
+        bool held = lock_item.trans_holding.count(trans_id) > 0;
 
         // upgrade the lock type
-        if (lock_item.lock_type == S || lock_item.lock_type == NONE) {
-            lock_item.lock_type = X;
-        }
+        lock_item.lock_type = granted_type(lock_item.lock_type, X);
         lock_item.trans_holding.insert(trans_id);
 
         // update the transaction table
         // _trans_table[trans_id].locks_holding.insert(item_id);
 
         // Grant lock to TM
+        if (_escalation_threshold > 0) {
+            note_item_lock(trans_id, !held, X);
+        }
         return true;
     } else {
 
         // append this operation to the end of the lock queue
-        if (!lock_item.check_exist(new_queue_item)) {
-            lock_item.lock_queue.push_back(new_queue_item);
+        enqueue(lock_item, new_queue_item);
+        _listener->ReceiveLockWait(trans_id, _site_id);
+        if (_tracer != nullptr) {
+            _tracer->LockWaitBegin(_site_id, trans_id, item_id, true);
         }
 
         // update the transaction table
@@ -281,120 +673,382 @@ DataMng::GetWriteLock(transid_t trans_id, itemid_t item_id) {
     return false;
 }
 
+bool
+DataMng::GetIncrementLock(transid_t trans_id, itemid_t item_id) {
+
+    // with escalation, the site level is locked first, like for a write
+    if (_escalation_threshold > 0) {
+        if (site_covers(trans_id, I)) {
+            return true;
+        }
+        if (!get_intention_lock(trans_id, I)) {
+            return false;
+        }
+    }
+
+    lock_queue_item_t new_queue_item = make_request(trans_id, I);
+    lock_table_item_t &lock_item = lock_item_of(item_id);
+
+    if (check_already_hold(item_id, new_queue_item) ||
+        (check_holding_conflict(item_id, new_queue_item) &&
+         check_queued_conflict(item_id, new_queue_item))) {
+        bool held = lock_item.trans_holding.count(trans_id) > 0;
+
+        // an increment on top of its own read needs X
+        lock_item.lock_type = granted_type(lock_item.lock_type, I);
+        lock_item.trans_holding.insert(trans_id);
+
+        if (_escalation_threshold > 0) {
+            note_item_lock(trans_id, !held, I);
+        }
+        return true;
+    }
+
+    // append this operation to the end of the lock queue
+    enqueue(lock_item, new_queue_item);
+    _listener->ReceiveLockWait(trans_id, _site_id);
+    if (_tracer != nullptr) {
+        _tracer->LockWaitBegin(_site_id, trans_id, item_id, true);
+    }
+    return false;
+}
+
 void
 DataMng::Write(op_t op) {
     itemid_t item_id = op.param.w_param.item_id;
     int write_val = op.param.w_param.value;
     transid_t trans_id = op.trans_id;
 
-    if (check_already_hold(item_id, lock_queue_item_t(trans_id, X))) {
+    if (site_covers(trans_id, X) || check_already_hold(item_id, lock_queue_item_t(trans_id, X))) {
 
-        // update the transaction table
-        _trans_table[trans_id].modified_item.insert(item_id);
+        // execute the operation in the write buffer of the transaction, it replaces its increments so far
+        trans_table_item &trans = get_trans(trans_id);
+        trans.write_buffer[item_id] = write_val;
+        trans.increments.erase(item_id);
+
+        _listener->ReceiveWriteResponse(op, _site_id);
+    } else {
+        _out << "ERROR: Unsafe to write\n";
+    }
+}
+
+bool
+DataMng::LockAndWrite(op_t op) {
+    itemid_t item_id = op.param.w_param.item_id;
+    transid_t trans_id = op.trans_id;
+
+    if (!GetWriteLock(trans_id, item_id)) {
+        return false;
+    }
 
-        // execute the operation
-        _memory[item_id].value = write_val;
+    // execute the operation in the write buffer of the transaction, it replaces its increments so far
+    trans_table_item &trans = get_trans(trans_id);
+    trans.write_buffer[item_id] = op.param.w_param.value;
+    trans.increments.erase(item_id);
+    return true;
+}
 
-        TM->ReceiveWriteResponse(op, _site_id);
+std::vector<bool>
+DataMng::LockAndWriteBatch(const std::vector<op_t> &ops) {
+    std::vector<bool> granted;
+    granted.reserve(ops.size());
+    for (const op_t &op : ops) {
+        granted.push_back(LockAndWrite(op));
+    }
+    return granted;
+}
+
+inc_result_t
+DataMng::LockAndIncrement(op_t op) {
+    itemid_t item_id = op.param.w_param.item_id;
+    transid_t trans_id = op.trans_id;
+
+    // the delta is added to the current value, which a recovered replica may not have
+    if (!readable(item_id)) {
+        return INC_STALE;
+    }
+    if (!GetIncrementLock(trans_id, item_id)) {
+        return INC_WAIT;
+    }
+
+    trans_table_item &trans = get_trans(trans_id);
+    auto write = trans.write_buffer.find(item_id);
+    if (write != trans.write_buffer.end()) {
+        write->second += op.param.w_param.value;
     } else {
-        std::cout << "ERROR: Unsafe to write\n";
+        trans.increments[item_id] += op.param.w_param.value;
+    }
+    return INC_APPLIED;
+}
+
+std::vector<bool>
+DataMng::LockAndReadBatch(const std::vector<op_t> &ops) {
+    std::vector<bool> granted;
+    granted.reserve(ops.size());
+    for (const op_t &op : ops) {
+        granted.push_back(GetReadLock(op.trans_id, op.param.r_param.item_id) && Read(op));
     }
+    return granted;
 }
 
 void
 DataMng::Commit(transid_t trans_id, timestamp_t commit_time) {
-    auto err_not_safe_commit = []() {
-        std::cout << "Debug Info: Items in lock queue at commit time\n";
+    GroupCommit(std::vector<transid_t>(1, trans_id), commit_time);
+}
+
+void
+DataMng::GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) {
+    auto err_not_safe_commit = [this]() {
+        _out << "Debug Info: Items in lock queue at commit time\n";
     };
 
-    // clean up the locks
+    // clean up the locks of the whole group in a single pass over the lock table
+    std::unordered_set<transid_t> released;
+    auto is_released = [&released](const lock_queue_item_t &item) {
+        return released.count(item.trans_id) > 0;
+    };
+    std::unordered_set<transid_t> committing(trans_ids.begin(), trans_ids.end());
+    auto is_committing = [&committing](const lock_queue_item_t &item) {
+        return committing.count(item.trans_id) > 0;
+    };
     for (auto &p : _lock_table) {
         lock_table_item_t &lock_item = p.second;
-        if (lock_item.trans_holding.count(trans_id)) {
-            // clean up the lock table
-            lock_item.trans_holding.erase(trans_id);
-
-            // clean up the lock queue
-            size_t ori_size = lock_item.lock_queue.size();
-            lock_item.lock_queue.remove_if([trans_id](const lock_queue_item_t &item) {
-                return item.trans_id == trans_id;
-            });
-            size_t new_size = lock_item.lock_queue.size();
-            if (ori_size != new_size) {
-                err_not_safe_commit();
+        released.clear();
+        for (transid_t trans_id : trans_ids) {
+            if (lock_item.trans_holding.erase(trans_id)) {
+                released.insert(trans_id);
             }
-
-            // free up the lock
-            if (lock_item.trans_holding.empty()) {
-                lock_item.lock_type = NONE;
+        }
+        if (released.empty()) {
+            // a request for an item it never got (e.g. a read served by another replica): left behind, it would be
+            // granted later to a transaction nobody releases
+            if (!lock_item.lock_queue.empty()) {
+                lock_item.lock_queue.remove_if(is_committing);
             }
+            continue;
         }
-    }
 
-    // write everything changed back to disk
-    for (itemid_t item_id : _trans_table[trans_id].modified_item) {
-        int value = _memory[item_id].value;
-        _disk[item_id].push_front(disk_item(value, commit_time));
+        // clean up the lock queue
+        size_t ori_size = lock_item.lock_queue.size();
+        lock_item.lock_queue.remove_if(is_released);
+        size_t new_size = lock_item.lock_queue.size();
+        if (ori_size != new_size) {
+            err_not_safe_commit();
+        }
+
+        // and the stale requests of the other members, which do not hold it
+        if (released.size() < committing.size()) {
+            lock_item.lock_queue.remove_if(is_committing);
+        }
 
-        // now we allow to read this value
-        _readable[item_id] = true;
+        // free up the lock
+        if (lock_item.trans_holding.empty()) {
+            lock_item.lock_type = NONE;
+        }
     }
 
-    // clean up transaction table
-    _trans_table.erase(trans_id);
+    // install the write buffers as new versions, in commit order
+    for (transid_t trans_id : trans_ids) {
+        auto it = _trans_table.find(trans_id);
+        if (it == _trans_table.end()) {
+            continue;
+        }
+        for (const auto &write : it->second.write_buffer) {
+            install_version(write.first, write.second, commit_time);
+        }
+        for (const auto &increment : it->second.increments) {
+            install_version(increment.first, latest_value(increment.first) + increment.second, commit_time);
+        }
+
+        // clean up transaction table
+        drop_trans(trans_id);
+    }
+    for (transid_t trans_id : trans_ids) {
+        release_site_lock(trans_id);
+    }
 
-    // now, since we have committed a transaction, hopefully we can finish some queued operations
+    // now, since we have committed the group, hopefully we can finish some queued operations
     try_resolve_lock_table();
 }
 
+void
+DataMng::build_columns() {
+    for (column_set_t &columns : _columns) {
+        columns.items.clear();
+        columns.values.clear();
+        columns.commit_times.clear();
+    }
+    for (const auto &p : _disk) {
+        column_set_t &columns = _columns[is_replicated(p.first) ? 1 : 0];
+        columns.items.push_back(p.first);
+        columns.values.push_back(p.second.front().value);
+        columns.commit_times.push_back(p.second.front().commit_time);
+    }
+}
+
+void
+DataMng::update_column(itemid_t item_id, int value, timestamp_t commit_time) {
+    column_set_t &columns = _columns[is_replicated(item_id) ? 1 : 0];
+    size_t i = std::lower_bound(columns.items.begin(), columns.items.end(), item_id) - columns.items.begin();
+    if (i == columns.items.size() || columns.items[i] != item_id) {
+        // the first commit of this item
+        columns.items.insert(columns.items.begin() + i, item_id);
+        columns.values.insert(columns.values.begin() + i, value);
+        columns.commit_times.insert(columns.commit_times.begin() + i, commit_time);
+        return;
+    }
+    columns.values[i] = value;
+    columns.commit_times[i] = commit_time;
+}
+
+void
+DataMng::install_version(itemid_t item_id, int value, timestamp_t commit_time) {
+    _memory[item_id].value = value;
+    push_version(item_id, disk_item(value, commit_time));
+    update_column(item_id, value, commit_time);
+
+    // now we allow to read this value (only the replicated items are ever unreadable)
+    if (_replicas_stale && is_replicated(item_id)) {
+        _readable.insert(item_id);
+    }
+}
+
+void
+DataMng::push_version(itemid_t item_id, const disk_item &version) {
+    std::list<disk_item> &versions = versions_of(item_id);
+    versions.push_front(version);
+    _hot_count++;
+    if (_cold == nullptr || versions.size() <= _hot_versions) {
+        return;
+    }
+    disk_item oldest = versions.back();
+    versions.pop_back();
+    _hot_count--;
+    if (oldest.commit_time != -1) {
+        _cold->Append(item_id, oldest.value, oldest.commit_time);
+    }
+}
+
+std::list<DataMng::disk_item> &
+DataMng::versions_of(itemid_t item_id) {
+    std::list<disk_item> &versions = _disk[item_id];
+    if (versions.empty()) {
+        // commit time = -1 means initial values
+        versions.push_back(disk_item(initial_value(item_id), -1));
+        _hot_count++;
+    }
+    return versions;
+}
+
+bool
+DataMng::version_at(itemid_t item_id, timestamp_t ts, disk_item &version) {
+    auto it = _disk.find(item_id);
+    if (it == _disk.end()) {
+        version = disk_item(initial_value(item_id), -1);
+        return ts >= -1;
+    }
+    for (const disk_item &candidate : it->second) {
+        if (candidate.commit_time <= ts) {
+            version = candidate;
+            return true;
+        }
+    }
+
+    // older than what is left in memory: it is in the cold tier, or it is the initial version
+    if (_cold != nullptr && it->second.back().commit_time != -1) {
+        if (_cold->Find(item_id, ts, version.value, version.commit_time)) {
+            return true;
+        }
+        version = disk_item(initial_value(item_id), -1);
+        return ts >= -1;
+    }
+    return false;
+}
+
+int
+DataMng::latest_value(itemid_t item_id) {
+    auto it = _disk.find(item_id);
+    return it != _disk.end() ? it->second.front().value : initial_value(item_id);
+}
+
+bool
+DataMng::readable(itemid_t item_id) {
+    if (!_is_up) {
+        return false;
+    }
+    return !_replicas_stale || !is_replicated(item_id) || _readable.count(item_id) > 0;
+}
+
+DataMng::trans_table_item &
+DataMng::get_trans(transid_t trans_id) {
+    auto it = _trans_table.find(trans_id);
+    if (it == _trans_table.end()) {
+        it = _trans_table.emplace(trans_id, trans_table_item(_arena_pool.Acquire())).first;
+    }
+    return it->second;
+}
+
+void
+DataMng::drop_trans(transid_t trans_id) {
+    _trans_rank.erase(trans_id);
+    auto it = _trans_table.find(trans_id);
+    if (it == _trans_table.end()) {
+        return;
+    }
+    Arena *arena = it->second.arena;
+    _trans_table.erase(it);
+    _arena_pool.Release(arena);
+}
+
+void
+DataMng::drop_all_trans() {
+    std::vector<Arena *> arenas;
+    for (const auto &p : _trans_table) {
+        arenas.push_back(p.second.arena);
+    }
+    _trans_table.clear();
+    _trans_rank.clear();
+    for (Arena *arena : arenas) {
+        _arena_pool.Release(arena);
+    }
+}
+
 void
 DataMng::try_resolve_lock_table() {
-    bool flag = true;
-    while (flag) {
-        flag = false;
-        for (auto &p : _lock_table) {
-            itemid_t item_id = p.first;
-            lock_table_item_t &lock_item = p.second;
-            if (!lock_item.lock_queue.empty()) {
-                // we peek at the next operation, and check if we are safe to execute it
-                auto next_item = lock_item.lock_queue.front();
-
-                switch (next_item.lock_type) {
-                    case S: {
-                        transid_t next_trans_id = next_item.trans_id;
-                        if (check_holding_conflict(item_id, next_item)) {
-
-                            // now we should be able to remove this lock waiting item
-                            lock_item.lock_queue.pop_front();
-
-                            // also grant the new lock here
-                            if (lock_item.lock_type == NONE) {
-                                lock_item.lock_type = S;
-                            }
-                            lock_item.trans_holding.insert(next_trans_id);
-                            flag = true;
-                        }
-                        break;
-                    }
-                    case X: {
-                        transid_t next_trans_id = next_item.trans_id;
-                        if (check_holding_conflict(item_id, next_item)) {
-
-                            // now we should be able to remove this lock waiting item
-                            lock_item.lock_queue.pop_front();
-
-                            // also grant the new lock here
-                            if (lock_item.lock_type == S || lock_item.lock_type == NONE) {
-                                lock_item.lock_type = X;
-                            }
-                            lock_item.trans_holding.insert(next_trans_id);
-                            flag = true;
+    // a grant never lets the requests on another item go, so each item is settled in one go
+    for (auto &p : _lock_table) {
+        itemid_t item_id = p.first;
+        lock_table_item_t &lock_item = p.second;
+        bool flag = true;
+        while (flag && !lock_item.lock_queue.empty()) {
+            flag = false;
+
+            // we peek at the next operation, and check if we are safe to execute it
+            auto next_item = lock_item.lock_queue.front();
+
+            switch (next_item.lock_type) {
+                case S:
+                case X:
+                case I: {
+                    transid_t next_trans_id = next_item.trans_id;
+                    if (check_holding_conflict(item_id, next_item)) {
+
+                        // now we should be able to remove this lock waiting item
+                        lock_item.lock_queue.pop_front();
+
+                        // also grant the new lock here
+                        lock_item.lock_type = granted_type(lock_item.lock_type, next_item.lock_type);
+                        lock_item.trans_holding.insert(next_trans_id);
+                        _listener->ReceiveLockGrant(next_trans_id, _site_id);
+                        if (_tracer != nullptr) {
+                            _tracer->LockWaitEnd(_site_id, next_trans_id, item_id, "granted");
                         }
-                        break;
+                        flag = true;
                     }
-                    default:
-                        err_invalid_case();
+                    break;
                 }
+                default:
+                    err_invalid_case();
             }
         }
     }
@@ -427,7 +1081,7 @@ DataMng::GetWaitingGraph() {
         // 2. all the ops in the queue are waiting for the previous ones (if conflict)
         for (auto it_parent = lock_item.lock_queue.begin(); it_parent != lock_item.lock_queue.end(); it_parent++) {
             for (auto it_child = lock_item.lock_queue.begin(); it_child != it_parent; it_child++) {
-                if (check_item_conflict(*it_parent, *it_child)) {
+                if (!check_item_compatible(*it_parent, *it_child)) {
                     itemid_t parent = it_parent->trans_id;
                     itemid_t child = it_child->trans_id;
                     if (parent != child) {
@@ -438,9 +1092,220 @@ DataMng::GetWaitingGraph() {
         }
     }
 
+    // 3. the transactions waiting for the site level wait for the conflicting holders
+    for (const auto &waiter : _site_waiters) {
+        for (const auto &holder : _site_holders) {
+            if (holder.first != waiter.first && (holder.second.modes & site_conflicts(waiter.second))) {
+                graph[waiter.first].insert(holder.first);
+            }
+        }
+    }
+
     return graph;
 }
 
+void
+DataMng::SetEscalationThreshold(int threshold) {
+    _escalation_threshold = threshold;
+}
+
+void
+DataMng::SetColdTier(const std::string &dir, int hot_versions) {
+    if (hot_versions <= 0) {
+        _cold.reset();
+        _hot_versions = 0;
+        return;
+    }
+    _cold.reset(new ColdStore(dir));
+    _hot_versions = static_cast<size_t>(hot_versions);
+}
+
+long
+DataMng::HotVersions() const {
+    return _hot_count;
+}
+
+const ColdStore *
+DataMng::GetColdStore() const {
+    return _cold.get();
+}
+
+void
+DataMng::SetTracer(Tracer *tracer) {
+    _tracer = tracer;
+}
+
+void
+DataMng::SetTransRank(transid_t trans_id, int rank) {
+    _trans_rank[trans_id] = rank;
+}
+
+DataMng::lock_queue_item_t
+DataMng::make_request(transid_t trans_id, lock_type_t lock_type) {
+    lock_queue_item_t item(trans_id, lock_type);
+    auto it = _trans_rank.find(trans_id);
+    item.rank = it == _trans_rank.end() ? std::numeric_limits<int>::max() : it->second;
+    return item;
+}
+
+void
+DataMng::enqueue(lock_table_item_t &lock_item, lock_queue_item_t item) {
+    if (lock_item.check_exist(item)) {
+        return;
+    }
+    auto it = lock_item.lock_queue.begin();
+    while (it != lock_item.lock_queue.end() && it->rank <= item.rank) {
+        ++it;
+    }
+    lock_item.lock_queue.insert(it, item);
+}
+
+DataMng::lock_table_item_t &
+DataMng::lock_item_of(itemid_t item_id) {
+    auto it = _lock_table.find(item_id);
+    if (it == _lock_table.end()) {
+        it = _lock_table.emplace(item_id, lock_table_item_t(&_node_pool)).first;
+    }
+    return it->second;
+}
+
+size_t
+DataMng::LockTableSize() const {
+    return _lock_table.size();
+}
+
+size_t
+DataMng::Escalations() const {
+    return _escalations;
+}
+
+size_t
+DataMng::UnreadableReplicas() const {
+    if (!_is_up || !_replicas_stale) {
+        return 0;
+    }
+    // the replicated items are the even ones, all of them on every site
+    return ITEM_COUNT / 2 - _readable.size();
+}
+
+int
+DataMng::site_conflicts(int mode) {
+    switch (mode) {
+        case SITE_IS:
+            return SITE_X;
+        case SITE_IX:
+            return SITE_S | SITE_X;
+        case SITE_S:
+            return SITE_IX | SITE_X;
+        case SITE_X:
+            return SITE_IS | SITE_IX | SITE_S | SITE_X;
+        default:
+            err_invalid_case();
+    }
+    return 0;
+}
+
+bool
+DataMng::check_site_conflict(transid_t trans_id, int mode) {
+    int conflicts = site_conflicts(mode);
+    for (const auto &holder : _site_holders) {
+        if (holder.first != trans_id && (holder.second.modes & conflicts)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+DataMng::site_covers(transid_t trans_id, lock_type_t lock_type) {
+    if (_site_holders.empty()) {
+        return false;
+    }
+    auto it = _site_holders.find(trans_id);
+    if (it == _site_holders.end()) {
+        return false;
+    }
+    int modes = it->second.modes;
+    return (modes & SITE_X) || (lock_type == S && (modes & SITE_S));
+}
+
+bool
+DataMng::get_intention_lock(transid_t trans_id, lock_type_t lock_type) {
+    int mode = lock_type == S ? SITE_IS : SITE_IX;
+    auto it = _site_holders.find(trans_id);
+    if (it != _site_holders.end() && (it->second.modes & mode)) {
+        return true;
+    }
+    if (!check_site_conflict(trans_id, mode)) {
+        _site_waiters[trans_id] = mode;
+        _listener->ReceiveLockWait(trans_id, _site_id);
+        return false;
+    }
+    _site_waiters.erase(trans_id);
+    _site_holders[trans_id].modes |= mode;
+    return true;
+}
+
+void
+DataMng::note_item_lock(transid_t trans_id, bool is_new, lock_type_t lock_type) {
+    site_holder_t &holder = _site_holders[trans_id];
+    if (lock_type != S) {
+        holder.wrote = true;
+    }
+    if (is_new) {
+        holder.item_locks++;
+    }
+    if (holder.item_locks < _escalation_threshold) {
+        return;
+    }
+
+    // escalate to S if it only reads, X once it has written
+    int target = holder.wrote ? SITE_X : SITE_S;
+    if ((holder.modes & target) || !check_site_conflict(trans_id, target)) {
+        return;
+    }
+
+    // a transaction waiting in a lock queue keeps its item locks, the queue would wait for nothing otherwise
+    for (const auto &p : _lock_table) {
+        for (const lock_queue_item_t &item : p.second.lock_queue) {
+            if (item.trans_id == trans_id) {
+                return;
+            }
+        }
+    }
+
+    // the site lock covers the item locks now, drop them and every lock table entry left unused
+    for (auto it = _lock_table.begin(); it != _lock_table.end();) {
+        lock_table_item_t &lock_item = it->second;
+        if (lock_item.trans_holding.erase(trans_id) && lock_item.trans_holding.empty()) {
+            lock_item.lock_type = NONE;
+        }
+        if (lock_item.lock_type == NONE && lock_item.lock_queue.empty()) {
+            it = _lock_table.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    holder.modes |= target;
+    holder.item_locks = 0;
+    _escalations++;
+}
+
+void
+DataMng::release_site_lock(transid_t trans_id) {
+    bool released = !_site_holders.empty() && _site_holders.erase(trans_id) > 0;
+    if (!_site_waiters.empty()) {
+        _site_waiters.erase(trans_id);
+
+        // the waiters are not granted here, they try again
+        if (released) {
+            for (const auto &waiter : _site_waiters) {
+                _listener->ReceiveLockGrant(waiter.first, _site_id);
+            }
+        }
+    }
+}
+
 
 bool
 DataMng::check_lock_queue() {
@@ -453,38 +1318,51 @@ DataMng::check_lock_queue() {
             tmp.insert(item.trans_id);
         }
     }
-    std::cout << "Debug Info: same item occured twice in the same lock queue\n";
+    _out << "Debug Info: same item occured twice in the same lock queue\n";
     return false;
 }
 
 bool
-DataMng::check_item_conflict(lock_queue_item_t _lhs, lock_queue_item_t _rhs) {
+DataMng::check_item_compatible(lock_queue_item_t _lhs, lock_queue_item_t _rhs) {
     if (_lhs.trans_id == _rhs.trans_id) {
         return true;
     }
     if ((_lhs.lock_type == S) && (_rhs.lock_type == S)) {
         return true;
     }
+    if ((_lhs.lock_type == I) && (_rhs.lock_type == I)) {
+        return true;
+    }
     return false;
 }
 
+DataMng::lock_type_t
+DataMng::granted_type(lock_type_t held, lock_type_t requested) {
+    if (held == NONE || held == requested) {
+        return requested;
+    }
+    // X covers everything, and S together with I is only safe for a single holder
+    return X;
+}
+
 bool
 DataMng::check_already_hold(itemid_t item_id, lock_queue_item_t _rhs) {
-    const lock_table_item_t &lock_item = _lock_table[item_id];
+    const lock_table_item_t &lock_item = lock_item_of(item_id);
     const transid_t trans_id = _rhs.trans_id;
 
     // first, we must hold it
     if (!lock_item.trans_holding.count(trans_id)) return false;
 
     // second, the lock type is match
-    if (_rhs.lock_type == S) return true;
-    else if (lock_item.lock_type == X)return true;
+    if (lock_item.lock_type == X) return true;
+    else if (_rhs.lock_type == S) return lock_item.lock_type == S;
+    else if (_rhs.lock_type == I) return lock_item.lock_type == I;
     else return false;
 }
 
 bool
 DataMng::check_holding_conflict(itemid_t item_id, lock_queue_item_t _rhs) {
-    const lock_table_item_t &lock_item = _lock_table[item_id];
+    const lock_table_item_t &lock_item = lock_item_of(item_id);
     const transid_t trans_id = _rhs.trans_id;
     switch (lock_item.lock_type) {
         case NONE:
@@ -500,6 +1378,13 @@ DataMng::check_holding_conflict(itemid_t item_id, lock_queue_item_t _rhs) {
             if (lock_item.trans_holding.count(trans_id)) return true;
             else return false;
         }
+        case I: {
+            if (_rhs.lock_type == I) return true;
+            else if (lock_item.trans_holding.size() == 1 &&
+                     lock_item.trans_holding.count(trans_id))
+                return true;
+            else return false;
+        }
         default:
             err_invalid_case();
     }
@@ -508,9 +1393,13 @@ DataMng::check_holding_conflict(itemid_t item_id, lock_queue_item_t _rhs) {
 
 bool
 DataMng::check_queued_conflict(itemid_t item_id, lock_queue_item_t _rhs) {
-    const lock_table_item_t &lock_item = _lock_table[item_id];
+    const lock_table_item_t &lock_item = lock_item_of(item_id);
     for (const auto &lock_queue_item : lock_item.lock_queue) {
-        if (!check_item_conflict(_rhs, lock_queue_item)) {
+        if (lock_queue_item.rank > _rhs.rank) {
+            // the request would be queued ahead of it anyway
+            continue;
+        }
+        if (!check_item_compatible(_rhs, lock_queue_item)) {
             return false;
         }
     }
@@ -8,37 +8,70 @@
 #pragma once
 
 #include"Common.h"
+#include"DataSite.h"
+#include"Arena.h"
+#include"Tracer.h"
+#include"ColdStore.h"
 #include<map>
+#include<memory>
 #include<unordered_map>
 #include<unordered_set>
 #include<list>
+#include<vector>
+#include<istream>
+#include<ostream>
 
-class DataMng {
+class DataMng : public DataSite {
 public:
     //------------- Basic stuffs goes here -----------------------
     siteid_t _site_id;
     bool _is_up;
     std::list<timestamp_t> _last_fail_time;
     std::list<timestamp_t> _last_up_time;
-    // Follow the data initialization rules for the given site_id
-    DataMng(siteid_t site_id);
+    // Follow the data initialization rules for the given site_id. Nothing is allocated per item: an item that has
+    // never been committed here is at its initial value (10 * item id)
+    // Read and write results are sent back to the listener, dumps are written to out
+    DataMng(siteid_t site_id, SiteListener *listener, std::ostream &out);
+
+    //------------------- stable storage ---------------------------
+    // The non-volatile part of this site (the versions on disk and the fail/up history) as a log
+    // Write all of it
+    void SaveStable(std::ostream &out);
+
+    // Append the versions that committing these transactions will install (call it before the commit)
+    void LogCommit(std::ostream &out, const std::vector<transid_t> &trans_ids, timestamp_t commit_time);
+
+    // Replace the non-volatile part by replaying the log. The site is left failed,
+    // Recover() rebuilds the memory from it
+    // Ret: false if the log is malformed
+    bool LoadStable(std::istream &in);
 
     //--------------------tester cause events----------------------
     // Fail this site
-    void Fail(timestamp_t _ts);
+    void Fail(timestamp_t _ts) override;
 
     // Recover this site
-    void Recover(timestamp_t _ts);
+    void Recover(timestamp_t _ts) override;
 
     // Dump all of the disk values
-    void Dump();
+    void Dump() override;
 
     // Dump one item
-    void DumpItem(itemid_t item_id);
+    void DumpItem(itemid_t item_id) override;
+
+    // Write the committed value at ts of every item hosted here to path, in item order, through a fixed-size
+    // buffer. It only reads the versions on disk, and can run while other sites export on other threads
+    // Ret: the number of records written
+    long Export(timestamp_t ts, const std::string &path, dump_format_t format) override;
 
     //-----------------transaction execution events----------------
     // Abort an transaction
-    void Abort(transid_t trans_id);
+    void Abort(transid_t trans_id) override;
+
+    // The rank of a transaction in the lock queues, lower first. A queued request keeps the rank it had when it was
+    // queued, and a new request only waits behind the queued ones of the same or a lower rank. Without ranks (the
+    // default) the queues are FIFO
+    void SetTransRank(transid_t trans_id, int rank) override;
 
     //Before the TM trying to read or write an item, it should get the locks first
 
@@ -48,7 +81,7 @@ public:
     //    a. This item is not readable due to recovery (only when it is a replicated item)
     //    b. There's a lock conflict - side effect: the transaction will be scheduled into 
     //       lock waiting queue
-    bool GetReadLock(transid_t trans_id, itemid_t item_id);
+    bool GetReadLock(transid_t trans_id, itemid_t item_id) override;
 
     // Get write lock (X)
     // 1. Return true if lock granted
@@ -56,6 +89,12 @@ public:
     //    scheduled in to lock waiting queue
     bool GetWriteLock(transid_t trans_id, itemid_t item_id);
 
+    // Get increment lock (I): compatible with the increments of other transactions, conflicts with S and X
+    // 1. Return true if lock granted (or covered by an X lock)
+    // 2. Return false if there's a lock conflict - side effect: the transaction will be
+    //    scheduled in to lock waiting queue
+    bool GetIncrementLock(transid_t trans_id, itemid_t item_id);
+
 
     // For the read operations, the result will be send back via TM's listener
 
@@ -63,27 +102,93 @@ public:
     // Return false if this item is not readable due to recovery 
     //    (only when it is a replicated item)
     // Ret: If we are allowed to read this item on this site
-    bool Read(op_t op);
+    bool Read(op_t op) override;
 
     // Read - Only transactions use multiversion concurrency control
     // Return false if this item is not readable due to recovery 
     //    (only when it is a replicated item)
     // Ret: If we are allowed to read this item on this site
-    bool Ronly(op_t op, timestamp_t ts);
+    bool Ronly(op_t op, timestamp_t ts) override;
+
+    // Snapshot scan for read-only transactions over the items in [first, last] of one kind (replicated or not):
+    // the value each of them had at ts. It runs over the column copy of the latest versions, _disk is only
+    // walked for the items committed after ts. The items this site cannot serve at ts (see Ronly) are missed
+    snapshot_t SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts,
+                            bool with_values) override;
+
+    // Several reads of the same transaction in one request (RR), locked and read in the order given
+    // Ret: whether each op has been granted and read, the results are sent back via the listener
+    std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) override;
 
     // Write operation: W1(X, V)
     void Write(op_t op);
 
+    // Lock and write in one request: W1(X, V)
+    // 1. Return true if the X lock is granted, the value is then written into memory
+    // 2. Return false if there's a lock conflict - side effect: the transaction will be
+    //    scheduled in to lock waiting queue
+    // No write response is sent back, the TM reports it once every replica has granted the lock
+    bool LockAndWrite(op_t op);
+
+    // Several writes of the same transaction in one request, applied in order
+    // Ret: whether each op has been granted and written
+    std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) override;
+
+    // Increment operation: INC1(X, delta), lock and record the delta in one request
+    // The deltas of a transaction are added up, and folded into the latest committed value when it commits, so
+    // increments of different transactions commute. After its own write the delta is added to the written value,
+    // a later write replaces it. No response is sent back, the TM reports it once every replica has applied it
+    inc_result_t LockAndIncrement(op_t op) override;
+
     // Commit a transaction (the caller should ensure that it is safe to commit)
     void Commit(transid_t trans_id, timestamp_t commit_time);
 
+    // Group commit: commit several transactions that ended in the same tick in one pass.
+    // The locks of all of them are released together, their versions are appended in the
+    // given order, and the lock queues are resolved only once at the end.
+    void GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) override;
+
     // This is used by TM to retrive waiting graph from the DMs.
     // Which will be ultimately used for deadlock detection
-    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph();
+    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() override;
+
+    //------------------- lock escalation --------------------------
+    // Multi-granularity locking: with a threshold, a transaction takes an intention lock (IS/IX) on the site
+    // before its item locks, and once it holds threshold item locks on this site they are replaced by a
+    // single site lock (S if it only read, X once it has written). 0 disables it, the default
+    void SetEscalationThreshold(int threshold);
+
+    // Record the lock waits and the unreadable replicas on the timeline, null to stop (the default)
+    void SetTracer(Tracer *tracer);
+
+    size_t LockTableSize() const;
+
+    size_t Escalations() const;
+
+    // The replicated items that are not readable on this up site since it recovered, 0 while it is down
+    size_t UnreadableReplicas() const;
+
+    //------------------- tiered versions --------------------------
+    // Keep at most hot_versions versions of an item in memory, the older ones go to a cold tier of segment files
+    // mapped from dir (see ColdStore.h), where reads at an older snapshot find them. Set it before the first
+    // commit. 0 keeps every version in memory, the default
+    void SetColdTier(const std::string &dir, int hot_versions);
+
+    // The versions in memory (the initial ones included)
+    long HotVersions() const;
+
+    // null without a cold tier
+    const ColdStore *GetColdStore() const;
 
 private:
+    SiteListener *_listener;
+    std::ostream &_out;
+    Tracer *_tracer;
+
     //------------- Storage goes here ----------------------------
     // For temporal storage(memory), it seems do not need a timestamp version
+    // It only holds committed values, the writes of a transaction stay in its write buffer until it commits.
+    // The items that were never committed are not in it
     struct mem_item {
         int value;
 
@@ -96,11 +201,14 @@ private:
 
     std::unordered_map<itemid_t, mem_item> _memory;
 
-    // reads will not be allowed at recovered sites until a committed write takes place
-    std::unordered_map<itemid_t, bool> _readable;
+    // reads will not be allowed at recovered sites until a committed write takes place:
+    // once the site has recovered, the replicated items are readable only if they are in _readable
+    bool _replicas_stale;
+    std::unordered_set<itemid_t> _readable;
 
     // For non-volatile storage(disk), we use multi-version control
     // Here I use a map because the dump function needs an order
+    // Only the items committed at least once have a list (ending with the initial version)
     struct disk_item {
         int value;
         timestamp_t commit_time;
@@ -115,25 +223,72 @@ private:
 
     std::map<itemid_t, std::list<disk_item>> _disk;
 
+    // The latest version of each item in _disk, one array per field, in item order. [0] holds the items only
+    // this site has, [1] the replicated ones. Kept up to date by every commit
+    struct column_set_t {
+        std::vector<itemid_t> items;
+        std::vector<int> values;
+        std::vector<timestamp_t> commit_times;
+    };
+
+    column_set_t _columns[2];
+
+    // rebuild both column sets from _disk
+    void build_columns();
+
+    // a new latest version of this item
+    void update_column(itemid_t item_id, int value, timestamp_t commit_time);
+
+    // commit a new version of this item: memory, disk and columns
+    void install_version(itemid_t item_id, int value, timestamp_t commit_time);
+
+    // a version newer than the ones of the item on disk, the oldest one goes to the cold tier if there are too many
+    void push_version(itemid_t item_id, const disk_item &version);
+
+    //------------- Cold tier ------------------------------------
+    // null unless SetColdTier, the initial versions are implied and never spilled
+    std::unique_ptr<ColdStore> _cold;
+    size_t _hot_versions;
+    long _hot_count;
+
+    //------------- Lazily initialized items ---------------------
+    // the versions of an item, its list is created (with the initial version) on first use
+    std::list<disk_item> &versions_of(itemid_t item_id);
+
+    // the latest version committed at or before ts, Ret: false if there is none
+    bool version_at(itemid_t item_id, timestamp_t ts, disk_item &version);
+
+    // the latest committed value on disk
+    int latest_value(itemid_t item_id);
+
+    // false while the item may miss writes (recovered replicated item) or the site is down
+    bool readable(itemid_t item_id);
+
     //------------- Now begin the lock part ----------------------
     enum lock_type_t {
         NONE,
         S,
-        X
+        X,
+        // increment: shared between increments only
+        I
     };
 
     struct lock_queue_item_t {
         lock_type_t lock_type;
         transid_t trans_id;
+        // see SetTransRank
+        int rank;
 
         lock_queue_item_t() {
             lock_type = NONE;
             trans_id = -1;
+            rank = 0;
         }
 
         lock_queue_item_t(transid_t _t, lock_type_t _l) {
             lock_type = _l;
             trans_id = _t;
+            rank = 0;
         }
 
         bool operator==(lock_queue_item_t _other) {
@@ -145,9 +300,9 @@ private:
     struct lock_table_item_t {
         lock_type_t lock_type;
         std::unordered_set<transid_t> trans_holding;
-        std::list<lock_queue_item_t> lock_queue;
+        pool_list<lock_queue_item_t> lock_queue;
 
-        lock_table_item_t() {
+        explicit lock_table_item_t(NodePool *pool) : lock_queue(pool_allocator<lock_queue_item_t>(pool)) {
             lock_type = NONE;
         }
 
@@ -161,21 +316,76 @@ private:
         }
     };
 
+    // the nodes of the lock queues, declared first so that it outlives them
+    NodePool _node_pool;
+
     std::unordered_map<itemid_t, lock_table_item_t> _lock_table;
 
+    // see SetTransRank, empty if the queues are FIFO
+    std::unordered_map<transid_t, int> _trans_rank;
+
+    // The site level above the item locks, only used while escalation is enabled
+    enum site_lock_mode_t {
+        SITE_IS = 1,
+        SITE_IX = 2,
+        SITE_S = 4,
+        SITE_X = 8
+    };
+
+    struct site_holder_t {
+        // site_lock_mode_t bits
+        int modes;
+        // item locks taken since the last escalation
+        int item_locks;
+        bool wrote;
+
+        site_holder_t() {
+            modes = 0;
+            item_locks = 0;
+            wrote = false;
+        }
+    };
+
+    int _escalation_threshold;
+    size_t _escalations;
+    std::unordered_map<transid_t, site_holder_t> _site_holders;
+    // the mode each waiting transaction asked for
+    std::unordered_map<transid_t, int> _site_waiters;
+
     //------------- Active Transaction Table ---------------------
+    // The bookkeeping of each transaction lives in its own arena, released in one go at commit/abort
+    ArenaPool _arena_pool;
+
     struct trans_table_item {
-        std::unordered_set<itemid_t> modified_item;
+        Arena *arena;
+        // the private write buffer: the last value written to each item, installed at commit, dropped at abort
+        arena_map<itemid_t, int> write_buffer;
+        // the sum of its increments of the items it has not written, folded into the latest value at commit
+        arena_map<itemid_t, int> increments;
 
         // std::unordered_set<itemid_t> locks_holding;
         // std::unordered_set<itemid_t> locks_waiting;
-        trans_table_item() {}
+        trans_table_item(Arena *_arena)
+                : write_buffer(0, std::hash<itemid_t>(), std::equal_to<itemid_t>(),
+                               arena_allocator<std::pair<const itemid_t, int>>(_arena)),
+                  increments(0, std::hash<itemid_t>(), std::equal_to<itemid_t>(),
+                             arena_allocator<std::pair<const itemid_t, int>>(_arena)) {
+            arena = _arena;
+        }
     };
 
     std::unordered_map<transid_t, trans_table_item> _trans_table;
 
 
     //------------- Internal helper functions ---------------------
+    // The entry of a transaction in the trans table, created on its first write
+    trans_table_item &get_trans(transid_t trans_id);
+
+    // Remove a transaction (or all of them) from the trans table and release its arena
+    void drop_trans(transid_t trans_id);
+
+    void drop_all_trans();
+
     // Return true if it is safe to grant lock. false otherwise
     // bool check_conflict(itemid_t item_id, transid_t trans_id, op_type_t op_type);
 
@@ -187,18 +397,49 @@ private:
     // - So let's check it
     bool check_lock_queue();
 
-    // check if two lock queue item are conflict
+    // check if two lock queue items are compatible
     // Return true if no conflict, false otherwise
-    bool check_item_conflict(lock_queue_item_t _lhs, lock_queue_item_t _rhs);
+    bool check_item_compatible(lock_queue_item_t _lhs, lock_queue_item_t _rhs);
 
     // check if we already hold the lock for this item without any update to the lock table
     bool check_already_hold(itemid_t item_id, lock_queue_item_t _rhs);
 
+    // the lock type of an item once a lock of this type is granted on top of the held one
+    static lock_type_t granted_type(lock_type_t held, lock_type_t requested);
+
     // check if a lock queue item is conflict with current lock holding
     // Return true if no conflict, false otherwise
     bool check_holding_conflict(itemid_t item_id, lock_queue_item_t _rhs);
 
+    // the site lock modes that conflict with mode
+    static int site_conflicts(int mode);
+
+    // Return true if no other transaction holds a site lock conflicting with mode
+    bool check_site_conflict(transid_t trans_id, int mode);
+
+    // Return true if the site lock of this transaction already covers an item lock of this type
+    bool site_covers(transid_t trans_id, lock_type_t lock_type);
+
+    // Take the intention lock for an item lock of this type
+    // Return false if it conflicts, the transaction then waits for the site
+    bool get_intention_lock(transid_t trans_id, lock_type_t lock_type);
+
+    // An item lock was granted, escalate to a site lock once there are enough of them
+    void note_item_lock(transid_t trans_id, bool is_new, lock_type_t lock_type);
+
+    void release_site_lock(transid_t trans_id);
+
     // check if a lock queue item is conflict with any lock item currently in the lock queue
+    // (only the ones it would not get ahead of)
     // Return true if no conflict, false otherwise
     bool check_queued_conflict(itemid_t item_id, lock_queue_item_t _rhs);
+
+    // the lock request of a transaction, with its rank
+    lock_queue_item_t make_request(transid_t trans_id, lock_type_t lock_type);
+
+    // queue a lock request behind the ones of the same or a lower rank, unless it is already queued
+    void enqueue(lock_table_item_t &lock_item, lock_queue_item_t item);
+
+    // the lock table entry of the item, a free one if it has none yet
+    lock_table_item_t &lock_item_of(itemid_t item_id);
 };
@@ -0,0 +1,110 @@
+/**
+ * Date: 2026-10-18
+ * Description: The interface between the transaction manager and a data site. A site is either a DataMng living
+ * in the same process, or a SiteProxy that forwards every request to a site process over shared memory.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include<string>
+#include<unordered_map>
+#include<unordered_set>
+#include<vector>
+
+// What one site returns for a snapshot scan
+struct snapshot_t {
+    // sum and number of the items served
+    long long sum;
+    int count;
+
+    // only if the values were asked for: the items served and their values, in item order
+    std::vector<itemid_t> items;
+    std::vector<int> values;
+
+    // the items of the range this site cannot serve at the snapshot
+    std::vector<itemid_t> missed;
+
+    snapshot_t() {
+        sum = 0;
+        count = 0;
+    }
+};
+
+// What a site did with an increment, see DataMng::LockAndIncrement
+enum inc_result_t {
+    // the lock is granted and the delta recorded
+    INC_APPLIED,
+    // there is a lock conflict, the request waits in the lock queue
+    INC_WAIT,
+    // the replica may miss writes (it recovered), so there is nothing to add the delta to. It is left alone
+    INC_STALE
+};
+
+// The file format of a dump export, see TransMng::SetDumpExport
+enum dump_format_t {
+    // a "tick,site,item,value" line per item
+    DUMP_CSV,
+    // a record of three 32-bit ints (site, item, value) per item
+    DUMP_BINARY
+};
+
+// The TM side of a site: results of read/write operations are sent back through it
+class SiteListener {
+public:
+    virtual ~SiteListener() {}
+
+    // The response of a read operation
+    virtual void ReceiveReadResponse(op_t op, siteid_t site_id, int value) = 0;
+
+    // The response of a write operation
+    virtual void ReceiveWriteResponse(op_t op, siteid_t site_id) = 0;
+
+    // A lock request of the transaction that had to wait may be granted now: the site granted it from its lock
+    // queue, or released the site lock it waited for
+    virtual void ReceiveLockGrant(transid_t /*trans_id*/, siteid_t /*site_id*/) {}
+
+    // A lock request of the transaction has to wait on this site, for an item lock or for the site lock
+    virtual void ReceiveLockWait(transid_t /*trans_id*/, siteid_t /*site_id*/) {}
+};
+
+// Everything the TM may ask a site to do (see DataMng.h for the details of each request)
+class DataSite {
+public:
+    virtual ~DataSite() {}
+
+    //--------------------tester cause events----------------------
+    virtual void Fail(timestamp_t _ts) = 0;
+
+    virtual void Recover(timestamp_t _ts) = 0;
+
+    virtual void Dump() = 0;
+
+    virtual void DumpItem(itemid_t item_id) = 0;
+
+    virtual long Export(timestamp_t ts, const std::string &path, dump_format_t format) = 0;
+
+    //-----------------transaction execution events----------------
+    virtual void Abort(transid_t trans_id) = 0;
+
+    virtual void SetTransRank(transid_t trans_id, int rank) = 0;
+
+    virtual bool GetReadLock(transid_t trans_id, itemid_t item_id) = 0;
+
+    virtual bool Read(op_t op) = 0;
+
+    virtual bool Ronly(op_t op, timestamp_t ts) = 0;
+
+    virtual snapshot_t SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts,
+                                    bool with_values) = 0;
+
+    virtual std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) = 0;
+
+    virtual std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) = 0;
+
+    virtual inc_result_t LockAndIncrement(op_t op) = 0;
+
+    virtual void GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) = 0;
+
+    virtual std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() = 0;
+};
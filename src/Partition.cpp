@@ -0,0 +1,321 @@
+/**
+ * Date: 2026-10-18
+ * Description: Partitioned TMs over shared sites, see Partition.h
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  Run                   |body                  |
+ *  -----------------------------------------------------------------------------------------
+ *  Pump                  |partition             |false if nothing happened, true otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  Wait                  |partition, timeout    |
+ *  -----------------------------------------------------------------------------------------
+ *  Caller                |trans_id              |the TM of the transaction if it is calling
+ *  -----------------------------------------------------------------------------------------
+ *  PostGrant             |trans_id, site_id     |
+ *  -----------------------------------------------------------------------------------------
+ *  NextTick              |start_round           |
+ *  -----------------------------------------------------------------------------------------
+ *  MergeWaits            |partition, waits,...  |a victim of this partition, -1 if none
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "Partition.h"
+
+#include <thread>
+
+namespace {
+    // the partition whose thread this is, -1 on any other thread
+    thread_local int current_partition = -1;
+}
+
+//------------------------ SharedSite -----------------------------
+
+SharedSite::SharedSite(siteid_t site_id, PartitionGroup *group)
+        : _group(group), _out(nullptr), _dm(site_id, this, _out) {
+}
+
+void
+SharedSite::Fail(timestamp_t _ts) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.Fail(_ts);
+}
+
+void
+SharedSite::Recover(timestamp_t _ts) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.Recover(_ts);
+}
+
+void
+SharedSite::Dump() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.Dump();
+}
+
+void
+SharedSite::DumpItem(itemid_t item_id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.DumpItem(item_id);
+}
+
+long
+SharedSite::Export(timestamp_t ts, const std::string &path, dump_format_t format) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.Export(ts, path, format);
+}
+
+void
+SharedSite::Abort(transid_t trans_id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.Abort(trans_id);
+}
+
+void
+SharedSite::SetTransRank(transid_t trans_id, int rank) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.SetTransRank(trans_id, rank);
+}
+
+bool
+SharedSite::GetReadLock(transid_t trans_id, itemid_t item_id) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.GetReadLock(trans_id, item_id);
+}
+
+bool
+SharedSite::Read(op_t op) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.Read(op);
+}
+
+bool
+SharedSite::Ronly(op_t op, timestamp_t ts) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.Ronly(op, ts);
+}
+
+snapshot_t
+SharedSite::SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts, bool with_values) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.SnapshotScan(first, last, replicated, ts, with_values);
+}
+
+std::vector<bool>
+SharedSite::LockAndReadBatch(const std::vector<op_t> &ops) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.LockAndReadBatch(ops);
+}
+
+std::vector<bool>
+SharedSite::LockAndWriteBatch(const std::vector<op_t> &ops) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.LockAndWriteBatch(ops);
+}
+
+inc_result_t
+SharedSite::LockAndIncrement(op_t op) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.LockAndIncrement(op);
+}
+
+void
+SharedSite::GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _dm.GroupCommit(trans_ids, commit_time);
+}
+
+std::unordered_map<siteid_t, std::unordered_set<siteid_t>>
+SharedSite::GetWaitingGraph() {
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _dm.GetWaitingGraph();
+}
+
+void
+SharedSite::ReceiveReadResponse(op_t op, siteid_t site_id, int value) {
+    // the op is one the calling TM sent, for one of its own transactions
+    _group->Partition(_group->OwnerOf(op.trans_id)).ReceiveReadResponse(op, site_id, value);
+}
+
+void
+SharedSite::ReceiveWriteResponse(op_t op, siteid_t site_id) {
+    _group->Partition(_group->OwnerOf(op.trans_id)).ReceiveWriteResponse(op, site_id);
+}
+
+void
+SharedSite::ReceiveLockGrant(transid_t trans_id, siteid_t site_id) {
+    TransMng *tm = _group->Caller(trans_id);
+    if (tm != nullptr) {
+        tm->ReceiveLockGrant(trans_id, site_id);
+    } else {
+        _group->PostGrant(trans_id, site_id);
+    }
+}
+
+void
+SharedSite::ReceiveLockWait(transid_t trans_id, siteid_t site_id) {
+    // only the TM asking for the lock keeps track of it
+    TransMng *tm = _group->Caller(trans_id);
+    if (tm != nullptr) {
+        tm->ReceiveLockWait(trans_id, site_id);
+    }
+}
+
+//------------------------ PartitionGroup -------------------------
+
+PartitionGroup::partition_t::partition_t() : out(nullptr) {
+}
+
+PartitionGroup::PartitionGroup(int partitions) {
+    _now = 0;
+    _victims = 0;
+    for (int i = 0; i < partitions; ++i) {
+        _partitions.emplace_back(new partition_t());
+        _partitions.back()->tm.reset(new TransMng(_partitions.back()->out));
+        _partitions.back()->tm->SetCoordinator(this, i);
+    }
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; ++site_id) {
+        _sites.emplace_back(new SharedSite(site_id, this));
+        for (auto &partition : _partitions) {
+            partition->tm->AttachSite(site_id, _sites.back().get());
+        }
+    }
+}
+
+PartitionGroup::~PartitionGroup() {
+    // the TMs go first, nothing calls the sites after that
+    _partitions.clear();
+}
+
+int
+PartitionGroup::Partitions() const {
+    return static_cast<int>(_partitions.size());
+}
+
+TransMng &
+PartitionGroup::Partition(int partition) {
+    return *_partitions[partition]->tm;
+}
+
+int
+PartitionGroup::OwnerOf(transid_t trans_id) const {
+    return (trans_id - 1) % static_cast<int>(_partitions.size());
+}
+
+void
+PartitionGroup::Run(const std::function<void(int partition)> &body) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < Partitions(); ++i) {
+        threads.emplace_back([&body, i]() {
+            current_partition = i;
+            body(i);
+            current_partition = -1;
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+bool
+PartitionGroup::Pump(int partition) {
+    current_partition = partition;
+    partition_t &p = *_partitions[partition];
+    std::vector<std::pair<transid_t, siteid_t>> grants;
+    std::vector<transid_t> victims;
+    {
+        std::lock_guard<std::mutex> guard(p.inbox_mutex);
+        grants.swap(p.grants);
+        victims.swap(p.victims);
+    }
+    for (const auto &grant : grants) {
+        p.tm->ReceiveLockGrant(grant.first, grant.second);
+    }
+    for (transid_t trans_id : victims) {
+        if (p.tm->AbortDeadlockVictim(trans_id)) {
+            _victims++;
+        }
+    }
+    bool pumped = p.tm->Pump();
+    return pumped || !grants.empty() || !victims.empty();
+}
+
+void
+PartitionGroup::Wait(int partition, std::chrono::microseconds timeout) {
+    partition_t &p = *_partitions[partition];
+    std::unique_lock<std::mutex> lock(p.inbox_mutex);
+    p.inbox_ready.wait_for(lock, timeout, [&p]() {
+        return !p.grants.empty() || !p.victims.empty();
+    });
+}
+
+long
+PartitionGroup::DeadlockVictims() const {
+    return _victims;
+}
+
+TransMng *
+PartitionGroup::Caller(transid_t trans_id) {
+    int owner = OwnerOf(trans_id);
+    return owner == current_partition ? _partitions[owner]->tm.get() : nullptr;
+}
+
+void
+PartitionGroup::PostGrant(transid_t trans_id, siteid_t site_id) {
+    partition_t &owner = *_partitions[OwnerOf(trans_id)];
+    std::lock_guard<std::mutex> guard(owner.inbox_mutex);
+    owner.grants.push_back(std::make_pair(trans_id, site_id));
+    owner.inbox_ready.notify_one();
+}
+
+void
+PartitionGroup::NextTick(const std::function<void(timestamp_t)> &start_round) {
+    std::lock_guard<std::mutex> guard(_clock_mutex);
+    start_round(++_now);
+}
+
+transid_t
+PartitionGroup::MergeWaits(int partition, const waits_for_t &waits,
+                           const std::unordered_map<transid_t, timestamp_t> &starts) {
+    std::lock_guard<std::mutex> guard(_waits_mutex);
+    _partitions[partition]->waits = waits;
+    _partitions[partition]->starts = starts;
+
+    // the other partitions reported theirs when they last looked, the victim is checked by its owner again
+    waits_for_t merged;
+    std::unordered_map<transid_t, timestamp_t> started;
+    for (const auto &p : _partitions) {
+        for (const auto &edges : p->waits) {
+            merged[edges.first].insert(edges.second.begin(), edges.second.end());
+        }
+        started.insert(p->starts.begin(), p->starts.end());
+    }
+
+    // the youngest transaction on a cycle, like a TM on its own
+    transid_t victim = -1;
+    for (transid_t trans_id : TransMng::OnCycle(merged)) {
+        auto it = started.find(trans_id);
+        if (it == started.end()) {
+            continue;
+        }
+        if (victim == -1 || it->second > started[victim] || (it->second == started[victim] && trans_id > victim)) {
+            victim = trans_id;
+        }
+    }
+    if (victim == -1) {
+        return -1;
+    }
+
+    // its waits end with it, until its partition reports again
+    partition_t &owner = *_partitions[OwnerOf(victim)];
+    owner.waits.erase(victim);
+    owner.starts.erase(victim);
+    if (OwnerOf(victim) == partition) {
+        // it waits right now, its TM aborts it
+        _victims++;
+        return victim;
+    }
+    std::lock_guard<std::mutex> inbox_guard(owner.inbox_mutex);
+    owner.victims.push_back(victim);
+    owner.inbox_ready.notify_one();
+    return -1;
+}
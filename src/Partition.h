@@ -0,0 +1,156 @@
+/**
+ * Date: 2026-10-18
+ * Description: Several TMs coordinating at once over one set of sites, each on its own thread and owning a partition
+ * of the transaction ids: transaction T belongs to partition (T - 1) % partitions. A site is a DataMng behind a mutex
+ * (SharedSite). What it tells about a transaction goes to the TM that owns it: right away when that TM is the caller,
+ * otherwise to the inbox of the TM, delivered before its next round. The TMs take their ticks from one clock and
+ * install their commits under its lock, so that commit times and read-only snapshots agree across them. The deadlocks
+ * across partitions are found by merging the waits-for graphs each TM reports for its own transactions.
+ * Only the embedded transactions (TransMng::BeginTx ... Pump) run this way, and the sites do not fail. What the TMs
+ * and the sites would print is dropped, the embedded transactions tell their outcome through their callbacks.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include"DataMng.h"
+#include"TransMng.h"
+#include<atomic>
+#include<chrono>
+#include<condition_variable>
+#include<functional>
+#include<memory>
+#include<mutex>
+#include<ostream>
+#include<unordered_map>
+#include<unordered_set>
+#include<utility>
+#include<vector>
+
+class PartitionGroup;
+
+// A site shared by the TMs of a group, every request holds its mutex
+class SharedSite : public DataSite, public SiteListener {
+public:
+    SharedSite(siteid_t site_id, PartitionGroup *group);
+
+    //------------------------ DataSite -----------------------------
+    void Fail(timestamp_t _ts) override;
+
+    void Recover(timestamp_t _ts) override;
+
+    void Dump() override;
+
+    void DumpItem(itemid_t item_id) override;
+
+    long Export(timestamp_t ts, const std::string &path, dump_format_t format) override;
+
+    void Abort(transid_t trans_id) override;
+
+    void SetTransRank(transid_t trans_id, int rank) override;
+
+    bool GetReadLock(transid_t trans_id, itemid_t item_id) override;
+
+    bool Read(op_t op) override;
+
+    bool Ronly(op_t op, timestamp_t ts) override;
+
+    snapshot_t SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts,
+                            bool with_values) override;
+
+    std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) override;
+
+    std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) override;
+
+    inc_result_t LockAndIncrement(op_t op) override;
+
+    void GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) override;
+
+    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() override;
+
+    //------------------------ SiteListener -------------------------
+    // The answers to a request go back to the TM that sent it
+    void ReceiveReadResponse(op_t op, siteid_t site_id, int value) override;
+
+    void ReceiveWriteResponse(op_t op, siteid_t site_id) override;
+
+    // Released by any TM, the grant goes to the owner of the transaction
+    void ReceiveLockGrant(transid_t trans_id, siteid_t site_id) override;
+
+    void ReceiveLockWait(transid_t trans_id, siteid_t site_id) override;
+
+private:
+    PartitionGroup *_group;
+    std::mutex _mutex;
+    std::ostream _out;
+    DataMng _dm;
+};
+
+class PartitionGroup : public TransCoordinator {
+public:
+    // partitions TMs over SITE_COUNT shared sites
+    PartitionGroup(int partitions);
+
+    ~PartitionGroup() override;
+
+    int Partitions() const;
+
+    TransMng &Partition(int partition);
+
+    int OwnerOf(transid_t trans_id) const;
+
+    // Run body(partition) on a thread per partition, and wait for all of them. The TM of a partition may only be used
+    // from its thread while they run
+    void Run(const std::function<void(int partition)> &body);
+
+    // One round of the TM of the partition, on its thread: the grants and the deadlock victims handed to it first
+    // Ret: false if nothing happened
+    bool Pump(int partition);
+
+    // Wait until another TM hands something to this partition, or for timeout. Between two rounds that did nothing
+    // (its transactions wait for the others, or for a deadlock to be found)
+    void Wait(int partition, std::chrono::microseconds timeout);
+
+    // The deadlock victims aborted across the partitions. A victim that no longer waits when its TM gets it is not
+    // aborted, nor counted
+    long DeadlockVictims() const;
+
+    //------------------------ from the sites -----------------------
+    // The TM that owns the transaction, if it is the one calling, null otherwise
+    TransMng *Caller(transid_t trans_id);
+
+    // A lock of a transaction of another partition may be granted now
+    void PostGrant(transid_t trans_id, siteid_t site_id);
+
+    //------------------------ TransCoordinator ---------------------
+    void NextTick(const std::function<void(timestamp_t)> &start_round) override;
+
+    transid_t MergeWaits(int partition, const waits_for_t &waits,
+                         const std::unordered_map<transid_t, timestamp_t> &starts) override;
+
+private:
+    // a TM and what the others handed to it
+    struct partition_t {
+        std::ostream out;
+        std::unique_ptr<TransMng> tm;
+        std::mutex inbox_mutex;
+        std::condition_variable inbox_ready;
+        std::vector<std::pair<transid_t, siteid_t>> grants;
+        std::vector<transid_t> victims;
+        // the waits it reported last, and when its waiting transactions began
+        waits_for_t waits;
+        std::unordered_map<transid_t, timestamp_t> starts;
+
+        partition_t();
+    };
+
+    std::vector<std::unique_ptr<partition_t>> _partitions;
+    std::vector<std::unique_ptr<SharedSite>> _sites;
+
+    std::mutex _clock_mutex;
+    timestamp_t _now;
+
+    // guards the waits of every partition
+    std::mutex _waits_mutex;
+    std::atomic<long> _victims;
+};
@@ -0,0 +1,246 @@
+/**
+ * Date: 2026-10-18
+ * Description: Batch runner, see Runner.h
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  RunScenarios          |options, report       |0 if all the scenarios pass, 1 otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  run_one               |scenario, options     |
+ *  -----------------------------------------------------------------------------------------
+ *  compare_files         |output, golden        |the first different line, 0 if identical
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "Runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+    enum scenario_result_t {
+        NO_GOLDEN,
+        PASS,
+        FAIL,
+        NO_INPUT,
+        NO_OUTPUT,
+        INVALID
+    };
+
+    struct scenario_t {
+        std::string input_name;
+        std::string output_name;
+        scenario_result_t result;
+        int diff_line;
+        long invalid_commands;
+        double wall_ms;
+    };
+
+    // "test12" sorts after "test2"
+    bool natural_less(const std::string &lhs, const std::string &rhs) {
+        size_t i = 0, j = 0;
+        while (i < lhs.size() && j < rhs.size()) {
+            if (std::isdigit(lhs[i]) && std::isdigit(rhs[j])) {
+                size_t i_end = i, j_end = j;
+                while (i_end < lhs.size() && std::isdigit(lhs[i_end])) i_end++;
+                while (j_end < rhs.size() && std::isdigit(rhs[j_end])) j_end++;
+                unsigned long lhs_num = std::stoul(lhs.substr(i, i_end - i));
+                unsigned long rhs_num = std::stoul(rhs.substr(j, j_end - j));
+                if (lhs_num != rhs_num) {
+                    return lhs_num < rhs_num;
+                }
+                i = i_end;
+                j = j_end;
+            } else {
+                if (lhs[i] != rhs[j]) {
+                    return lhs[i] < rhs[j];
+                }
+                i++;
+                j++;
+            }
+        }
+        return lhs.size() - i < rhs.size() - j;
+    }
+
+    std::vector<std::string> list_files(const std::string &dir) {
+        std::vector<std::string> names;
+        DIR *d = opendir(dir.c_str());
+        if (d == nullptr) {
+            return names;
+        }
+        while (dirent *entry = readdir(d)) {
+            // the subdirectories hold scenarios of their own (e.g. for another --sched policy)
+            std::string name = entry->d_name;
+            struct stat info;
+            if (!name.empty() && name[0] != '.' && stat((dir + "/" + name).c_str(), &info) == 0 &&
+                !S_ISDIR(info.st_mode)) {
+                names.push_back(name);
+            }
+        }
+        closedir(d);
+        std::sort(names.begin(), names.end(), natural_less);
+        return names;
+    }
+
+    // follow the naming of runit.sh: inputs/testN -> outputs/outN
+    std::string output_name_of(const std::string &input_name) {
+        if (input_name.compare(0, 4, "test") == 0) {
+            return "out" + input_name.substr(4);
+        }
+        return input_name;
+    }
+
+    // Ret: the first line that differs (1-indexed), 0 if the files are identical, -1 if there's no golden file
+    int compare_files(const std::string &output_path, const std::string &golden_path) {
+        std::ifstream output(output_path.c_str());
+        std::ifstream golden(golden_path.c_str());
+        if (!golden.is_open()) {
+            return -1;
+        }
+
+        std::string output_line, golden_line;
+        int line_no = 0;
+        while (true) {
+            line_no++;
+            bool has_output = static_cast<bool>(std::getline(output, output_line));
+            bool has_golden = static_cast<bool>(std::getline(golden, golden_line));
+            if (!has_output && !has_golden) {
+                return 0;
+            }
+            if (has_output != has_golden || output_line != golden_line) {
+                return line_no;
+            }
+        }
+    }
+
+    void run_one(scenario_t &scenario, const runner_options_t &options, const cluster_options_t &cluster_options) {
+        std::string input_path = options.input_dir + "/" + scenario.input_name;
+        std::string output_path = options.output_dir + "/" + scenario.output_name;
+
+        std::ifstream input(input_path.c_str());
+        if (!input.is_open()) {
+            scenario.result = NO_INPUT;
+            return;
+        }
+
+        std::ofstream output(output_path.c_str(), std::ios::trunc);
+        if (!output.is_open()) {
+            scenario.result = NO_OUTPUT;
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            // an invalid command fails this scenario only, the others go on
+            Cluster cluster(cluster_options, output);
+            cluster.GetTM().SetStrictCommands(false);
+            cluster.GetTM().Simulate(input);
+            scenario.invalid_commands = cluster.GetTM().InvalidCommands();
+        }
+        output.close();
+        auto end = std::chrono::steady_clock::now();
+        scenario.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (scenario.invalid_commands > 0) {
+            scenario.result = INVALID;
+            return;
+        }
+
+        scenario.result = NO_GOLDEN;
+        if (!options.golden_dir.empty()) {
+            int diff_line = compare_files(output_path, options.golden_dir + "/" + scenario.output_name);
+            if (diff_line >= 0) {
+                scenario.result = diff_line == 0 ? PASS : FAIL;
+                scenario.diff_line = diff_line;
+            }
+        }
+    }
+} // helper functions
+
+int
+RunScenarios(const runner_options_t &options, const cluster_options_t &cluster_options, std::ostream &report) {
+    std::vector<scenario_t> scenarios;
+    for (const std::string &name : list_files(options.input_dir)) {
+        scenario_t scenario;
+        scenario.input_name = name;
+        scenario.output_name = output_name_of(name);
+        scenario.result = NO_INPUT;
+        scenario.diff_line = 0;
+        scenario.invalid_commands = 0;
+        scenario.wall_ms = 0;
+        scenarios.push_back(scenario);
+    }
+
+    // forking the site processes is only safe from a single thread
+    int threads = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    if (cluster_options.multi_process || threads < 1) {
+        threads = 1;
+    }
+
+    // each worker takes the next scenario until none is left
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&]() {
+            size_t idx;
+            while ((idx = next.fetch_add(1)) < scenarios.size()) {
+                run_one(scenarios[idx], options, cluster_options);
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    int passed = 0, failed = 0;
+    report << std::fixed << std::setprecision(3);
+    for (const scenario_t &scenario : scenarios) {
+        report << std::left << std::setw(16) << scenario.input_name << std::right;
+        switch (scenario.result) {
+            case PASS:
+                passed++;
+                report << "PASS     ";
+                break;
+            case FAIL:
+                failed++;
+                report << "FAIL     ";
+                break;
+            case NO_GOLDEN:
+                report << "NO GOLDEN";
+                break;
+            case NO_INPUT:
+                failed++;
+                report << "NO INPUT ";
+                break;
+            case NO_OUTPUT:
+                failed++;
+                report << "NO OUTPUT";
+                break;
+            case INVALID:
+                failed++;
+                report << "ERROR    ";
+                break;
+        }
+        report << std::setw(12) << scenario.wall_ms << " ms";
+        if (scenario.result == FAIL) {
+            report << "  (first difference at line " << scenario.diff_line << ")";
+        } else if (scenario.result == INVALID) {
+            report << "  (" << scenario.invalid_commands << " invalid commands)";
+        }
+        report << "\n";
+    }
+    report << scenarios.size() << " scenarios, " << passed << " passed, " << failed << " failed, "
+           << threads << " threads, " << std::chrono::duration<double, std::milli>(end - start).count()
+           << " ms\n";
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+/**
+ * Date: 2026-10-18
+ * Description: Batch runner. Every input file of a directory is a scenario, each of them is simulated by its own
+ * cluster on a pool of threads. The output of a scenario is written to the output directory, compared with the
+ * golden output if there is one, and the wall time of every scenario is reported.
+ *
+**/
+#pragma once
+
+#include"Cluster.h"
+#include<ostream>
+#include<string>
+
+struct runner_options_t {
+    std::string input_dir;
+
+    std::string output_dir;
+
+    // empty: do not compare
+    std::string golden_dir;
+
+    // 0: one thread per core
+    int threads;
+
+    runner_options_t() {
+        threads = 0;
+    }
+};
+
+// Run the scenarios, report them to report
+// Ret: 0 if every scenario wrote its output, had no invalid command and, when it has a golden output, matches it,
+// 1 otherwise
+int RunScenarios(const runner_options_t &options, const cluster_options_t &cluster_options, std::ostream &report);
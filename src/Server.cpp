@@ -0,0 +1,616 @@
+/**
+ * Date: 2026-10-18
+ * Description: Server mode and its load generator, see Server.h
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  RunServer             |options, log          |0 on a clean shutdown, 1 otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  RunLoad               |options, report       |0 if the run completed, 1 otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  scan_trans_ids        |line                  |the transactions each command of the line names
+ *  -----------------------------------------------------------------------------------------
+ *  line_ready            |client                |true if no transaction of the client is queued
+ *  -----------------------------------------------------------------------------------------
+ *  execute_line          |client, line          |
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "Server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <list>
+#include <random>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    volatile sig_atomic_t stop_requested = 0;
+
+    void on_signal(int) {
+        stop_requested = 1;
+    }
+
+    // the server keeps reading a client until this many of its lines wait for execution
+    const size_t MAX_PENDING_LINES = 4096;
+
+    const size_t READ_CHUNK = 65536;
+
+    struct client_t {
+        int fd;
+        // bytes received after the last complete line
+        std::string in_buf;
+        // complete lines, in the order they arrived
+        std::deque<std::string> lines;
+        // what the TM reported for this client during the current tick
+        std::ostringstream out;
+        // bytes waiting for the socket
+        std::string out_buf;
+        // transactions this client has begun and not ended yet
+        std::unordered_set<transid_t> trans;
+        // the client shut down its sending side
+        bool eof;
+        // the connection is broken, drop the client
+        bool broken;
+    };
+
+    class ClientRouter : public TransRouter {
+    public:
+        std::unordered_map<transid_t, client_t *> owner;
+
+        // the client whose line is running, null during an idle tick
+        client_t *current;
+
+        ClientRouter() {
+            current = nullptr;
+        }
+
+        std::ostream &Output(transid_t trans_id) override {
+            auto it = owner.find(trans_id);
+            if (it != owner.end()) {
+                return it->second->out;
+            }
+            if (current != nullptr) {
+                return current->out;
+            }
+            _discard.str("");
+            return _discard;
+        }
+
+    private:
+        std::ostringstream _discard;
+    };
+
+    struct trans_ref_t {
+        transid_t trans_id;
+        bool is_begin;
+    };
+
+    // Every command whose first argument is a transaction "Tn", comments and spaces are ignored
+    std::vector<trans_ref_t> scan_trans_ids(const std::string &line) {
+        std::vector<trans_ref_t> refs;
+        std::string stripped;
+        for (size_t i = 0; i < line.size(); ++i) {
+            if (line[i] == '/' && i + 1 < line.size() && line[i + 1] == '/') {
+                break;
+            }
+            if (!std::isspace(static_cast<unsigned char>(line[i]))) {
+                stripped += line[i];
+            }
+        }
+
+        size_t start = 0;
+        while (start < stripped.size()) {
+            size_t end = stripped.find(';', start);
+            if (end == std::string::npos) {
+                end = stripped.size();
+            }
+            std::string command = stripped.substr(start, end - start);
+            start = end + 1;
+
+            size_t open = command.find('(');
+            if (open == std::string::npos || open + 2 >= command.size() || command[open + 1] != 'T') {
+                continue;
+            }
+            size_t arg_end = open + 2;
+            while (arg_end < command.size() && std::isdigit(static_cast<unsigned char>(command[arg_end]))) {
+                arg_end++;
+            }
+            if (arg_end == open + 2) {
+                continue;
+            }
+            trans_ref_t ref;
+            ref.trans_id = std::atoi(command.substr(open + 2, arg_end - open - 2).c_str());
+            ref.is_begin = command.compare(0, 5, "begin") == 0;
+            refs.push_back(ref);
+        }
+        return refs;
+    }
+
+    bool set_nonblocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool make_address(const std::string &path, sockaddr_un &addr) {
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        std::strcpy(addr.sun_path, path.c_str());
+        return true;
+    }
+
+    // Split what arrived into lines, keep the incomplete tail
+    void take_lines(std::string &in_buf, std::deque<std::string> &lines) {
+        size_t start = 0, end;
+        while ((end = in_buf.find('\n', start)) != std::string::npos) {
+            std::string line = in_buf.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            lines.push_back(line);
+            start = end + 1;
+        }
+        in_buf.erase(0, start);
+    }
+
+    // Ret: false if the connection is closed or broken
+    bool receive(int fd, std::string &in_buf) {
+        char chunk[READ_CHUNK];
+        while (true) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n > 0) {
+                in_buf.append(chunk, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+    }
+
+    // Ret: false if the connection is broken
+    bool send_pending(int fd, std::string &out_buf) {
+        while (!out_buf.empty()) {
+            ssize_t n = send(fd, out_buf.data(), out_buf.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                out_buf.erase(0, static_cast<size_t>(n));
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return true;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    class Server {
+    public:
+        Server(const cluster_options_t &cluster_options) : _cluster(cluster_options, _cluster_out) {
+            TransMng &tm = _cluster.GetTM();
+            tm.SetTickBanner(false);
+            tm.SetStrictCommands(false);
+            tm.SetRouter(&_router);
+            _lines = 0;
+            _ticks = 0;
+        }
+
+        ~Server() {
+            for (client_t *client : _clients) {
+                close(client->fd);
+                delete client;
+            }
+        }
+
+        void Accept(int fd) {
+            client_t *client = new client_t();
+            client->fd = fd;
+            client->eof = false;
+            client->broken = false;
+            _clients.push_back(client);
+        }
+
+        std::list<client_t *> &Clients() {
+            return _clients;
+        }
+
+        // Run at most one line of every client, an idle tick if none could run but ops are queued.
+        // Ret: true if a line ran
+        bool Step() {
+            bool ran = false;
+            for (client_t *client : _clients) {
+                if (!client->broken && !client->lines.empty() && line_ready(client)) {
+                    std::string line = client->lines.front();
+                    client->lines.pop_front();
+                    execute_line(client, line);
+                    ran = true;
+                }
+            }
+            if (!ran && _cluster.GetTM().HasQueuedOps()) {
+                // nothing new, but a deadlock may have to be broken
+                _router.current = nullptr;
+                tick("");
+                _cluster_out.str("");
+            }
+            return ran;
+        }
+
+        // Move what the TM reported to the socket buffers, drop the clients that are gone
+        void Flush() {
+            for (auto it = _clients.begin(); it != _clients.end();) {
+                client_t *client = *it;
+                client->out_buf += client->out.str();
+                client->out.str("");
+                if (!client->broken && !send_pending(client->fd, client->out_buf)) {
+                    client->broken = true;
+                }
+
+                bool done = client->eof && client->lines.empty() && line_ready(client) && client->out_buf.empty();
+                if (client->broken || done) {
+                    drop(client);
+                    it = _clients.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        bool HasQueuedOps() {
+            return _cluster.GetTM().HasQueuedOps();
+        }
+
+        long Lines() const {
+            return _lines;
+        }
+
+        long Ticks() const {
+            return _ticks;
+        }
+
+    private:
+        std::ostringstream _cluster_out;
+        Cluster _cluster;
+        ClientRouter _router;
+        std::list<client_t *> _clients;
+        long _lines;
+        long _ticks;
+
+        bool line_ready(client_t *client) {
+            for (transid_t trans_id : client->trans) {
+                if (_cluster.GetTM().QueuedOps(trans_id) > 0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void tick(const std::string &line) {
+            TransMng &tm = _cluster.GetTM();
+            tm.StartTick();
+            tm.RunTick(line);
+            _ticks++;
+        }
+
+        void execute_line(client_t *client, const std::string &line) {
+            TransMng &tm = _cluster.GetTM();
+            std::vector<trans_ref_t> refs = scan_trans_ids(line);
+
+            // a transaction belongs to the client that began it
+            for (const trans_ref_t &ref : refs) {
+                auto it = _router.owner.find(ref.trans_id);
+                if (it != _router.owner.end() && it->second != client) {
+                    client->out << "ERROR: Transaction T" << ref.trans_id << " belongs to another client\n";
+                    return;
+                }
+            }
+            for (const trans_ref_t &ref : refs) {
+                if (ref.is_begin && !tm.IsActive(ref.trans_id)) {
+                    _router.owner[ref.trans_id] = client;
+                    client->trans.insert(ref.trans_id);
+                }
+            }
+
+            _router.current = client;
+            tick(line);
+            _lines++;
+            client->out << _cluster_out.str();
+            _cluster_out.str("");
+
+            // forget the transactions that ended in this tick
+            for (const trans_ref_t &ref : refs) {
+                if (!tm.IsActive(ref.trans_id) && client->trans.erase(ref.trans_id)) {
+                    _router.owner.erase(ref.trans_id);
+                }
+            }
+        }
+
+        void drop(client_t *client) {
+            for (transid_t trans_id : client->trans) {
+                _cluster.GetTM().Disconnect(trans_id);
+                _router.owner.erase(trans_id);
+            }
+            if (_router.current == client) {
+                _router.current = nullptr;
+            }
+            close(client->fd);
+            delete client;
+        }
+    };
+
+    // ------------------------------- Load client ---------------------------------
+
+    struct conn_t {
+        int fd;
+        std::string in_buf;
+        std::string out_buf;
+        transid_t base_id;
+        int seq;
+        // the transaction in flight, -1 if none
+        transid_t trans_id;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    double percentile(const std::vector<double> &sorted, double p) {
+        if (sorted.empty()) {
+            return 0;
+        }
+        size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+        return sorted[idx];
+    }
+} // helper functions
+
+int
+RunServer(const server_options_t &options, const cluster_options_t &cluster_options, std::ostream &log) {
+    sockaddr_un addr;
+    if (!make_address(options.socket_path, addr)) {
+        log << "ERROR: socket path too long\n";
+        return 1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.socket_path.c_str());
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        listen(listen_fd, 128) != 0 || !set_nonblocking(listen_fd)) {
+        log << "ERROR: cannot listen on " << options.socket_path << ": " << std::strerror(errno) << "\n";
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return 1;
+    }
+
+    // interrupt poll() on shutdown, a closed client must not kill the server
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    log << "listening on " << options.socket_path << std::endl;
+
+    {
+        Server server(cluster_options);
+        bool ran = false;
+        while (!stop_requested) {
+            std::vector<pollfd> fds;
+            std::vector<client_t *> polled;
+            pollfd listen_pfd = {listen_fd, POLLIN, 0};
+            fds.push_back(listen_pfd);
+            for (client_t *client : server.Clients()) {
+                short events = 0;
+                if (!client->eof && client->lines.size() < MAX_PENDING_LINES) {
+                    events |= POLLIN;
+                }
+                if (!client->out_buf.empty()) {
+                    events |= POLLOUT;
+                }
+                pollfd pfd = {client->fd, events, 0};
+                fds.push_back(pfd);
+                polled.push_back(client);
+            }
+
+            // don't wait while there is work, retry blocked ops every millisecond
+            int timeout = ran ? 0 : (server.HasQueuedOps() ? 1 : 100);
+            if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+                log << "ERROR: poll: " << std::strerror(errno) << "\n";
+                break;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                int fd;
+                while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+                    set_nonblocking(fd);
+                    server.Accept(fd);
+                }
+            }
+            for (size_t i = 0; i < polled.size(); ++i) {
+                client_t *client = polled[i];
+                if (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    if (!receive(client->fd, client->in_buf)) {
+                        client->eof = true;
+                    }
+                    take_lines(client->in_buf, client->lines);
+                }
+            }
+
+            ran = server.Step();
+            server.Flush();
+        }
+        log << "served " << server.Lines() << " lines in " << server.Ticks() << " ticks" << std::endl;
+    }
+
+    close(listen_fd);
+    unlink(options.socket_path.c_str());
+    return 0;
+}
+
+int
+RunLoad(const load_options_t &options, std::ostream &report) {
+    sockaddr_un addr;
+    if (!make_address(options.socket_path, addr)) {
+        report << "ERROR: socket path too long\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<conn_t> conns(options.clients);
+    for (int i = 0; i < options.clients; ++i) {
+        conn_t &conn = conns[i];
+        conn.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (conn.fd < 0 || connect(conn.fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+            report << "ERROR: cannot connect to " << options.socket_path << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+        set_nonblocking(conn.fd);
+        conn.base_id = options.id_base + i * 1000000;
+        conn.seq = 0;
+        conn.trans_id = -1;
+    }
+
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<int> item_dist(1, ITEM_COUNT);
+    std::uniform_int_distribution<int> value_dist(0, 9999);
+
+    std::vector<double> latency_us;
+    long committed = 0, aborted = 0, reads = 0;
+    bool failed = false;
+
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::microseconds(static_cast<long>(options.seconds * 1e6));
+    auto give_up = deadline + std::chrono::seconds(10);
+    while (!failed) {
+        auto now = std::chrono::steady_clock::now();
+        bool accepting = now < deadline;
+
+        // start the next transaction on every idle connection, the whole script is pipelined
+        size_t in_flight = 0;
+        for (conn_t &conn : conns) {
+            if (conn.trans_id < 0 && accepting) {
+                conn.seq = conn.seq % 999999 + 1;
+                conn.trans_id = conn.base_id + conn.seq;
+                std::string t = "T" + std::to_string(conn.trans_id);
+                std::string script = "begin(" + t + ")\n";
+                for (int op = 0; op < options.ops; ++op) {
+                    if (op > 0) {
+                        script += "; ";
+                    }
+                    std::string item = "x" + std::to_string(item_dist(rng));
+                    if (op % 2 == 0) {
+                        script += "R(" + t + "," + item + ")";
+                    } else {
+                        script += "W(" + t + "," + item + "," + std::to_string(value_dist(rng)) + ")";
+                    }
+                }
+                script += "\nend(" + t + ")\n";
+                conn.out_buf += script;
+                conn.start = now;
+            }
+            if (conn.trans_id >= 0) {
+                in_flight++;
+            }
+        }
+        if (in_flight == 0 || now > give_up) {
+            break;
+        }
+
+        std::vector<pollfd> fds;
+        for (conn_t &conn : conns) {
+            pollfd pfd = {conn.fd, static_cast<short>(POLLIN | (conn.out_buf.empty() ? 0 : POLLOUT)), 0};
+            fds.push_back(pfd);
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+            report << "ERROR: poll: " << std::strerror(errno) << "\n";
+            return 1;
+        }
+
+        for (size_t i = 0; i < conns.size(); ++i) {
+            conn_t &conn = conns[i];
+            if (!send_pending(conn.fd, conn.out_buf)) {
+                report << "ERROR: connection closed by the server\n";
+                failed = true;
+                break;
+            }
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (!receive(conn.fd, conn.in_buf)) {
+                report << "ERROR: connection closed by the server\n";
+                failed = true;
+                break;
+            }
+
+            std::deque<std::string> lines;
+            take_lines(conn.in_buf, lines);
+            std::string t = "Transaction T" + std::to_string(conn.trans_id) + " ";
+            for (const std::string &line : lines) {
+                if (line.compare(0, 5, "ERROR") == 0) {
+                    report << "server rejected a command: " << line << "\n";
+                    failed = true;
+                    break;
+                }
+                if (line.compare(0, 14, "Received from ") == 0) {
+                    reads += line.find(" READ ") != std::string::npos;
+                    continue;
+                }
+                // the response to end() closes the transaction
+                bool commit = line == t + "finished succesfully!";
+                bool abort = line == t + "has already aborted";
+                if (commit || abort) {
+                    auto end = std::chrono::steady_clock::now();
+                    latency_us.push_back(std::chrono::duration<double, std::micro>(end - conn.start).count());
+                    committed += commit;
+                    aborted += abort;
+                    conn.trans_id = -1;
+                }
+            }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    for (conn_t &conn : conns) {
+        close(conn.fd);
+    }
+
+    double wall = std::chrono::duration<double>(end - start).count();
+    std::sort(latency_us.begin(), latency_us.end());
+    report << "---------------- Load (" << options.clients << " clients, " << options.ops
+           << " ops per transaction) ----------------\n";
+    report << std::fixed << std::setprecision(3);
+    report << "committed " << committed << ", aborted " << aborted << ", reads " << reads
+           << " in " << wall << " s\n";
+    report << std::setprecision(0);
+    report << "throughput " << (wall > 0 ? (committed + aborted) / wall : 0) << " transactions/s, "
+           << (wall > 0 ? committed / wall : 0) << " commits/s\n";
+    report << std::setprecision(1);
+    report << "latency us: p50 " << percentile(latency_us, 0.50)
+           << "  p90 " << percentile(latency_us, 0.90)
+           << "  p99 " << percentile(latency_us, 0.99)
+           << "  max " << (latency_us.empty() ? 0 : latency_us.back()) << "\n";
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Date: 2026-10-18
+ * Description: Server mode and its load generator.
+ * - RunServer: one cluster serves many clients over a Unix domain socket. A client sends lines of the usual
+ *   command language and may pipeline as many of them as it likes. The lines of a client run in order, one tick
+ *   each, and a line is held back while a transaction of that client still has queued ops. The read results and
+ *   the outcome of a transaction go back to the client that began it, anything else a line prints (dumps,
+ *   errors) goes back to the client that sent the line.
+ * - RunLoad: opens a number of connections, each of them runs one transaction after another as fast as the
+ *   server answers, and reports the sustained transactions per second and the latency percentiles.
+ *
+**/
+#pragma once
+
+#include"Cluster.h"
+#include<ostream>
+#include<string>
+
+struct server_options_t {
+    std::string socket_path;
+};
+
+struct load_options_t {
+    std::string socket_path;
+
+    // number of connections, each of them has one transaction in flight
+    int clients;
+
+    // how long new transactions are started
+    double seconds;
+
+    // reads and writes per transaction, half of each
+    int ops;
+
+    // the ids of connection i are id_base + i * 1000000 + 1, 2, ...
+    int id_base;
+
+    unsigned seed;
+
+    load_options_t() {
+        clients = 8;
+        seconds = 5;
+        ops = 4;
+        id_base = 0;
+        seed = 1;
+    }
+};
+
+// Serve until SIGINT or SIGTERM. Ret: 0 on a clean shutdown, 1 if the socket could not be set up
+int RunServer(const server_options_t &options, const cluster_options_t &cluster_options, std::ostream &log);
+
+// Ret: 0 if the run completed, 1 if the server could not be reached or rejected a command
+int RunLoad(const load_options_t &options, std::ostream &report);
@@ -0,0 +1,758 @@
+/**
+ * Date: 2026-10-18
+ * Description: Multi-process deployment of the data sites, see SiteProc.h
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  Spawn                 |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  Kill                  |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  Call                  |request, payload      |the reply message
+ *  -----------------------------------------------------------------------------------------
+ *  run_site              |site_id, rings, path  |(never returns)
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "SiteProc.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "DataMng.h"
+
+namespace {
+    const char *msg_type_name(int type) {
+        switch (type) {
+            case MSG_FAIL: return "fail";
+            case MSG_RECOVER: return "recover";
+            case MSG_DUMP: return "dump";
+            case MSG_DUMP_ITEM: return "dump_item";
+            case MSG_EXPORT: return "export";
+            case MSG_ABORT: return "abort";
+            case MSG_READ_LOCK: return "read_lock";
+            case MSG_READ: return "read";
+            case MSG_RONLY: return "ronly";
+            case MSG_SNAPSHOT: return "snapshot_scan";
+            case MSG_READ_BATCH: return "lock_and_read";
+            case MSG_WRITE_BATCH: return "lock_and_write";
+            case MSG_INC: return "lock_and_inc";
+            case MSG_COMMIT_BATCH: return "commit";
+            case MSG_WAIT_GRAPH: return "waiting_graph";
+            default: return "other";
+        }
+    }
+
+    void err_site_died(siteid_t site_id) {
+        std::cout << "ERROR: Site " << site_id << " process exited unexpectedly\n";
+        std::exit(-1);
+    }
+
+    // futex on a word in shared memory, so it must not be a private futex
+    void futex_wait(std::atomic<uint32_t> &word, uint32_t expected) {
+        timespec timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_nsec = 10 * 1000 * 1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    void futex_wake(std::atomic<uint32_t> &word) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    // spin for a short while before going to sleep, most replies arrive within microseconds
+    const int SPIN_COUNT = 2000;
+
+    site_msg_t encode_op(site_msg_type_t type, const op_t &op) {
+        site_msg_t msg(type);
+        msg.op_id = op.op_id;
+        msg.trans_id = op.trans_id;
+        msg.op_type = op.op_type;
+        if (op.op_type == OP_WRITE || op.op_type == OP_INC) {
+            msg.item_id = op.param.w_param.item_id;
+            msg.value = op.param.w_param.value;
+        } else {
+            msg.item_id = op.param.r_param.item_id;
+        }
+        return msg;
+    }
+
+    op_t decode_op(const site_msg_t &msg) {
+        op_param_t param;
+        if (msg.op_type == OP_WRITE || msg.op_type == OP_INC) {
+            param.w_param.item_id = msg.item_id;
+            param.w_param.value = msg.value;
+        } else {
+            param.r_param.item_id = msg.item_id;
+        }
+        return op_t(msg.op_id, msg.trans_id, static_cast<op_type_t>(msg.op_type), param);
+    }
+
+    void push_blocking(msg_ring_t *ring, const site_msg_t &msg) {
+        int spins = 0;
+        while (!ring->TryPush(msg)) {
+            if (++spins < SPIN_COUNT) {
+                sched_yield();
+            } else {
+                ring->WaitNotFull();
+            }
+        }
+    }
+
+    //------------------------- the site process -------------------------------
+    // Forwards the read/write results to the TM, after whatever the site printed so far
+    class SiteProcListener : public SiteListener {
+    public:
+        SiteProcListener(msg_ring_t *out, std::ostringstream *printed) {
+            _out = out;
+            _printed = printed;
+        }
+
+        void FlushText() {
+            std::string text = _printed->str();
+            _printed->str("");
+            for (size_t pos = 0; pos < text.size(); pos += sizeof(site_msg_t::text)) {
+                site_msg_t msg(MSG_TEXT);
+                msg.count = static_cast<int32_t>(std::min(sizeof(msg.text), text.size() - pos));
+                std::memcpy(msg.text, text.data() + pos, msg.count);
+                push_blocking(_out, msg);
+            }
+        }
+
+        void ReceiveReadResponse(op_t op, siteid_t /*site_id*/, int value) override {
+            FlushText();
+            site_msg_t msg = encode_op(MSG_READ_RESP, op);
+            msg.value = value;
+            push_blocking(_out, msg);
+        }
+
+        void ReceiveWriteResponse(op_t op, siteid_t /*site_id*/) override {
+            FlushText();
+            push_blocking(_out, encode_op(MSG_WRITE_RESP, op));
+        }
+
+        void ReceiveLockGrant(transid_t trans_id, siteid_t /*site_id*/) override {
+            site_msg_t msg(MSG_LOCK_READY);
+            msg.trans_id = trans_id;
+            push_blocking(_out, msg);
+        }
+
+        void ReceiveLockWait(transid_t trans_id, siteid_t /*site_id*/) override {
+            site_msg_t msg(MSG_LOCK_WAIT);
+            msg.trans_id = trans_id;
+            push_blocking(_out, msg);
+        }
+
+    private:
+        msg_ring_t *_out;
+        std::ostringstream *_printed;
+    };
+
+    // rewrite the whole log, and rename it over the old one so a kill never leaves half a file
+    void save_stable(DataMng &dm, const std::string &path) {
+        std::string tmp_path = path + ".tmp";
+        {
+            std::ofstream out(tmp_path.c_str(), std::ios::trunc);
+            dm.SaveStable(out);
+        }
+        std::rename(tmp_path.c_str(), path.c_str());
+    }
+
+    site_msg_t pop_blocking(msg_ring_t *ring) {
+        site_msg_t msg;
+        int spins = 0;
+        while (!ring->TryPop(msg)) {
+            if (++spins < SPIN_COUNT) {
+                sched_yield();
+            } else {
+                ring->WaitNotEmpty();
+            }
+        }
+        return msg;
+    }
+
+    void run_site(siteid_t site_id, msg_ring_t *in, msg_ring_t *out, const std::string &stable_path,
+                  int escalation_threshold, int hot_versions, const std::string &cold_dir) {
+        // everything the DataMng prints goes back to the TM as text
+        std::ostringstream printed;
+        SiteProcListener listener(out, &printed);
+        DataMng dm(site_id, &listener, printed);
+        dm.SetEscalationThreshold(escalation_threshold);
+        dm.SetColdTier(cold_dir, hot_versions);
+
+        std::ifstream stable(stable_path.c_str());
+        if (stable.is_open()) {
+            if (!dm.LoadStable(stable)) {
+                std::cerr << "ERROR: Site " << site_id << " has a corrupted stable storage\n";
+                _exit(-1);
+            }
+        } else {
+            save_stable(dm, stable_path);
+        }
+        stable.close();
+
+        // commits are appended to the log before they are applied
+        std::ofstream commit_log(stable_path.c_str(), std::ios::app);
+
+        while (true) {
+            site_msg_t msg = pop_blocking(in);
+            site_msg_t reply(MSG_REPLY);
+
+            if (msg.type == MSG_RANK) {
+                // the TM does not wait for it
+                dm.SetTransRank(msg.trans_id, msg.value);
+                continue;
+            }
+
+            switch (msg.type) {
+                case MSG_FAIL:
+                    dm.Fail(msg.ts);
+                    commit_log.close();
+                    save_stable(dm, stable_path);
+                    break;
+                case MSG_RECOVER:
+                    dm.Recover(msg.ts);
+                    commit_log.close();
+                    save_stable(dm, stable_path);
+                    commit_log.open(stable_path.c_str(), std::ios::app);
+                    break;
+                case MSG_DUMP:
+                    dm.Dump();
+                    break;
+                case MSG_DUMP_ITEM:
+                    dm.DumpItem(msg.item_id);
+                    break;
+                case MSG_EXPORT: {
+                    std::string path;
+                    while (static_cast<int>(path.size()) < msg.count) {
+                        site_msg_t part = pop_blocking(in);
+                        path.append(part.text, part.count);
+                    }
+                    long records = dm.Export(msg.ts, path, static_cast<dump_format_t>(msg.op_type));
+                    reply.value = static_cast<int32_t>(records);
+                    break;
+                }
+                case MSG_ABORT:
+                    dm.Abort(msg.trans_id);
+                    break;
+                case MSG_READ_LOCK:
+                    reply.value = dm.GetReadLock(msg.trans_id, msg.item_id);
+                    break;
+                case MSG_READ:
+                    reply.value = dm.Read(decode_op(msg));
+                    break;
+                case MSG_RONLY:
+                    reply.value = dm.Ronly(decode_op(msg), msg.ts);
+                    break;
+                case MSG_INC:
+                    reply.value = dm.LockAndIncrement(decode_op(msg));
+                    break;
+                case MSG_SNAPSHOT: {
+                    snapshot_t snapshot = dm.SnapshotScan(msg.item_id, msg.value, msg.op_type != 0, msg.ts,
+                                                          msg.count != 0);
+                    for (size_t i = 0; i < snapshot.items.size(); ++i) {
+                        site_msg_t item(MSG_SCAN_ITEM);
+                        item.item_id = snapshot.items[i];
+                        item.value = snapshot.values[i];
+                        push_blocking(out, item);
+                    }
+                    for (itemid_t item_id : snapshot.missed) {
+                        site_msg_t miss(MSG_SCAN_MISS);
+                        miss.item_id = item_id;
+                        push_blocking(out, miss);
+                    }
+                    // the sum does not fit into value, it travels in text
+                    reply.count = snapshot.count;
+                    std::memcpy(reply.text, &snapshot.sum, sizeof(snapshot.sum));
+                    break;
+                }
+                case MSG_READ_BATCH:
+                case MSG_WRITE_BATCH: {
+                    std::vector<op_t> ops;
+                    for (int i = 0; i < msg.count; ++i) {
+                        ops.push_back(decode_op(pop_blocking(in)));
+                    }
+                    std::vector<bool> granted = msg.type == MSG_READ_BATCH ? dm.LockAndReadBatch(ops)
+                                                                           : dm.LockAndWriteBatch(ops);
+                    listener.FlushText();
+                    for (bool g : granted) {
+                        site_msg_t grant(MSG_GRANT);
+                        grant.value = g;
+                        push_blocking(out, grant);
+                    }
+                    break;
+                }
+                case MSG_COMMIT_BATCH: {
+                    std::vector<transid_t> trans_ids;
+                    for (int i = 0; i < msg.count; ++i) {
+                        trans_ids.push_back(pop_blocking(in).trans_id);
+                    }
+                    dm.LogCommit(commit_log, trans_ids, msg.ts);
+                    commit_log.flush();
+                    dm.GroupCommit(trans_ids, msg.ts);
+                    break;
+                }
+                case MSG_WAIT_GRAPH: {
+                    auto graph = dm.GetWaitingGraph();
+                    for (const auto &p : graph) {
+                        for (transid_t child : p.second) {
+                            site_msg_t edge(MSG_EDGE);
+                            edge.trans_id = p.first;
+                            edge.value = child;
+                            push_blocking(out, edge);
+                        }
+                    }
+                    break;
+                }
+                case MSG_SHUTDOWN:
+                    push_blocking(out, reply);
+                    _exit(0);
+                default:
+                    std::cerr << "ERROR: Site " << site_id << " received an invalid message\n";
+                    _exit(-1);
+            }
+
+            listener.FlushText();
+            push_blocking(out, reply);
+        }
+    }
+} // helper functions
+
+// ----------------------------- msg_ring_t -----------------------------------
+
+void
+msg_ring_t::Reset() {
+    head.store(0);
+    tail.store(0);
+    sleepers.store(0);
+}
+
+bool
+msg_ring_t::TryPush(const site_msg_t &msg) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == RING_SLOTS) {
+        return false;
+    }
+    slots[t % RING_SLOTS] = msg;
+    tail.store(t + 1, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst)) {
+        futex_wake(tail);
+    }
+    return true;
+}
+
+bool
+msg_ring_t::TryPop(site_msg_t &msg) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    msg = slots[h % RING_SLOTS];
+    head.store(h + 1, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst)) {
+        futex_wake(head);
+    }
+    return true;
+}
+
+void
+msg_ring_t::WaitNotFull() {
+    sleepers.store(1, std::memory_order_seq_cst);
+    uint32_t h = head.load(std::memory_order_seq_cst);
+    if (tail.load(std::memory_order_relaxed) - h == RING_SLOTS) {
+        futex_wait(head, h);
+    }
+    sleepers.store(0, std::memory_order_seq_cst);
+}
+
+void
+msg_ring_t::WaitNotEmpty() {
+    sleepers.store(1, std::memory_order_seq_cst);
+    uint32_t t = tail.load(std::memory_order_seq_cst);
+    if (head.load(std::memory_order_relaxed) == t) {
+        futex_wait(tail, t);
+    }
+    sleepers.store(0, std::memory_order_seq_cst);
+}
+
+// ----------------------------- SiteProcStats --------------------------------
+
+void
+SiteProcStats::Record(site_msg_type_t type, double micros) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _latency_us[type].push_back(micros);
+}
+
+void
+SiteProcStats::Print(std::ostream &out, double wall_seconds) {
+    size_t total = 0;
+    out << "---------------- Site messaging (round trip, us) ----------------\n";
+    out << std::left << std::setw(16) << "request" << std::right
+        << std::setw(10) << "count" << std::setw(10) << "mean"
+        << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+    out << std::fixed << std::setprecision(1);
+    for (auto &p : _latency_us) {
+        std::vector<double> &samples = p.second;
+        std::sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double us : samples) {
+            sum += us;
+        }
+        out << std::left << std::setw(16) << msg_type_name(p.first) << std::right
+            << std::setw(10) << samples.size()
+            << std::setw(10) << sum / samples.size()
+            << std::setw(10) << samples[samples.size() / 2]
+            << std::setw(10) << samples[samples.size() * 99 / 100]
+            << std::setw(10) << samples.back() << "\n";
+        total += samples.size();
+    }
+    out << "total " << total << " requests in " << std::setprecision(3) << wall_seconds << " s";
+    if (wall_seconds > 0) {
+        out << " (" << std::setprecision(0) << total / wall_seconds << " requests/s)";
+    }
+    out << "\n";
+}
+
+// ----------------------------- SiteProxy ------------------------------------
+
+SiteProxy::SiteProxy(siteid_t site_id, SiteListener *listener, std::ostream &out, const std::string &stable_path,
+                     SiteProcStats *stats, int escalation_threshold, int hot_versions, const std::string &cold_dir)
+        : _out(out) {
+    _site_id = site_id;
+    _listener = listener;
+    _stable_path = stable_path;
+    _stats = stats;
+    _escalation_threshold = escalation_threshold;
+    _hot_versions = hot_versions;
+    _cold_dir = cold_dir;
+    _pid = -1;
+
+    // both rings are shared with every process we fork for this site
+    void *shm = mmap(nullptr, 2 * sizeof(msg_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shm == MAP_FAILED) {
+        std::cout << "ERROR: Cannot map the rings of Site " << site_id << "\n";
+        std::exit(-1);
+    }
+    _to_site = new(shm) msg_ring_t();
+    _to_tm = new(static_cast<char *>(shm) + sizeof(msg_ring_t)) msg_ring_t();
+
+    Spawn();
+}
+
+SiteProxy::~SiteProxy() {
+    if (_pid > 0) {
+        Send(site_msg_t(MSG_SHUTDOWN));
+        waitpid(_pid, nullptr, 0);
+    }
+    munmap(_to_site, 2 * sizeof(msg_ring_t));
+    std::remove(_stable_path.c_str());
+}
+
+void
+SiteProxy::Spawn() {
+    _to_site->Reset();
+    _to_tm->Reset();
+
+    // whatever is buffered would otherwise be printed twice
+    _out.flush();
+    std::cout.flush();
+
+    pid_t ppid = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cout << "ERROR: Cannot start Site " << _site_id << "\n";
+        std::exit(-1);
+    }
+    if (pid == 0) {
+        // do not outlive the TM
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != ppid) {
+            _exit(0);
+        }
+        run_site(_site_id, _to_site, _to_tm, _stable_path, _escalation_threshold, _hot_versions, _cold_dir);
+        _exit(0);
+    }
+    _pid = pid;
+}
+
+void
+SiteProxy::Kill() {
+    kill(_pid, SIGKILL);
+    waitpid(_pid, nullptr, 0);
+    _pid = -1;
+}
+
+void
+SiteProxy::Send(const site_msg_t &msg) {
+    push_blocking(_to_site, msg);
+}
+
+site_msg_t
+SiteProxy::Call(const std::vector<site_msg_t> &request, std::vector<site_msg_t> *payload) {
+    auto start = std::chrono::steady_clock::now();
+    for (const site_msg_t &msg : request) {
+        Send(msg);
+    }
+
+    site_msg_t msg;
+    int spins = 0;
+    while (true) {
+        if (!_to_tm->TryPop(msg)) {
+            if (++spins < SPIN_COUNT) {
+                sched_yield();
+                continue;
+            }
+            // a long wait, make sure the site is still alive
+            if (waitpid(_pid, nullptr, WNOHANG) != 0) {
+                err_site_died(_site_id);
+            }
+            _to_tm->WaitNotEmpty();
+            continue;
+        }
+
+        if (msg.type == MSG_REPLY) {
+            break;
+        } else if (msg.type == MSG_TEXT) {
+            _out.write(msg.text, msg.count);
+        } else if (msg.type == MSG_READ_RESP) {
+            _listener->ReceiveReadResponse(decode_op(msg), _site_id, msg.value);
+        } else if (msg.type == MSG_WRITE_RESP) {
+            _listener->ReceiveWriteResponse(decode_op(msg), _site_id);
+        } else if (msg.type == MSG_LOCK_READY) {
+            _listener->ReceiveLockGrant(msg.trans_id, _site_id);
+        } else if (msg.type == MSG_LOCK_WAIT) {
+            _listener->ReceiveLockWait(msg.trans_id, _site_id);
+        } else if (payload != nullptr) {
+            payload->push_back(msg);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    _stats->Record(static_cast<site_msg_type_t>(request.front().type),
+                   std::chrono::duration<double, std::micro>(end - start).count());
+    return msg;
+}
+
+void
+SiteProxy::Fail(timestamp_t _ts) {
+    site_msg_t msg(MSG_FAIL);
+    msg.ts = _ts;
+    Call(std::vector<site_msg_t>(1, msg));
+    Kill();
+}
+
+void
+SiteProxy::Recover(timestamp_t _ts) {
+    // a site that is up keeps its locks and transactions, only the memory is reloaded (see DataMng::Recover)
+    if (_pid <= 0) {
+        Spawn();
+    }
+
+    site_msg_t msg(MSG_RECOVER);
+    msg.ts = _ts;
+    Call(std::vector<site_msg_t>(1, msg));
+}
+
+void
+SiteProxy::Dump() {
+    if (_pid > 0) {
+        Call(std::vector<site_msg_t>(1, site_msg_t(MSG_DUMP)));
+        return;
+    }
+
+    // the site is down, read its disk directly
+    DataMng dm(_site_id, _listener, _out);
+    std::ifstream stable(_stable_path.c_str());
+    dm.LoadStable(stable);
+    dm.Dump();
+}
+
+void
+SiteProxy::DumpItem(itemid_t item_id) {
+    if (_pid > 0) {
+        site_msg_t msg(MSG_DUMP_ITEM);
+        msg.item_id = item_id;
+        Call(std::vector<site_msg_t>(1, msg));
+        return;
+    }
+
+    // the site is down, read its disk directly
+    DataMng dm(_site_id, _listener, _out);
+    std::ifstream stable(_stable_path.c_str());
+    dm.LoadStable(stable);
+    dm.DumpItem(item_id);
+}
+
+long
+SiteProxy::Export(timestamp_t ts, const std::string &path, dump_format_t format) {
+    if (_pid > 0) {
+        std::vector<site_msg_t> request(1, site_msg_t(MSG_EXPORT));
+        request[0].ts = ts;
+        request[0].op_type = format;
+        request[0].count = static_cast<int32_t>(path.size());
+        for (size_t i = 0; i < path.size(); i += sizeof(request[0].text)) {
+            site_msg_t part(MSG_TEXT);
+            part.count = static_cast<int32_t>(std::min(path.size() - i, sizeof(part.text)));
+            std::memcpy(part.text, path.data() + i, part.count);
+            request.push_back(part);
+        }
+        return Call(request).value;
+    }
+
+    // the site is down, read its disk directly
+    DataMng dm(_site_id, _listener, _out);
+    std::ifstream stable(_stable_path.c_str());
+    dm.LoadStable(stable);
+    return dm.Export(ts, path, format);
+}
+
+void
+SiteProxy::Abort(transid_t trans_id) {
+    // a failed site has already forgotten every transaction
+    if (_pid < 0) {
+        return;
+    }
+    site_msg_t msg(MSG_ABORT);
+    msg.trans_id = trans_id;
+    Call(std::vector<site_msg_t>(1, msg));
+}
+
+void
+SiteProxy::SetTransRank(transid_t trans_id, int rank) {
+    if (_pid < 0) {
+        return;
+    }
+    site_msg_t msg(MSG_RANK);
+    msg.trans_id = trans_id;
+    msg.value = rank;
+    Send(msg);
+}
+
+bool
+SiteProxy::GetReadLock(transid_t trans_id, itemid_t item_id) {
+    site_msg_t msg(MSG_READ_LOCK);
+    msg.trans_id = trans_id;
+    msg.item_id = item_id;
+    return Call(std::vector<site_msg_t>(1, msg)).value != 0;
+}
+
+bool
+SiteProxy::Read(op_t op) {
+    return Call(std::vector<site_msg_t>(1, encode_op(MSG_READ, op))).value != 0;
+}
+
+bool
+SiteProxy::Ronly(op_t op, timestamp_t ts) {
+    site_msg_t msg = encode_op(MSG_RONLY, op);
+    msg.ts = ts;
+    return Call(std::vector<site_msg_t>(1, msg)).value != 0;
+}
+
+snapshot_t
+SiteProxy::SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts, bool with_values) {
+    site_msg_t msg(MSG_SNAPSHOT);
+    msg.item_id = first;
+    msg.value = last;
+    msg.op_type = replicated;
+    msg.ts = ts;
+    msg.count = with_values;
+
+    std::vector<site_msg_t> payload;
+    site_msg_t reply = Call(std::vector<site_msg_t>(1, msg), &payload);
+
+    snapshot_t snapshot;
+    snapshot.count = reply.count;
+    std::memcpy(&snapshot.sum, reply.text, sizeof(snapshot.sum));
+    for (const site_msg_t &item : payload) {
+        if (item.type == MSG_SCAN_ITEM) {
+            snapshot.items.push_back(item.item_id);
+            snapshot.values.push_back(item.value);
+        } else {
+            snapshot.missed.push_back(item.item_id);
+        }
+    }
+    return snapshot;
+}
+
+std::vector<bool>
+SiteProxy::LockAndReadBatch(const std::vector<op_t> &ops) {
+    return CallBatch(MSG_READ_BATCH, ops);
+}
+
+std::vector<bool>
+SiteProxy::LockAndWriteBatch(const std::vector<op_t> &ops) {
+    return CallBatch(MSG_WRITE_BATCH, ops);
+}
+
+inc_result_t
+SiteProxy::LockAndIncrement(op_t op) {
+    return static_cast<inc_result_t>(Call(std::vector<site_msg_t>(1, encode_op(MSG_INC, op))).value);
+}
+
+std::vector<bool>
+SiteProxy::CallBatch(site_msg_type_t type, const std::vector<op_t> &ops) {
+    std::vector<site_msg_t> request;
+    site_msg_t header(type);
+    header.count = static_cast<int32_t>(ops.size());
+    request.push_back(header);
+    for (const op_t &op : ops) {
+        request.push_back(encode_op(MSG_OP, op));
+    }
+
+    std::vector<site_msg_t> payload;
+    Call(request, &payload);
+
+    std::vector<bool> granted;
+    for (const site_msg_t &msg : payload) {
+        granted.push_back(msg.value != 0);
+    }
+    return granted;
+}
+
+void
+SiteProxy::GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) {
+    // a failed site has already forgotten every transaction
+    if (_pid < 0) {
+        return;
+    }
+
+    std::vector<site_msg_t> request;
+    site_msg_t header(MSG_COMMIT_BATCH);
+    header.count = static_cast<int32_t>(trans_ids.size());
+    header.ts = commit_time;
+    request.push_back(header);
+    for (transid_t trans_id : trans_ids) {
+        site_msg_t msg(MSG_OP);
+        msg.trans_id = trans_id;
+        request.push_back(msg);
+    }
+    Call(request);
+}
+
+std::unordered_map<siteid_t, std::unordered_set<siteid_t>>
+SiteProxy::GetWaitingGraph() {
+    std::vector<site_msg_t> payload;
+    Call(std::vector<site_msg_t>(1, site_msg_t(MSG_WAIT_GRAPH)), &payload);
+
+    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> graph;
+    for (const site_msg_t &edge : payload) {
+        graph[edge.trans_id].insert(edge.value);
+    }
+    return graph;
+}
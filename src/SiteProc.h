@@ -0,0 +1,188 @@
+/**
+ * Date: 2026-10-18
+ * Description: Multi-process deployment of the data sites. Each site runs a DataMng in its own process, and
+ * the TM talks to it through a SiteProxy over a pair of single-producer/single-consumer ring buffers in shared
+ * memory, using fixed-size binary messages. fail(n) kills the site process and recover(n) starts a new one,
+ * which reloads the stable storage (versions and fail history) the site wrote to its file.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include"DataSite.h"
+#include<atomic>
+#include<cstdint>
+#include<map>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<vector>
+#include<sys/types.h>
+
+// Every message between the TM and a site process
+enum site_msg_type_t {
+    // requests: TM -> site
+    MSG_FAIL,
+    MSG_RECOVER,
+    MSG_DUMP,
+    MSG_DUMP_ITEM,
+    MSG_EXPORT,         // op_type = the format, count = length of the path following in MSG_TEXT, reply value = records
+    MSG_ABORT,
+    MSG_READ_LOCK,
+    MSG_READ,
+    MSG_RONLY,
+    MSG_SNAPSHOT,       // item_id..value = the range, op_type = replicated, count = with values
+    MSG_READ_BATCH,     // count = number of MSG_OP following
+    MSG_WRITE_BATCH,    // count = number of MSG_OP following
+    MSG_INC,            // the reply value is the inc_result_t
+    MSG_COMMIT_BATCH,   // count = number of MSG_OP following, only trans_id is used
+    MSG_WAIT_GRAPH,
+    MSG_RANK,           // value = the rank of trans_id, no reply
+    MSG_SHUTDOWN,
+    MSG_OP,
+
+    // responses: site -> TM
+    MSG_READ_RESP,
+    MSG_WRITE_RESP,
+    MSG_LOCK_READY,     // a lock request of trans_id may be granted now
+    MSG_LOCK_WAIT,      // a lock request of trans_id has to wait
+    MSG_TEXT,           // count = number of valid chars in text (also the path of MSG_EXPORT)
+    MSG_GRANT,          // value = 1 if the op at this position is granted
+    MSG_EDGE,           // trans_id waits for value
+    MSG_SCAN_ITEM,      // item_id has value at the snapshot
+    MSG_SCAN_MISS,      // item_id cannot be served at the snapshot
+    MSG_REPLY,          // the end of a request, value = the return value if there is one
+
+    MSG_TYPE_COUNT
+};
+
+// A fixed-size message: one cache line
+struct site_msg_t {
+    int32_t type;
+    int32_t count;
+    int32_t trans_id;
+    int32_t item_id;
+    int32_t value;
+    int32_t op_id;
+    int32_t op_type;
+    int32_t ts;
+    char text[32];
+
+    site_msg_t() {
+        type = MSG_REPLY;
+        count = trans_id = item_id = value = op_id = op_type = ts = 0;
+    }
+
+    explicit site_msg_t(site_msg_type_t _type) : site_msg_t() {
+        type = _type;
+    }
+};
+
+#define RING_SLOTS 256
+
+// Single-producer/single-consumer ring living in shared memory
+struct msg_ring_t {
+    alignas(64) std::atomic<uint32_t> head;     // next slot to read, only moved by the consumer
+    alignas(64) std::atomic<uint32_t> tail;     // next slot to write, only moved by the producer
+    alignas(64) std::atomic<uint32_t> sleepers; // set while a side is blocked on head/tail
+    site_msg_t slots[RING_SLOTS];
+
+    void Reset();
+
+    // Return false if the ring is full / empty
+    bool TryPush(const site_msg_t &msg);
+
+    bool TryPop(site_msg_t &msg);
+
+    // Block for a while until the ring may have changed
+    void WaitNotFull();
+
+    void WaitNotEmpty();
+};
+
+// Round-trip time of every request, shared by all the proxies (which may record from several threads)
+class SiteProcStats {
+public:
+    void Record(site_msg_type_t type, double micros);
+
+    // Per message type count and latency percentiles, and the overall throughput
+    void Print(std::ostream &out, double wall_seconds);
+
+private:
+    std::mutex _mutex;
+    std::map<int, std::vector<double>> _latency_us;
+};
+
+// The TM side of a site process
+class SiteProxy : public DataSite {
+public:
+    // Start the site process. Its stable storage lives in stable_path, what it prints is written to out
+    SiteProxy(siteid_t site_id, SiteListener *listener, std::ostream &out, const std::string &stable_path,
+              SiteProcStats *stats, int escalation_threshold, int hot_versions, const std::string &cold_dir);
+
+    // Shut the site process down and remove its stable storage
+    ~SiteProxy() override;
+
+    // The site records the failure in its stable storage, then its process is killed
+    void Fail(timestamp_t _ts) override;
+
+    // Start a new site process, which recovers from the stable storage
+    void Recover(timestamp_t _ts) override;
+
+    void Dump() override;
+
+    void DumpItem(itemid_t item_id) override;
+
+    // The site process writes the file itself, a failed site is exported from its stable storage
+    long Export(timestamp_t ts, const std::string &path, dump_format_t format) override;
+
+    void Abort(transid_t trans_id) override;
+
+    void SetTransRank(transid_t trans_id, int rank) override;
+
+    bool GetReadLock(transid_t trans_id, itemid_t item_id) override;
+
+    bool Read(op_t op) override;
+
+    bool Ronly(op_t op, timestamp_t ts) override;
+
+    snapshot_t SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts,
+                            bool with_values) override;
+
+    std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) override;
+
+    std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) override;
+
+    inc_result_t LockAndIncrement(op_t op) override;
+
+    void GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) override;
+
+    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() override;
+
+private:
+    siteid_t _site_id;
+    SiteListener *_listener;
+    std::ostream &_out;
+    std::string _stable_path;
+    SiteProcStats *_stats;
+    int _escalation_threshold;
+    int _hot_versions;
+    std::string _cold_dir;
+
+    pid_t _pid;
+    msg_ring_t *_to_site;
+    msg_ring_t *_to_tm;
+
+    void Spawn();
+
+    void Kill();
+
+    void Send(const site_msg_t &msg);
+
+    // Send a request and wait for its reply. Read/write responses and text printed by the site are
+    // handled on the way, other messages are collected in payload
+    site_msg_t Call(const std::vector<site_msg_t> &request, std::vector<site_msg_t> *payload = nullptr);
+
+    // A batch request (MSG_READ_BATCH or MSG_WRITE_BATCH), Ret: whether each op has been granted
+    std::vector<bool> CallBatch(site_msg_type_t type, const std::vector<op_t> &ops);
+};
@@ -0,0 +1,281 @@
+/**
+ * Date: 2026-10-18
+ * Description: Timeline of a run in the Chrome trace-event format.
+ *  -----------------------------------------------------------------------------------------
+ *          name          |         Inputs       |                  output
+ *  -----------------------------------------------------------------------------------------
+ *  SetTick               |tick                  |
+ *  -----------------------------------------------------------------------------------------
+ *  TransBegin            |trans_id, is_ronly    |
+ *  -----------------------------------------------------------------------------------------
+ *  TransEnd              |trans_id, outcome     |
+ *  -----------------------------------------------------------------------------------------
+ *  TransEvent            |trans_id, what        |
+ *  -----------------------------------------------------------------------------------------
+ *  OpStarted             |op                    |
+ *  -----------------------------------------------------------------------------------------
+ *  OpTried               |op, done              |
+ *  -----------------------------------------------------------------------------------------
+ *  OpDropped             |op                    |
+ *  -----------------------------------------------------------------------------------------
+ *  LockWaitBegin         |site_id, trans_id,... |
+ *  -----------------------------------------------------------------------------------------
+ *  LockWaitEnd           |site_id, trans_id,... |
+ *  -----------------------------------------------------------------------------------------
+ *  Unreadable            |site_id, trans_id,... |
+ *  -----------------------------------------------------------------------------------------
+ *  SiteFail              |site_id               |
+ *  -----------------------------------------------------------------------------------------
+ *  SiteRecover           |site_id               |
+ *  -----------------------------------------------------------------------------------------
+**/
+#include "Tracer.h"
+
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+namespace {
+    const int TM_PID = 0;
+
+    std::string trans_span(transid_t trans_id) {
+        return "T" + std::to_string(trans_id);
+    }
+
+    std::string op_span(opid_t op_id) {
+        return "op" + std::to_string(op_id);
+    }
+
+    std::string site_span(siteid_t site_id, transid_t trans_id, itemid_t item_id) {
+        return "s" + std::to_string(site_id) + ".T" + std::to_string(trans_id) + ".x" + std::to_string(item_id);
+    }
+
+    std::string op_name(const op_t &op) {
+        std::string t = "T" + std::to_string(op.trans_id);
+        switch (op.op_type) {
+            case OP_READ:
+                return "R(" + t + ", x" + std::to_string(op.param.r_param.item_id) + ")";
+            case OP_RONLY:
+                return "R(" + t + ", x" + std::to_string(op.param.r_param.item_id) + ") read-only";
+            case OP_WRITE:
+                return "W(" + t + ", x" + std::to_string(op.param.w_param.item_id) + ", " +
+                       std::to_string(op.param.w_param.value) + ")";
+            case OP_INC:
+                return "INC(" + t + ", x" + std::to_string(op.param.w_param.item_id) + ", " +
+                       std::to_string(op.param.w_param.value) + ")";
+            case OP_READ_RANGE:
+                return "RR(" + t + ")";
+            case OP_WRITE_MULTI:
+                return "MW(" + t + ")";
+            case OP_SUM:
+            case OP_SCAN:
+                return std::string(op.op_type == OP_SUM ? "SUM(" : "SCAN(") + t + ", x" +
+                       std::to_string(op.param.s_param.first) + "..x" + std::to_string(op.param.s_param.last) + ")";
+        }
+        return t;
+    }
+
+    std::string outcome_arg(const char *outcome) {
+        return std::string("\"outcome\": \"") + outcome + "\"";
+    }
+}
+
+Tracer::Tracer(std::ostream &out) : _out(out) {
+    _start = std::chrono::steady_clock::now();
+    _tick = 0;
+    _first_event = true;
+
+    _out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    for (int pid = TM_PID; pid <= SITE_COUNT; ++pid) {
+        std::string name = pid == TM_PID ? "TM" : "Site " + std::to_string(pid);
+        emit('M', pid, "", "", "process_name", "\"name\": \"" + name + "\"");
+    }
+}
+
+Tracer::~Tracer() {
+    // whatever never ended, e.g. the ops that still wait when the input is over
+    std::vector<std::string> open;
+    for (const auto &p : _open) {
+        open.push_back(p.first);
+    }
+    for (const std::string &id : open) {
+        end_span(id, outcome_arg("unfinished"));
+    }
+    _out << "\n]}\n";
+    _out.flush();
+}
+
+void
+Tracer::SetTick(timestamp_t tick) {
+    _tick = tick;
+}
+
+void
+Tracer::TransBegin(transid_t trans_id, bool is_ronly) {
+    begin_span(TM_PID, "transaction", trans_span(trans_id), trans_span(trans_id) + (is_ronly ? " read-only" : ""),
+               "");
+}
+
+void
+Tracer::TransEnd(transid_t trans_id, const char *outcome) {
+    for (auto it = _unreadable.begin(); it != _unreadable.end();) {
+        auto next = std::next(it);
+        if (it->first.first == trans_id) {
+            end_unreadable(trans_id, it->first.second, outcome);
+        }
+        it = next;
+    }
+    end_span(trans_span(trans_id), outcome_arg(outcome));
+}
+
+void
+Tracer::TransEvent(transid_t trans_id, const std::string &what) {
+    emit('n', TM_PID, "transaction", trans_span(trans_id), what, "");
+}
+
+void
+Tracer::OpStarted(const op_t &op) {
+    std::string id = op_span(op.op_id);
+    if (!_open.count(id)) {
+        begin_span(TM_PID, "op", id, op_name(op), "\"trans\": " + std::to_string(op.trans_id));
+    }
+}
+
+void
+Tracer::OpTried(const op_t &op, bool done) {
+    std::string id = op_span(op.op_id);
+    std::string queued = id + ".queued";
+    if (!done) {
+        if (!_open.count(queued)) {
+            begin_span(TM_PID, "op", queued, "queued", "");
+        }
+        return;
+    }
+    end_span(queued, "");
+    end_span(id, outcome_arg("done"));
+    if (op.op_type == OP_READ) {
+        end_unreadable(op.trans_id, op.param.r_param.item_id, "op done");
+    }
+}
+
+void
+Tracer::OpDropped(const op_t &op) {
+    std::string id = op_span(op.op_id);
+    end_span(id + ".queued", "");
+    end_span(id, outcome_arg("aborted"));
+}
+
+void
+Tracer::LockWaitBegin(siteid_t site_id, transid_t trans_id, itemid_t item_id, bool exclusive) {
+    std::string id = site_span(site_id, trans_id, item_id);
+    if (_open.count(id)) {
+        return;
+    }
+    begin_span(site_id, "lock", id, std::string(exclusive ? "X" : "S") + " lock x" + std::to_string(item_id) + " T" +
+               std::to_string(trans_id), "\"trans\": " + std::to_string(trans_id));
+}
+
+void
+Tracer::LockWaitEnd(siteid_t site_id, transid_t trans_id, itemid_t item_id, const char *outcome) {
+    end_span(site_span(site_id, trans_id, item_id), outcome_arg(outcome));
+}
+
+void
+Tracer::Unreadable(siteid_t site_id, transid_t trans_id, itemid_t item_id) {
+    std::string id = site_span(site_id, trans_id, item_id) + ".unreadable";
+    if (_open.count(id)) {
+        return;
+    }
+    begin_span(site_id, "unreadable", id, "x" + std::to_string(item_id) + " not readable T" + std::to_string(trans_id),
+               "\"trans\": " + std::to_string(trans_id));
+    _unreadable[std::make_pair(trans_id, item_id)].insert(site_id);
+}
+
+void
+Tracer::SiteFail(siteid_t site_id) {
+    // the site forgets its lock queues and whoever waited there
+    std::string prefix = "s" + std::to_string(site_id) + ".";
+    std::vector<std::string> waits;
+    for (const auto &p : _open) {
+        if (p.first.compare(0, prefix.size(), prefix) == 0) {
+            waits.push_back(p.first);
+        }
+    }
+    for (const std::string &id : waits) {
+        end_span(id, outcome_arg("site failed"));
+    }
+    for (auto &p : _unreadable) {
+        p.second.erase(site_id);
+    }
+    instant(site_id, "fail", "");
+}
+
+void
+Tracer::SiteRecover(siteid_t site_id) {
+    instant(site_id, "recover", "");
+}
+
+void
+Tracer::begin_span(int pid, const std::string &cat, const std::string &id, const std::string &name,
+                   const std::string &args) {
+    span_t span;
+    span.pid = pid;
+    span.cat = cat;
+    span.name = name;
+    _open[id] = span;
+    emit('b', pid, cat, id, name, args);
+}
+
+void
+Tracer::end_span(const std::string &id, const std::string &args) {
+    auto it = _open.find(id);
+    if (it == _open.end()) {
+        return;
+    }
+    span_t span = it->second;
+    _open.erase(it);
+    emit('e', span.pid, span.cat, id, span.name, args);
+}
+
+void
+Tracer::instant(int pid, const std::string &name, const std::string &args) {
+    emit('i', pid, "site", "", name, args);
+}
+
+void
+Tracer::emit(char ph, int pid, const std::string &cat, const std::string &id, const std::string &name,
+             const std::string &args) {
+    double ts = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _start).count();
+    char ts_buffer[32];
+    std::snprintf(ts_buffer, sizeof(ts_buffer), "%.3f", ts);
+
+    _out << (_first_event ? "" : ",\n") << "{\"name\": \"" << name << "\", \"ph\": \"" << ph << "\", \"pid\": " << pid
+         << ", \"tid\": 0, \"ts\": " << ts_buffer;
+    _first_event = false;
+    if (!cat.empty()) {
+        _out << ", \"cat\": \"" << cat << "\"";
+    }
+    if (!id.empty()) {
+        _out << ", \"id\": \"" << id << "\"";
+    }
+    if (ph == 'i') {
+        _out << ", \"s\": \"p\"";
+    }
+    _out << ", \"args\": {";
+    if (ph != 'M') {
+        _out << "\"tick\": " << _tick << (args.empty() ? "" : ", ");
+    }
+    _out << args << "}}";
+}
+
+void
+Tracer::end_unreadable(transid_t trans_id, itemid_t item_id, const char *outcome) {
+    auto it = _unreadable.find(std::make_pair(trans_id, item_id));
+    if (it == _unreadable.end()) {
+        return;
+    }
+    for (siteid_t site_id : it->second) {
+        end_span(site_span(site_id, trans_id, item_id) + ".unreadable", outcome_arg(outcome));
+    }
+    _unreadable.erase(it);
+}
@@ -0,0 +1,87 @@
+/**
+ * Date: 2026-10-18
+ * Description: Timeline of a run in the Chrome trace-event format (chrome://tracing, Perfetto). Transactions, ops and
+ * the lock waits and unreadable replicas they run into are spans, deadlock victims and site failures are instants.
+ * The TM is process 0 of the trace and site i is process i. The TM and the sites hold a Tracer pointer that is null
+ * unless tracing, so every hook costs one branch when it is off.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include<chrono>
+#include<map>
+#include<ostream>
+#include<set>
+#include<string>
+#include<utility>
+
+class Tracer {
+public:
+    // The events are written to out as they happen
+    Tracer(std::ostream &out);
+
+    // Closes the spans still open and finishes the JSON
+    ~Tracer();
+
+    // The tick of the TM, recorded with every event
+    void SetTick(timestamp_t tick);
+
+    //------------------------ TM ---------------------------------
+    void TransBegin(transid_t trans_id, bool is_ronly);
+
+    void TransEnd(transid_t trans_id, const char *outcome);
+
+    // Something that happened to the transaction, e.g. it was picked as a deadlock victim
+    void TransEvent(transid_t trans_id, const std::string &what);
+
+    // An op is about to be tried, it starts at its first try
+    void OpStarted(const op_t &op);
+
+    // An op was tried: it waits in the queue from its first failed try, and ends once done
+    void OpTried(const op_t &op, bool done);
+
+    // An op left the queue without running, its transaction aborted
+    void OpDropped(const op_t &op);
+
+    //------------------------ sites ------------------------------
+    void LockWaitBegin(siteid_t site_id, transid_t trans_id, itemid_t item_id, bool exclusive);
+
+    void LockWaitEnd(siteid_t site_id, transid_t trans_id, itemid_t item_id, const char *outcome);
+
+    // A read found the replica unreadable, until the op is done somewhere
+    void Unreadable(siteid_t site_id, transid_t trans_id, itemid_t item_id);
+
+    void SiteFail(siteid_t site_id);
+
+    void SiteRecover(siteid_t site_id);
+
+private:
+    std::ostream &_out;
+    std::chrono::steady_clock::time_point _start;
+    timestamp_t _tick;
+    bool _first_event;
+
+    // the spans not closed yet by id, with the process, category and name they began with
+    struct span_t {
+        int pid;
+        std::string cat;
+        std::string name;
+    };
+    std::map<std::string, span_t> _open;
+
+    // the unreadable spans of each (transaction, item), closed once a read of it is done
+    std::map<std::pair<transid_t, itemid_t>, std::set<siteid_t>> _unreadable;
+
+    void begin_span(int pid, const std::string &cat, const std::string &id, const std::string &name,
+                    const std::string &args);
+
+    void end_span(const std::string &id, const std::string &args);
+
+    void instant(int pid, const std::string &name, const std::string &args);
+
+    void emit(char ph, int pid, const std::string &cat, const std::string &id, const std::string &name,
+              const std::string &args);
+
+    void end_unreadable(transid_t trans_id, itemid_t item_id, const char *outcome);
+};
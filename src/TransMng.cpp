@@ -5,59 +5,179 @@
  *  -----------------------------------------------------------------------------------------
  *          name          |         Inputs       |                  output
  *  -----------------------------------------------------------------------------------------
+ *  AttachSite            |site_id, site         |
+ *  -----------------------------------------------------------------------------------------
  *  Simulate              |inputs                |
  *  -----------------------------------------------------------------------------------------
+ *  StartTick             |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  RunTick               |line                  |
+ *  -----------------------------------------------------------------------------------------
+ *  SimulateFree          |inputs                |
+ *  -----------------------------------------------------------------------------------------
+ *  RunEvent              |command, more_writes  |
+ *  -----------------------------------------------------------------------------------------
+ *  TryExecuteFresh       |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  Disconnect            |trans_id              |
+ *  -----------------------------------------------------------------------------------------
+ *  SetTracer             |tracer                |
+ *  -----------------------------------------------------------------------------------------
+ *  SetTransStats         |enabled               |
+ *  -----------------------------------------------------------------------------------------
+ *  TransReports          |                      |the reports of the ended transactions
+ *  -----------------------------------------------------------------------------------------
+ *  PrintTransSummary     |out                   |
+ *  -----------------------------------------------------------------------------------------
+ *  WriteTransCsv         |out                   |
+ *  -----------------------------------------------------------------------------------------
+ *  SetSnapshotCache      |enabled               |
+ *  -----------------------------------------------------------------------------------------
+ *  SnapshotHits          |                      |the read-only reads served by the snapshot cache
+ *  -----------------------------------------------------------------------------------------
+ *  SnapshotMisses        |                      |the read-only reads that asked a site
+ *  -----------------------------------------------------------------------------------------
+ *  SetDumpExport         |path, format          |
+ *  -----------------------------------------------------------------------------------------
  *  ReceiveReadResponse   |site_id, value        |
  *  -----------------------------------------------------------------------------------------
  *  ReceiveWriteResponse  |site_id               |
  *  -----------------------------------------------------------------------------------------
+ *  ReceiveLockGrant      |trans_id, site_id     |
+ *  -----------------------------------------------------------------------------------------
+ *  ReceiveLockWait       |trans_id, site_id     |
+ *  -----------------------------------------------------------------------------------------
+ *  BeginTx               |trans_id, is_ronly    |
+ *  -----------------------------------------------------------------------------------------
+ *  ReadTx                |trans_id, item_id, done|
+ *  -----------------------------------------------------------------------------------------
+ *  WriteTx               |trans_id, item_id,... |
+ *  -----------------------------------------------------------------------------------------
+ *  EndTx                 |trans_id, done        |
+ *  -----------------------------------------------------------------------------------------
+ *  Pump                  |                      |false if nothing happened, true otherwise
+ *  -----------------------------------------------------------------------------------------
  *  DetectDeadLock        |                      |true if there is deadlock, false otherwise
  *  -----------------------------------------------------------------------------------------
+ *  abort_victim          |trans_id              |
+ *  -----------------------------------------------------------------------------------------
+ *  SetCoordinator        |coordinator, partition|
+ *  -----------------------------------------------------------------------------------------
+ *  AbortDeadlockVictim   |trans_id              |true if aborted, false otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  OnCycle               |graph                 |the transactions on a cycle
+ *  -----------------------------------------------------------------------------------------
  *  TryExecuteQueue       |                      |
  *  -----------------------------------------------------------------------------------------
+ *  rank_of               |trans_id              |the rank of the transaction under the policy
+ *  -----------------------------------------------------------------------------------------
+ *  sync_ranks            |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  note_op_done          |op, priority          |
+ *  -----------------------------------------------------------------------------------------
+ *  note_try              |op                    |
+ *  -----------------------------------------------------------------------------------------
+ *  note_tried            |op, done              |
+ *  -----------------------------------------------------------------------------------------
+ *  charge_wait           |report, blocked       |
+ *  -----------------------------------------------------------------------------------------
+ *  settle_blocked        |live                  |
+ *  -----------------------------------------------------------------------------------------
+ *  close_report          |trans_id, committed   |
+ *  -----------------------------------------------------------------------------------------
+ *  RunAdmission          |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  adapt_cap             |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  release_slot          |trans                 |
+ *  -----------------------------------------------------------------------------------------
+ *  release_snapshot      |start_ts              |
+ *  -----------------------------------------------------------------------------------------
+ *  run_tx                |op, done              |
+ *  -----------------------------------------------------------------------------------------
+ *  wake                  |trans_id              |
+ *  -----------------------------------------------------------------------------------------
+ *  wake_all              |reads_only            |
+ *  -----------------------------------------------------------------------------------------
  *  ExecuteCommand        |line                  |
  *  -----------------------------------------------------------------------------------------
- *  Begin                 |trans_id, is_ronly    |
+ *  Begin                 |trans_id, is_ronly,...|
  *  -----------------------------------------------------------------------------------------
  *  Finish                |trans_id              |
  *  -----------------------------------------------------------------------------------------
- *  Abort                 |trans_id              |
+ *  FlushCommits          |                      |
+ *  -----------------------------------------------------------------------------------------
+ *  Abort                 |trans_id, reason      |
  *  -----------------------------------------------------------------------------------------
  *  Read                  |op                    |true if it can be readed, false otherwise
  *  -----------------------------------------------------------------------------------------
+ *  ReadCached            |op                    |true if answered from the cache, false otherwise
+ *  -----------------------------------------------------------------------------------------
  *  Ronly                 |op                    |true if it can be readed, false otherwise
  *  -----------------------------------------------------------------------------------------
  *  Write                 |op                    |true if it can be written, false otherwise
  *  -----------------------------------------------------------------------------------------
+ *  Increment             |op                    |true if every replica applied it, false otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  WriteBatch            |ops                   |Write result of each op
+ *  -----------------------------------------------------------------------------------------
+ *  BroadcastWrites       |ops                   |true for each op granted by all the replicas
+ *  -----------------------------------------------------------------------------------------
+ *  AckWrite              |op                    |
+ *  -----------------------------------------------------------------------------------------
+ *  ReadRange             |op                    |true once all the items are read, false otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  WriteMulti            |op                    |true once all the items are written, false otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  Scan                  |op                    |true once all the items are served, false otherwise
+ *  -----------------------------------------------------------------------------------------
+ *  QueueMulti            |op, items             |
+ *  -----------------------------------------------------------------------------------------
 **/
 
 #include<cstddef>
+#include<cstdint>
 #include<cstdio>
 #include<cstdlib>
+#include<algorithm>
+#include<deque>
+#include<iterator>
+#include<thread>
 #include<vector>
 #include<string>
+#include<iomanip>
 #include<iostream>
 
 #include"TransMng.h"
-#include"DataMng.h"
-
-// The +1 will deal with the annoying 1-index
-extern DataMng *DM[SITE_COUNT + 1];
+#include"DataSite.h"
 
 // helper functions
 namespace {
 
+    // admission control: the cap to start from, the ticks between two adjustments of it, and the commits per
+    // deadlock abort below which the cap is cut
+    const int ADMISSION_INITIAL_CAP = 16;
+    const int ADMISSION_MAX_CAP = 1024;
+    const timestamp_t ADMISSION_WINDOW = 32;
+    const long ADMISSION_ABORT_DIV = 2;
+
+    // the parts of a dump export are copied into it in chunks of this size
+    const size_t EXPORT_COPY_CHUNK = 64 * 1024;
+
+    // thrown by the parsers, the tick decides whether an invalid command is fatal
+    struct command_error_t {
+    };
+
     void print_command_error() {
-        std::cout << "ERROR: Invalid Command\n";
-        std::exit(-1);
+        throw command_error_t();
     }
 
-    void print_abort(transid_t trans_id) {
-        std::cout << "Transaction T" << trans_id << " already aborted, ignore this command\n";
+    void print_abort(std::ostream &out, transid_t trans_id) {
+        out << "Transaction T" << trans_id << " already aborted, ignore this command\n";
     }
 
-    void err_inconsist() {
-        std::cout << "ERROR: Internal state inconsist\n";
+    void err_inconsist(std::ostream &out) {
+        out << "ERROR: Internal state inconsist\n";
     };
 
     transid_t parse_trans_id(std::string s) {
@@ -111,6 +231,100 @@ namespace {
         }
     }
 
+    // [xi=v, xj=v, ...] of MW, split by parse_line into "[xi=v", "xj=v", ..., "xk=v]"
+    std::vector<std::pair<itemid_t, int>> parse_assignments(const std::vector<std::string> &parsed, size_t first) {
+        std::vector<std::pair<itemid_t, int>> assignments;
+        for (size_t i = first; i < parsed.size(); ++i) {
+            std::string assignment = parsed[i];
+            if (i == first) {
+                if (assignment.empty() || assignment[0] != '[') {
+                    print_command_error();
+                }
+                assignment = assignment.substr(1);
+            }
+            if (i + 1 == parsed.size()) {
+                if (assignment.empty() || assignment.back() != ']') {
+                    print_command_error();
+                }
+                assignment.pop_back();
+            }
+            size_t eq = assignment.find('=');
+            if (eq == std::string::npos) {
+                print_command_error();
+            }
+            assignments.push_back(std::make_pair(parse_item_id(assignment.substr(0, eq)),
+                                                 parse_value(assignment.substr(eq + 1))));
+        }
+
+        // an item may only be written once
+        std::vector<std::pair<itemid_t, int>> sorted = assignments;
+        std::sort(sorted.begin(), sorted.end());
+        for (size_t i = 1; i < sorted.size(); ++i) {
+            if (sorted[i].first == sorted[i - 1].first) {
+                print_command_error();
+            }
+        }
+        return assignments;
+    }
+
+    // The sites of an item in ascending order, computed rather than stored: every site for an even item,
+    // site 1 + i % 10 for an odd item i
+    struct site_range_t {
+        struct iterator {
+            siteid_t site_id;
+
+            siteid_t operator*() const {
+                return site_id;
+            }
+
+            iterator &operator++() {
+                ++site_id;
+                return *this;
+            }
+
+            bool operator!=(const iterator &other) const {
+                return site_id != other.site_id;
+            }
+        };
+
+        siteid_t first;
+        siteid_t last;
+
+        iterator begin() const {
+            return iterator{first};
+        }
+
+        iterator end() const {
+            return iterator{static_cast<siteid_t>(last + 1)};
+        }
+    };
+
+    site_range_t item_sites(itemid_t item_id) {
+        if (item_id % 2 == 0) {
+            return site_range_t{1, SITE_COUNT};
+        }
+        siteid_t site_id = 1 + item_id % 10;
+        return site_range_t{site_id, site_id};
+    }
+
+    bool hosts(siteid_t site_id, itemid_t item_id) {
+        return item_id % 2 == 0 || 1 + item_id % 10 == site_id;
+    }
+
+    // the site holds one of the unreplicated items in [first, last] (x_i lives on site 1 + i % 10 for odd i)
+    bool holds_unreplicated(siteid_t site_id, itemid_t first, itemid_t last) {
+        itemid_t item_id = first + ((site_id - 1 - first % 10) % 10 + 10) % 10;
+        return item_id <= last && item_id % 2 == 1;
+    }
+
+    bool is_multi(const op_t &op) {
+        return op.op_type == OP_READ_RANGE || op.op_type == OP_WRITE_MULTI;
+    }
+
+    itemid_t op_item(const op_t &op) {
+        return op.op_type == OP_WRITE || op.op_type == OP_INC ? op.param.w_param.item_id : op.param.r_param.item_id;
+    }
+
     // this helper function will split multi commands and remove the spaces and comments
     std::vector<std::string> split_multi_command(std::string line) {
         std::vector<std::string> res;
@@ -135,6 +349,14 @@ namespace {
         return res;
     }
 
+    // the transaction of a write command, empty for any other command
+    std::string write_trans(const std::string &command) {
+        if (command.compare(0, 2, "W(") != 0) {
+            return "";
+        }
+        return command.substr(2, command.find(',') - 2);
+    }
+
     // seperate the input string with '(', ',' or ')'
     std::vector<std::string> parse_line(std::string line) {
         std::vector<std::string> parsed;
@@ -154,54 +376,227 @@ namespace {
 }
 
 
-TransMng::TransMng() {
+TransMng::TransMng(std::ostream &out) : _out(out), _queued_ops(pool_allocator<op_t>(&_node_pool)) {
     _now = 0;
     _next_opid = 0;
+    _batch_writes = true;
+    _read_cache = true;
+    _cache_hits = 0;
+    _collecting = nullptr;
+    _snapshot_cache = true;
+    _snapshot_hits = 0;
+    _snapshot_misses = 0;
+    _ronly_value = 0;
+    _dump_format = DUMP_CSV;
+    _dump_started = false;
+    _tick_banner = true;
+    _strict_commands = true;
+    _invalid_commands = 0;
+    _router = nullptr;
+    _tracer = nullptr;
+    _coordinator = nullptr;
+    _partition = 0;
+    _idle_round = false;
+    _free_running = false;
+    _deadlock_interval = 0;
+    _deadlock_threshold = 16;
+    _last_detection = 0;
+    _wait_since = -1;
+    _queue_dirty = false;
+    _fresh_ops = 0;
+    _sched_policy = POLICY_FIFO;
+    _wait_stats = false;
+    _trans_stats = false;
+    _try_lock_sites = 0;
+    _admission = false;
+    _admitted_rw = 0;
+    _admission_stats.cap = ADMISSION_INITIAL_CAP;
+    _window_start = 0;
+    _window_saturated = false;
+    _in_tx_op = false;
+    _tx_value = 0;
 
     // assume that all the sites are up at beginning
+    _sites[0] = nullptr;
     for (int i = 1; i <= SITE_COUNT; ++i) {
         _site_status[i] = true;
+        _site_recovered[i] = false;
+        _sites[i] = nullptr;
     }
+}
 
-    // initialize item-site mappings
-    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
-        for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
-            if ((item_id % 2 == 0) || (1 + (item_id % 10) == site_id)) {
-                _item_sites[item_id].push_back(site_id);
-            }
-        }
-    }
+void
+TransMng::AttachSite(siteid_t site_id, DataSite *site) {
+    _sites[site_id] = site;
 }
 
 // ------------------- Main Loop -----------------------------
 
 void
 TransMng::Simulate(std::istream &inputs) {
+    if (_free_running) {
+        SimulateFree(inputs);
+        return;
+    }
+
     std::string line_buffer;
     while (true) {
-        std::cout << "------------------- Time Tick: " << _now
-                  << " -------------------------" << std::endl;
-        // 1. At the beginning of each timestamp, detect deadlock
-        while (DetectDeadLock()) {
-            // 2. If we have aborted something, maybe we can execute some commands
-            TryExecuteQueue();
-        }
+        StartTick();
 
         if (!std::getline(inputs, line_buffer)) {
             break;
         }
 
-        // 3. Split the commands read in
-        std::vector<std::string> commands = split_multi_command(line_buffer);
-        for (std::string command : commands) {
-            ExecuteCommand(command);
+        RunTick(line_buffer);
+    }
+}
+
+void
+TransMng::StartTick() {
+    if (_tracer != nullptr) {
+        _tracer->SetTick(_now);
+    }
+    if (_tick_banner) {
+        _out << "------------------- Time Tick: " << _now
+                  << " -------------------------" << std::endl;
+    }
+    // 1. At the beginning of each timestamp, detect deadlock
+    while (DetectDeadLock()) {
+        // 2. If we have aborted something, maybe we can execute some commands
+        TryExecuteQueue();
+    }
+}
+
+void
+TransMng::RunTick(const std::string &line) {
+    // 3. Split the commands read in
+    std::vector<std::string> commands = split_multi_command(line);
+    for (std::string command : commands) {
+        RunCommand(command);
+    }
+
+    // 4. Apply the commits of this tick as one group
+    FlushCommits();
+
+    // 5. Try to execute what's left in the queue
+    TryExecuteQueue();
+
+    // 6. Let the transactions waiting for a slot in
+    if (_admission) {
+        RunAdmission();
+    }
+
+    _now++;
+}
+
+void
+TransMng::RunCommand(const std::string &command) {
+    try {
+        ExecuteCommand(command);
+    }
+    catch (const command_error_t &) {
+        if (_strict_commands) {
+            std::cout << "ERROR: Invalid Command\n";
+            std::exit(-1);
+        }
+        _invalid_commands++;
+        _out << "ERROR: Invalid Command " << command << "\n";
+    }
+}
+
+// ------------------- Free Running -----------------------------
+
+void
+TransMng::SimulateFree(std::istream &inputs) {
+    // look one command ahead, so that consecutive writes of a transaction are sent as one batch
+    std::deque<std::string> commands;
+    std::string line_buffer;
+    while (true) {
+        while (commands.size() < 2 && std::getline(inputs, line_buffer)) {
+            for (std::string command : split_multi_command(line_buffer)) {
+                commands.push_back(command);
+            }
+        }
+        if (commands.empty()) {
+            break;
         }
+        std::string command = commands.front();
+        commands.pop_front();
+        std::string writer = write_trans(command);
+        RunEvent(command, !writer.empty() && !commands.empty() && write_trans(commands.front()) == writer);
+    }
 
-        // 4. Try to execute what's left in the queue
+    // the stream is over, whatever still waits is either deadlocked or waits for a site forever
+    TryExecuteQueue();
+    while (DetectDeadLock()) {
         TryExecuteQueue();
+    }
+}
+
+void
+TransMng::RunEvent(const std::string &command, bool more_writes) {
+    size_t queued_before = _queued_ops.size();
+    RunCommand(command);
+    _now++;
+    if (_tracer != nullptr) {
+        _tracer->SetTick(_now);
+    }
+
+    // commit right away, the released locks may let queued ops go
+    FlushCommits();
+
+    if (_queue_dirty) {
+        // something was released or came back up, retry everything
+        _queue_dirty = false;
+        _fresh_ops = 0;
+        TryExecuteQueue();
+    } else if (_queued_ops.size() > queued_before) {
+        _fresh_ops += _queued_ops.size() - queued_before;
+        if (!more_writes) {
+            TryExecuteFresh();
+        }
+    }
+
+    if (_queued_ops.empty()) {
+        _wait_since = -1;
+        return;
+    }
+    if (_wait_since < 0) {
+        _wait_since = _now;
+    }
+
+    bool due = (_deadlock_interval > 0 && _now - _last_detection >= _deadlock_interval) ||
+               (_deadlock_threshold > 0 && _now - _wait_since >= _deadlock_threshold);
+    if (due) {
+        _last_detection = _now;
+        while (DetectDeadLock()) {
+            TryExecuteQueue();
+        }
+        _queue_dirty = false;
+        _fresh_ops = 0;
+        _wait_since = _queued_ops.empty() ? -1 : _now;
+    }
+
+    if (_admission) {
+        RunAdmission();
+    }
+}
 
-        _now++;
+void
+TransMng::TryExecuteFresh() {
+    // the fresh ops at the tail all belong to one transaction. If an older op of it still waits, wait behind it
+    size_t fresh = _fresh_ops;
+    _fresh_ops = 0;
+    if (_trans_table[_queued_ops.back().trans_id].queued_ops != static_cast<int>(fresh)) {
+        return;
     }
+
+    // run the queue over the fresh ops only, then put back whatever has to wait
+    pool_list<op_t> older(_queued_ops.get_allocator());
+    older.splice(older.end(), _queued_ops, _queued_ops.begin(), std::prev(_queued_ops.end(), fresh));
+    TryExecuteQueue();
+    older.splice(older.end(), _queued_ops);
+    _queued_ops.swap(older);
 }
 
 void
@@ -213,20 +608,53 @@ TransMng::ExecuteCommand(std::string line) {
     }
 
     auto command_type = parsed_line[0];
+
+    // Only begin/end and queueing reads and writes of live transactions may be batched behind
+    // pending commits. Everything else observes the sites or prints, so apply the group first
+    bool batchable = (command_type == "begin" || command_type == "beginRO" || command_type == "beginP" ||
+                      command_type == "end");
+    if ((command_type == "W" || command_type == "INC" || command_type == "R" || command_type == "RR" || command_type == "MW" ||
+         command_type == "SUM" || command_type == "SCAN") && parsed_line.size() > 1) {
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        batchable = _trans_table.count(trans_id) && !_trans_table[trans_id].will_abort;
+    }
+    if (!batchable) {
+        FlushCommits();
+    }
+
     if (command_type == "begin") {
         // begin(Tn)
+        if (parsed_line.size() < 2) {
+            print_command_error();
+        }
         transid_t trans_id = parse_trans_id(parsed_line[1]);
-        Begin(trans_id, false);
+        Begin(trans_id, false, 0);
     } else if (command_type == "beginRO") {
         // beginRO(Tn)
+        if (parsed_line.size() < 2) {
+            print_command_error();
+        }
         transid_t trans_id = parse_trans_id(parsed_line[1]);
-        Begin(trans_id, true);
+        Begin(trans_id, true, 0);
+    } else if (command_type == "beginP") {
+        // beginP(Tn, prio)
+        if (parsed_line.size() < 3) {
+            print_command_error();
+        }
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        Begin(trans_id, false, parse_value(parsed_line[2]));
     } else if (command_type == "end") {
         // end(Tn)
+        if (parsed_line.size() < 2) {
+            print_command_error();
+        }
         transid_t trans_id = parse_trans_id(parsed_line[1]);
         Finish(trans_id);
     } else if (command_type == "W") {
         // W(Tn, xn, v)
+        if (parsed_line.size() < 4) {
+            print_command_error();
+        }
         transid_t trans_id = parse_trans_id(parsed_line[1]);
         itemid_t item_id = parse_item_id(parsed_line[2]);
         int value = parse_value(parsed_line[3]);
@@ -238,7 +666,7 @@ TransMng::ExecuteCommand(std::string line) {
 
         // 2. this site will abort, do nothing but report it
         if (_trans_table[trans_id].will_abort) {
-            print_abort(trans_id);
+            print_abort(OutFor(trans_id), trans_id);
             return;
         }
 
@@ -253,8 +681,39 @@ TransMng::ExecuteCommand(std::string line) {
 
         // 5. put it into our execution queue
         _queued_ops.push_back(write_op);
+        _trans_table[trans_id].queued_ops++;
+    } else if (command_type == "INC") {
+        // INC(Tn, xn, delta)
+        if (parsed_line.size() != 4) {
+            print_command_error();
+        }
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        itemid_t item_id = parse_item_id(parsed_line[2]);
+        int delta = parse_value(parsed_line[3]);
+        // 1. if this transaction is invalid, report error. A read-only transaction does not update
+        if (!_trans_table.count(trans_id) || _trans_table[trans_id].is_ronly) {
+            print_command_error();
+            return;
+        }
+
+        // 2. this site will abort, do nothing but report it
+        if (_trans_table[trans_id].will_abort) {
+            print_abort(OutFor(trans_id), trans_id);
+            return;
+        }
+
+        // 3. put it into our execution queue
+        op_param_t inc_param;
+        inc_param.w_param.item_id = item_id;
+        inc_param.w_param.value = delta;
+        _queued_ops.push_back(op_t(_next_opid, trans_id, OP_INC, inc_param));
+        _next_opid++;
+        _trans_table[trans_id].queued_ops++;
     } else if (command_type == "R") {
         // R(Tn, xn)
+        if (parsed_line.size() < 3) {
+            print_command_error();
+        }
         transid_t trans_id = parse_trans_id(parsed_line[1]);
         itemid_t item_id = parse_item_id(parsed_line[2]);
         // 1. if this transaction is invalid, report error
@@ -265,7 +724,7 @@ TransMng::ExecuteCommand(std::string line) {
 
         // 2. this site will abort, do nothing but report it
         if (_trans_table[trans_id].will_abort) {
-            print_abort(trans_id);
+            print_abort(OutFor(trans_id), trans_id);
             return;
         }
 
@@ -280,17 +739,129 @@ TransMng::ExecuteCommand(std::string line) {
 
             // 5. put it into our execution queue
             _queued_ops.push_back(read_op);
+            _trans_table[trans_id].queued_ops++;
         } else {
             op_t read_op(_next_opid, trans_id, OP_READ, read_param);
             _next_opid++;
 
             // 5. put it into our execution queue
             _queued_ops.push_back(read_op);
+            _trans_table[trans_id].queued_ops++;
+        }
+    } else if (command_type == "RR") {
+        // RR(Tn, xlo, xhi)
+        if (parsed_line.size() != 4) {
+            print_command_error();
+        }
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        itemid_t first = parse_item_id(parsed_line[2]);
+        itemid_t last = parse_item_id(parsed_line[3]);
+        // 1. if this transaction or the range is invalid, report error
+        if (!_trans_table.count(trans_id) || first > last) {
+            print_command_error();
+            return;
+        }
+
+        // 2. this site will abort, do nothing but report it
+        if (_trans_table[trans_id].will_abort) {
+            print_abort(OutFor(trans_id), trans_id);
+            return;
+        }
+
+        // 3. read-only transactions read snapshots without locks, every item is an ordinary read
+        if (_trans_table[trans_id].is_ronly) {
+            for (itemid_t item_id = first; item_id <= last; ++item_id) {
+                op_param_t read_param;
+                read_param.r_param.item_id = item_id;
+                _queued_ops.push_back(op_t(_next_opid, trans_id, OP_RONLY, read_param));
+                _next_opid++;
+                _trans_table[trans_id].queued_ops++;
+            }
+            return;
+        }
+
+        // 4. one op for the whole range
+        op_param_t range_param;
+        range_param.r_param.item_id = first;
+        op_t range_op(_next_opid, trans_id, OP_READ_RANGE, range_param);
+        _next_opid++;
+
+        std::vector<op_t> items;
+        for (itemid_t item_id = first; item_id <= last; ++item_id) {
+            op_param_t read_param;
+            read_param.r_param.item_id = item_id;
+            items.push_back(op_t(range_op.op_id, trans_id, OP_READ, read_param));
+        }
+        QueueMulti(range_op, items);
+    } else if (command_type == "MW") {
+        // MW(Tn, [xi=v, xj=v, ...])
+        if (parsed_line.size() < 3) {
+            print_command_error();
+        }
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        auto assignments = parse_assignments(parsed_line, 2);
+        // 1. if this transaction is invalid, report error
+        if (!_trans_table.count(trans_id)) {
+            print_command_error();
+            return;
+        }
+
+        // 2. this site will abort, do nothing but report it
+        if (_trans_table[trans_id].will_abort) {
+            print_abort(OutFor(trans_id), trans_id);
+            return;
+        }
+
+        // 3. one op for all the items
+        op_param_t multi_param;
+        multi_param.w_param.item_id = assignments.front().first;
+        multi_param.w_param.value = assignments.front().second;
+        op_t multi_op(_next_opid, trans_id, OP_WRITE_MULTI, multi_param);
+        _next_opid++;
+
+        std::vector<op_t> items;
+        for (const auto &assignment : assignments) {
+            op_param_t write_param;
+            write_param.w_param.item_id = assignment.first;
+            write_param.w_param.value = assignment.second;
+            items.push_back(op_t(multi_op.op_id, trans_id, OP_WRITE, write_param));
+        }
+        QueueMulti(multi_op, items);
+    } else if (command_type == "SUM" || command_type == "SCAN") {
+        // SUM(Tn), SUM(Tn, xlo, xhi), SCAN(Tn), SCAN(Tn, xlo, xhi)
+        if (parsed_line.size() != 2 && parsed_line.size() != 4) {
+            print_command_error();
+        }
+        transid_t trans_id = parse_trans_id(parsed_line[1]);
+        op_param_t scan_param;
+        scan_param.s_param.first = 1;
+        scan_param.s_param.last = ITEM_COUNT;
+        if (parsed_line.size() == 4) {
+            scan_param.s_param.first = parse_item_id(parsed_line[2]);
+            scan_param.s_param.last = parse_item_id(parsed_line[3]);
         }
+        // 1. only read-only transactions scan, at their snapshot
+        if (!_trans_table.count(trans_id) || !_trans_table[trans_id].is_ronly ||
+            scan_param.s_param.first > scan_param.s_param.last) {
+            print_command_error();
+            return;
+        }
+
+        // 2. put it into our execution queue
+        op_t scan_op(_next_opid, trans_id, command_type == "SUM" ? OP_SUM : OP_SCAN, scan_param);
+        _next_opid++;
+        _queued_ops.push_back(scan_op);
+        _trans_table[trans_id].queued_ops++;
     } else if (command_type == "fail") {
+        if (parsed_line.size() < 2) {
+            print_command_error();
+        }
         siteid_t site_id = parse_site_id(parsed_line[1]);
         Fail(site_id);
     } else if (command_type == "recover") {
+        if (parsed_line.size() < 2) {
+            print_command_error();
+        }
         siteid_t site_id = parse_site_id(parsed_line[1]);
         Recover(site_id);
     } else if (command_type == "dump") {
@@ -316,167 +887,1158 @@ TransMng::ExecuteCommand(std::string line) {
 }
 
 
-// -------------------- Tester Cause Events -----------------------
+// ------------------- Embedded Transactions -----------------------------
 
 void
-TransMng::Fail(siteid_t site_id) {
-    if (_site_status[site_id]) {
-        // fail the DM
-        DM[site_id]->Fail(_now);
-        _site_status[site_id] = false;
-
-        // Abort the 2pc transactions that accessed this site so far
+TransMng::BeginTx(transid_t trans_id, bool is_ronly) {
+    if (_trans_table.count(trans_id)) {
+        std::cout << "ERROR: Transaction T" << trans_id << " already began\n";
+        std::exit(-1);
+    }
+    Begin(trans_id, is_ronly, 0);
+}
+
+void
+TransMng::ReadTx(transid_t trans_id, itemid_t item_id, tx_done_t done) {
+    op_param_t param;
+    param.r_param.item_id = item_id;
+    bool is_ronly = _trans_table.count(trans_id) && _trans_table[trans_id].is_ronly;
+    run_tx(op_t(_next_opid++, trans_id, is_ronly ? OP_RONLY : OP_READ, param), done);
+}
+
+void
+TransMng::WriteTx(transid_t trans_id, itemid_t item_id, int value, tx_done_t done) {
+    op_param_t param;
+    param.w_param.item_id = item_id;
+    param.w_param.value = value;
+    run_tx(op_t(_next_opid++, trans_id, OP_WRITE, param), done);
+}
+
+void
+TransMng::EndTx(transid_t trans_id, tx_done_t done) {
+    if (!_trans_table.count(trans_id) || _parked.count(trans_id)) {
+        std::cout << "ERROR: Transaction T" << trans_id << " is not active or still has an op running\n";
+        std::exit(-1);
+    }
+    bool commits = !_trans_table[trans_id].will_abort;
+    Finish(trans_id);
+    if (commits) {
+        _commit_waiters.push_back(std::make_pair(trans_id, done));
+    } else {
+        done(false, 0);
+    }
+}
+
+bool
+TransMng::Pump() {
+    auto start_round = [this](timestamp_t tick) {
+        _now = tick;
+        if (_tracer != nullptr) {
+            _tracer->SetTick(_now);
+        }
+        FlushCommits();
+    };
+    // sharing the sites, the tick comes from the coordinator and the commits go in under its lock
+    if (_coordinator != nullptr) {
+        _coordinator->NextTick(start_round);
+    } else {
+        start_round(_now + 1);
+    }
+    if (_admission) {
+        RunAdmission();
+    }
+
+    std::vector<std::pair<transid_t, tx_done_t>> committed;
+    committed.swap(_committed);
+    // when everyone waits (for a deadlock or for a site), or every so many rounds. The victim and whoever gets its
+    // locks wake up
+    bool idle = committed.empty() && _woken.empty();
+    // sharing the sites, our transactions may only wait for the other TMs: idle twice in a row first
+    if (_coordinator != nullptr) {
+        bool was_idle = _idle_round;
+        _idle_round = idle;
+        idle = idle && was_idle;
+    }
+    bool due = _deadlock_interval > 0 && _now - _last_detection >= _deadlock_interval;
+    if (!_parked.empty() && (idle || due)) {
+        _last_detection = _now;
+        while (DetectDeadLock()) {
+            TryExecuteQueue();
+        }
+    }
+    std::vector<transid_t> woken;
+    woken.swap(_woken);
+    if (committed.empty() && woken.empty()) {
+        return false;
+    }
+
+    // what they do next may end up in the next round, never in this one
+    for (auto &p : committed) {
+        p.second(true, 0);
+    }
+    for (transid_t trans_id : woken) {
+        auto it = _parked.find(trans_id);
+        if (it == _parked.end()) {
+            continue;
+        }
+        parked_op_t parked = it->second;
+        _parked.erase(it);
+        run_tx(parked.op, parked.done);
+    }
+    return true;
+}
+
+const tx_stats_t &
+TransMng::TxStats() const {
+    return _tx_stats;
+}
+
+void
+TransMng::ReceiveLockGrant(transid_t trans_id, siteid_t /*site_id*/) {
+    wake(trans_id);
+}
+
+void
+TransMng::ReceiveLockWait(transid_t /*trans_id*/, siteid_t site_id) {
+    if (_trans_stats) {
+        _try_lock_sites |= 1u << site_id;
+    }
+}
+
+void
+TransMng::run_tx(op_t op, tx_done_t done) {
+    auto it = _trans_table.find(op.trans_id);
+    if (it == _trans_table.end() || _parked.count(op.trans_id)) {
+        std::cout << "ERROR: Transaction T" << op.trans_id << " is not active or still has an op running\n";
+        std::exit(-1);
+    }
+    trans_table_item &trans = it->second;
+    if (trans.will_abort) {
+        if (_tracer != nullptr) {
+            _tracer->OpDropped(op);
+        }
+        done(false, 0);
+        return;
+    }
+
+    // a transaction waiting for a slot waits with its first op, RunAdmission wakes it up
+    if (trans.admitted) {
+        _tx_stats.attempts++;
+        if (_tracer != nullptr) {
+            _tracer->OpStarted(op);
+        }
+        note_try(op);
+        _in_tx_op = true;
+        _tx_value = 0;
+        bool success = ExecuteOp(op);
+        _in_tx_op = false;
+        note_tried(op, success);
+        if (_tracer != nullptr) {
+            _tracer->OpTried(op, success);
+        }
+        if (success) {
+            trans.done_ops++;
+            _tx_stats.ops++;
+            done(true, _tx_value);
+            return;
+        }
+    }
+    _parked.insert(std::make_pair(op.trans_id, parked_op_t(op, done)));
+}
+
+void
+TransMng::wake(transid_t trans_id) {
+    if (_parked.empty()) {
+        return;
+    }
+    auto it = _parked.find(trans_id);
+    if (it == _parked.end() || it->second.woken) {
+        return;
+    }
+    it->second.woken = true;
+    _woken.push_back(trans_id);
+    _tx_stats.wakeups++;
+}
+
+void
+TransMng::wake_all(bool reads_only) {
+    if (_parked.empty()) {
+        return;
+    }
+    // in transaction order, the order of the map is not
+    std::vector<transid_t> trans_ids;
+    for (const auto &p : _parked) {
+        if (!p.second.woken && (!reads_only || p.second.op.op_type == OP_READ)) {
+            trans_ids.push_back(p.first);
+        }
+    }
+    std::sort(trans_ids.begin(), trans_ids.end());
+    for (transid_t trans_id : trans_ids) {
+        wake(trans_id);
+    }
+}
+
+// -------------------- Tester Cause Events -----------------------
+
+void
+TransMng::Fail(siteid_t site_id) {
+    if (_site_status[site_id]) {
+        // fail the DM
+        _sites[site_id]->Fail(_now);
+        _site_status[site_id] = false;
+        if (_tracer != nullptr) {
+            _tracer->SiteFail(site_id);
+        }
+
+        // Abort the 2pc transactions that accessed this site so far
         for (auto &p : _trans_table) {
             if ((!p.second.is_ronly)
                 && (!p.second.will_abort)
                 && (p.second.visited_sites.count(site_id))) {
-                std::cout << "Transaction T" << p.first
-                          << " aborted, because it has accessed Site " << site_id
-                          << " and this site failed\n";
-                Abort(p.first);
+                OutFor(p.first) << "Transaction T" << p.first
+                                << " aborted, because it has accessed Site " << site_id
+                                << " and this site failed\n";
+                if (_tracer != nullptr) {
+                    _tracer->TransEvent(p.first, "aborted, site " + std::to_string(site_id) + " failed");
+                }
+                Abort(p.first, "site failure");
+                _admission_stats.failure_aborts++;
             }
         }
-    } else {
-        std::cout << "Site " << site_id << " is not up yet\n";
+
+        // the parked ops lost their lock requests on this site, they may go to another one now
+        wake_all(false);
+    } else {
+        _out << "Site " << site_id << " is not up yet\n";
+    }
+}
+
+void
+TransMng::Recover(siteid_t site_id) {
+    _sites[site_id]->Recover(_now);
+    _site_status[site_id] = true;
+    if (_tracer != nullptr) {
+        _tracer->SiteRecover(site_id);
+    }
+    _site_recovered[site_id] = true;
+    _queue_dirty = true;
+    wake_all(false);
+
+    // the ranks were forgotten as well
+    for (auto &p : _trans_table) {
+        p.second.sent_rank = trans_table_item::RANK_UNSENT;
+    }
+
+    // the site starts over from its committed state, even if it was up, so what was read or written there is gone
+    if (_read_cache) {
+        for (auto &p : _trans_table) {
+            p.second.cache.clear();
+        }
+    }
+    for (auto &p : _multi_ops) {
+        std::fill(p.second.read_sites.begin(), p.second.read_sites.end(), 0);
+    }
+}
+
+void
+TransMng::DumpAll() {
+    if (!_dump_path.empty()) {
+        ExportAll();
+        return;
+    }
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        DumpSite(site_id);
+    }
+}
+
+void
+TransMng::ExportAll() {
+    // every commit so far is in the snapshot, the sites only read their versions on disk at it
+    timestamp_t ts = _now;
+    std::vector<std::string> parts(SITE_COUNT + 1);
+    std::vector<long> records(SITE_COUNT + 1, 0);
+    std::vector<std::thread> workers;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        parts[site_id] = _dump_path + ".site" + std::to_string(site_id);
+        workers.emplace_back([this, site_id, ts, &parts, &records]() {
+            records[site_id] = _sites[site_id]->Export(ts, parts[site_id], _dump_format);
+        });
+    }
+    long total = 0;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        workers[site_id - 1].join();
+        total += records[site_id];
+    }
+
+    std::FILE *out = std::fopen(_dump_path.c_str(), _dump_started ? "ab" : "wb");
+    if (out == nullptr) {
+        std::cout << "ERROR Open Dump File\n";
+        std::exit(-1);
+    }
+    if (_dump_format == DUMP_BINARY) {
+        // every dump starts with "RCD1", its tick (32 bits) and its number of records (64 bits)
+        int32_t tick = ts;
+        int64_t count = total;
+        std::fwrite("RCD1", 1, 4, out);
+        std::fwrite(&tick, sizeof(tick), 1, out);
+        std::fwrite(&count, sizeof(count), 1, out);
+    } else if (!_dump_started) {
+        std::fputs("tick,site,item,value\n", out);
+    }
+    _dump_started = true;
+
+    std::vector<char> chunk(EXPORT_COPY_CHUNK);
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        std::FILE *part = std::fopen(parts[site_id].c_str(), "rb");
+        if (part == nullptr) {
+            std::cout << "ERROR Open Dump File\n";
+            std::exit(-1);
+        }
+        size_t n;
+        while ((n = std::fread(chunk.data(), 1, chunk.size(), part)) > 0) {
+            std::fwrite(chunk.data(), 1, n, out);
+        }
+        std::fclose(part);
+        std::remove(parts[site_id].c_str());
+    }
+    if (std::fclose(out) != 0) {
+        std::cout << "ERROR Write Dump File\n";
+        std::exit(-1);
+    }
+}
+
+void
+TransMng::DumpSite(siteid_t site_id) {
+    _sites[site_id]->Dump();
+}
+
+void
+TransMng::DumpItem(itemid_t item_id) {
+    for (siteid_t site_id : item_sites(item_id)) {
+        _sites[site_id]->DumpItem(item_id);
+    }
+}
+
+// -------------------- Transaction Execution Events -------------------------
+
+void
+TransMng::TryExecuteQueue() {
+    if (_sched_policy != POLICY_FIFO) {
+        // a stable sort, the ops of a transaction keep their order
+        sync_ranks();
+        _queued_ops.sort([this](const op_t &a, const op_t &b) { return rank_of(a.trans_id) < rank_of(b.trans_id); });
+    }
+
+    pool_list<op_t> new_queue(_queued_ops.get_allocator());
+    while (!_queued_ops.empty()) {
+        op_t op = _queued_ops.front();
+        _queued_ops.pop_front();
+        trans_table_item &trans = _trans_table[op.trans_id];
+        if (_wait_stats) {
+            _op_since.insert(std::make_pair(op.op_id, _now));
+        }
+        if (!trans.admitted) {
+            // still waiting for a slot
+            new_queue.push_back(op);
+            continue;
+        }
+        if (trans.will_abort) {
+            // this transaction has already aborted, ignore
+            trans.queued_ops--;
+            _op_since.erase(op.op_id);
+            if (_tracer != nullptr) {
+                _tracer->OpDropped(op);
+            }
+            if (is_multi(op)) {
+                _multi_ops.erase(op.op_id);
+            }
+            _inc_sites.erase(op.op_id);
+            continue;
+        }
+        if (op.op_type == OP_WRITE && _batch_writes) {
+            // batch the writes of this transaction that directly follow in the queue
+            std::vector<op_t> batch(1, op);
+            while (!_queued_ops.empty() &&
+                   _queued_ops.front().op_type == OP_WRITE &&
+                   _queued_ops.front().trans_id == op.trans_id) {
+                batch.push_back(_queued_ops.front());
+                _queued_ops.pop_front();
+            }
+            for (const op_t &write : batch) {
+                note_try(write);
+                if (_tracer != nullptr) {
+                    _tracer->OpStarted(write);
+                }
+            }
+            std::vector<bool> done = WriteBatch(batch);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                note_tried(batch[i], done[i]);
+                if (_tracer != nullptr) {
+                    _tracer->OpTried(batch[i], done[i]);
+                }
+                if (!done[i]) {
+                    new_queue.push_back(batch[i]);
+                } else {
+                    trans.queued_ops--;
+                    trans.done_ops++;
+                    note_op_done(batch[i], trans.priority);
+                }
+            }
+            continue;
+        }
+        if (_tracer != nullptr) {
+            _tracer->OpStarted(op);
+        }
+        note_try(op);
+        bool success = ExecuteOp(op);
+        note_tried(op, success);
+        if (success) {
+            trans.queued_ops--;
+            trans.done_ops++;
+            note_op_done(op, trans.priority);
+            if (is_multi(op)) {
+                _multi_ops.erase(op.op_id);
+            }
+            if (_tracer != nullptr) {
+                _tracer->OpTried(op, true);
+            }
+        } else {
+            new_queue.push_back(op);
+            if (_tracer != nullptr) {
+                _tracer->OpTried(op, false);
+            }
+        }
+    }
+    _queued_ops.swap(new_queue);
+}
+
+int
+TransMng::rank_of(transid_t trans_id) const {
+    auto it = _trans_table.find(trans_id);
+    if (it == _trans_table.end()) {
+        return INT_MAX;
+    }
+    switch (_sched_policy) {
+        case POLICY_OLDEST:
+            return it->second.start_ts;
+        case POLICY_FEWEST_LOCKS:
+            // what is left to run is not known ahead, the locks it took or waits for so far stand for it
+            return it->second.done_ops + it->second.queued_ops;
+        case POLICY_PRIORITY:
+            return -it->second.priority;
+        default:
+            return 0;
+    }
+}
+
+void
+TransMng::sync_ranks() {
+    for (auto &p : _trans_table) {
+        trans_table_item &trans = p.second;
+        // skip the aborted ones and the placeholders of transactions that ended
+        if (trans.will_abort || trans.arena == nullptr) {
+            continue;
+        }
+        int rank = rank_of(p.first);
+        if (rank == trans.sent_rank) {
+            continue;
+        }
+        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+            if (_site_status[site_id]) {
+                _sites[site_id]->SetTransRank(p.first, rank);
+            }
+        }
+        trans.sent_rank = rank;
+    }
+}
+
+void
+TransMng::note_op_done(op_t op, int priority) {
+    if (!_wait_stats) {
+        return;
+    }
+    auto it = _op_since.find(op.op_id);
+    if (it != _op_since.end()) {
+        _op_waits[priority].push_back(_now - it->second);
+        _op_since.erase(it);
+    }
+}
+
+void
+TransMng::note_try(const op_t &op) {
+    if (!_trans_stats) {
+        return;
+    }
+    _try_lock_sites = 0;
+    auto it = _trans_live.find(op.trans_id);
+    if (it == _trans_live.end()) {
+        return;
+    }
+    std::vector<blocked_op_t> &blocked = it->second.blocked;
+    for (size_t i = 0; i < blocked.size(); ++i) {
+        if (blocked[i].op_id == op.op_id) {
+            charge_wait(it->second.report, blocked[i]);
+            blocked.erase(blocked.begin() + i);
+            it->second.report.retries++;
+            return;
+        }
+    }
+}
+
+void
+TransMng::note_tried(const op_t &op, bool done) {
+    if (!_trans_stats || done) {
+        return;
+    }
+    auto it = _trans_live.find(op.trans_id);
+    if (it == _trans_live.end()) {
+        return;
+    }
+    blocked_op_t blocked;
+    blocked.op_id = op.op_id;
+    blocked.since = _now;
+    blocked.since_wall = std::chrono::steady_clock::now();
+    blocked.lock_sites = _try_lock_sites;
+    it->second.blocked.push_back(blocked);
+}
+
+void
+TransMng::charge_wait(trans_report_t &report, const blocked_op_t &blocked) {
+    timestamp_t ticks = _now - blocked.since;
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - blocked.since_wall).count();
+    if (blocked.lock_sites == 0) {
+        report.replica_ticks += ticks;
+        report.replica_us += us;
+        return;
+    }
+    report.lock_wait_ticks += ticks;
+    report.lock_wait_us += us;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        if (blocked.lock_sites & (1u << site_id)) {
+            report.lock_ticks[site_id] += ticks;
+            report.lock_us[site_id] += us;
+        }
+    }
+}
+
+void
+TransMng::settle_blocked(trans_live_t &live) {
+    for (const blocked_op_t &blocked : live.blocked) {
+        charge_wait(live.report, blocked);
+    }
+    live.blocked.clear();
+}
+
+void
+TransMng::close_report(transid_t trans_id, bool committed) {
+    auto it = _trans_live.find(trans_id);
+    if (it == _trans_live.end()) {
+        return;
+    }
+    trans_live_t &live = it->second;
+    live.report.committed = committed;
+    if (committed) {
+        // ops may still wait when end() comes, they wait no longer
+        settle_blocked(live);
+        _commit_reports.push_back(std::make_pair(_trans_reports.size(), live.begin_wall));
+    }
+    _trans_reports.push_back(live.report);
+    _trans_live.erase(it);
+}
+
+void
+TransMng::RunAdmission() {
+    // the ops of the transactions that got in and wait for locks, not the ones that wait for a slot
+    long depth = 0;
+    for (const op_t &op : _queued_ops) {
+        auto it = _trans_table.find(op.trans_id);
+        depth += it != _trans_table.end() && it->second.admitted;
+    }
+    _admission_stats.wait_depth_sum += depth;
+    _admission_stats.wait_depth_samples++;
+    if (_now - _window_start >= ADMISSION_WINDOW) {
+        adapt_cap();
+    }
+
+    bool changed = false;
+    while (!_admit_queue.empty() && _admitted_rw < _admission_stats.cap) {
+        auto it = _trans_table.find(_admit_queue.front());
+        _admit_queue.pop_front();
+        if (it == _trans_table.end() || it->second.admitted) {
+            // it ended (or went away) before it got in
+            continue;
+        }
+        it->second.admitted = true;
+        wake(it->first);
+        if (!it->second.will_abort) {
+            it->second.holds_slot = true;
+            _admitted_rw++;
+        }
+        changed = true;
+    }
+    if (!_admit_queue.empty()) {
+        _window_saturated = true;
+    }
+
+    // the deferred end()s whose ops are done by now
+    std::vector<transid_t> ends;
+    ends.swap(_deferred_ends);
+    for (transid_t trans_id : ends) {
+        auto it = _trans_table.find(trans_id);
+        if (it == _trans_table.end()) {
+            continue;
+        }
+        if (it->second.admitted && (it->second.queued_ops == 0 || it->second.will_abort)) {
+            Finish(trans_id);
+            changed = true;
+        } else {
+            _deferred_ends.push_back(trans_id);
+        }
+    }
+
+    if (changed) {
+        FlushCommits();
+        TryExecuteQueue();
+    }
+}
+
+void
+TransMng::adapt_cap() {
+    long commits = _admission_stats.commits - _window_stats.commits;
+    long deadlock_aborts = _admission_stats.deadlock_aborts - _window_stats.deadlock_aborts;
+    long depth = _admission_stats.wait_depth_sum - _window_stats.wait_depth_sum;
+    long samples = _admission_stats.wait_depth_samples - _window_stats.wait_depth_samples;
+
+    // thrashing: a deadlock for every couple of commits, or a pile of ops waiting for locks for each slot
+    int &cap = _admission_stats.cap;
+    bool thrashing = deadlock_aborts * ADMISSION_ABORT_DIV > commits || (samples > 0 && depth > 4L * cap * samples);
+    if (thrashing) {
+        if (cap > 1) {
+            cap /= 2;
+            _admission_stats.cap_cuts++;
+        }
+    } else if (_window_saturated && cap < ADMISSION_MAX_CAP) {
+        cap++;
+    }
+
+    _window_stats = _admission_stats;
+    _window_start = _now;
+    _window_saturated = false;
+}
+
+void
+TransMng::release_slot(trans_table_item &trans) {
+    if (trans.holds_slot) {
+        trans.holds_slot = false;
+        _admitted_rw--;
+    }
+}
+
+void
+TransMng::release_snapshot(timestamp_t start_ts) {
+    auto snapshot = _snapshots.find(start_ts);
+    if (snapshot != _snapshots.end() && --snapshot->second.refs == 0) {
+        _snapshots.erase(snapshot);
+    }
+}
+
+bool
+TransMng::ExecuteOp(op_t op) {
+    switch (op.op_type) {
+        case OP_READ:
+            return Read(op);
+        case OP_WRITE:
+            if (_batch_writes) {
+                return WriteBatch(std::vector<op_t>(1, op))[0];
+            }
+            return Write(op);
+        case OP_RONLY:
+            return Ronly(op);
+        case OP_READ_RANGE:
+            return ReadRange(op);
+        case OP_WRITE_MULTI:
+            return WriteMulti(op);
+        case OP_SUM:
+        case OP_SCAN:
+            return Scan(op);
+        case OP_INC:
+            return Increment(op);
+        default: {
+            std::cout << "ERROR: Invalid case\n";
+            std::exit(-1);
+        }
+    }
+}
+
+void
+TransMng::ReceiveReadResponse(op_t op, siteid_t site_id, int value) {
+    if (_collecting != nullptr) {
+        // an item of the running RR, it is reported once the whole range has been read
+        auto it = std::lower_bound(_collecting->items.begin(), _collecting->items.end(), op,
+                                   [](const op_t &a, const op_t &b) { return op_item(a) < op_item(b); });
+        size_t i = static_cast<size_t>(it - _collecting->items.begin());
+        _collecting->read_sites[i] = site_id;
+        _collecting->values[i] = value;
+        return;
+    }
+    if (_read_cache && op.op_type == OP_READ) {
+        cached_item_t &cached = _trans_table[op.trans_id].cache[op.param.r_param.item_id];
+        cached.value = value;
+        cached.read_site = site_id;
+    }
+    if (op.op_type == OP_RONLY) {
+        _ronly_value = value;
+    }
+    if (_in_tx_op) {
+        // an embedded op, the value goes to its done
+        _tx_value = value;
+        return;
+    }
+    OutFor(op.trans_id) << "Received from Site " << site_id
+                        << " READ operation result on Transaction T" << op.trans_id
+                        << " | OPid: " << op.op_id
+                        << " | Key = " << op.param.r_param.item_id
+                        << " | Value = " << value
+                        << std::endl;
+}
+
+void
+TransMng::ReceiveWriteResponse(op_t op, siteid_t site_id) {
+    if (_in_tx_op) {
+        return;
+    }
+    OutFor(op.trans_id) << "Received from Site " << site_id
+                        << " WRITE operation result on Transaction T" << op.trans_id
+                        << " | OPid: " << op.op_id
+                        << " | Key = " << op.param.w_param.item_id
+                        << " | Value = " << op.param.w_param.value
+                        << std::endl;
+}
+
+void
+TransMng::SetWriteBatching(bool enabled) {
+    _batch_writes = enabled;
+}
+
+void
+TransMng::SetReadCache(bool enabled) {
+    _read_cache = enabled;
+}
+
+long
+TransMng::CacheHits() const {
+    return _cache_hits;
+}
+
+void
+TransMng::SetDumpExport(const std::string &path, dump_format_t format) {
+    _dump_path = path;
+    _dump_format = format;
+    _dump_started = false;
+}
+
+void
+TransMng::SetSnapshotCache(bool enabled) {
+    _snapshot_cache = enabled;
+}
+
+long
+TransMng::SnapshotHits() const {
+    return _snapshot_hits;
+}
+
+long
+TransMng::SnapshotMisses() const {
+    return _snapshot_misses;
+}
+
+void
+TransMng::SetTickBanner(bool enabled) {
+    _tick_banner = enabled;
+}
+
+void
+TransMng::SetStrictCommands(bool strict) {
+    _strict_commands = strict;
+}
+
+long
+TransMng::InvalidCommands() const {
+    return _invalid_commands;
+}
+
+void
+TransMng::SetRouter(TransRouter *router) {
+    _router = router;
+}
+
+void
+TransMng::SetFreeRunning(bool enabled) {
+    _free_running = enabled;
+}
+
+void
+TransMng::SetDeadlockInterval(int events) {
+    _deadlock_interval = events;
+}
+
+void
+TransMng::SetDeadlockThreshold(int events) {
+    _deadlock_threshold = events;
+}
+
+void
+TransMng::SetSchedPolicy(sched_policy_t policy) {
+    _sched_policy = policy;
+}
+
+void
+TransMng::SetWaitStats(bool enabled) {
+    _wait_stats = enabled;
+}
+
+void
+TransMng::SetTransStats(bool enabled) {
+    _trans_stats = enabled;
+}
+
+const std::vector<trans_report_t> &
+TransMng::TransReports() const {
+    return _trans_reports;
+}
+
+void
+TransMng::PrintTransSummary(std::ostream &out) const {
+    out << "---------------- Transactions (begin to commit or abort) ----------------\n";
+    for (int ronly = 0; ronly <= 1; ++ronly) {
+        std::vector<const trans_report_t *> reports;
+        long committed = 0;
+        std::map<std::string, long> reasons;
+        for (const trans_report_t &report : _trans_reports) {
+            if (report.is_ronly != (ronly == 1)) {
+                continue;
+            }
+            reports.push_back(&report);
+            if (report.committed) {
+                committed++;
+            } else {
+                reasons[report.abort_reason]++;
+            }
+        }
+        out << (ronly ? "read-only" : "read-write") << ": " << reports.size() << " ended, " << committed
+            << " committed, " << reports.size() - committed << " aborted";
+        if (!reasons.empty()) {
+            out << " (";
+            for (auto it = reasons.begin(); it != reasons.end(); ++it) {
+                out << (it == reasons.begin() ? "" : ", ") << it->first << " " << it->second;
+            }
+            out << ")";
+        }
+        out << "\n";
+        if (reports.empty()) {
+            continue;
+        }
+
+        // one row per measure, and the lock waits of each site summed over the transactions
+        std::vector<std::pair<std::string, std::vector<double>>> rows = {
+                {"ticks", {}}, {"wall us", {}}, {"lock wait ticks", {}}, {"lock wait us", {}},
+                {"replica wait ticks", {}}, {"replica wait us", {}}, {"retries", {}}};
+        timestamp_t site_ticks[SITE_COUNT + 1] = {0};
+        for (const trans_report_t *report : reports) {
+            for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                site_ticks[site_id] += report->lock_ticks[site_id];
+            }
+            rows[0].second.push_back(report->end_tick - report->begin_tick);
+            rows[1].second.push_back(report->wall_us);
+            rows[2].second.push_back(report->lock_wait_ticks);
+            rows[3].second.push_back(report->lock_wait_us);
+            rows[4].second.push_back(report->replica_ticks);
+            rows[5].second.push_back(report->replica_us);
+            rows[6].second.push_back(report->retries);
+        }
+        out << std::left << std::setw(20) << "  measure" << std::right << std::setw(12) << "mean"
+            << std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99"
+            << std::setw(12) << "max" << "\n";
+        out << std::fixed << std::setprecision(1);
+        for (auto &row : rows) {
+            std::vector<double> &samples = row.second;
+            std::sort(samples.begin(), samples.end());
+            double sum = 0;
+            for (double sample : samples) {
+                sum += sample;
+            }
+            out << std::left << std::setw(20) << "  " + row.first << std::right
+                << std::setw(12) << sum / samples.size()
+                << std::setw(12) << samples[samples.size() / 2]
+                << std::setw(12) << samples[samples.size() * 9 / 10]
+                << std::setw(12) << samples[samples.size() * 99 / 100]
+                << std::setw(12) << samples.back() << "\n";
+        }
+        out << "  lock wait ticks by site:";
+        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+            out << " " << site_ticks[site_id];
+        }
+        out << "\n";
+    }
+}
+
+void
+TransMng::WriteTransCsv(std::ostream &out) const {
+    out << "trans_id,type,outcome,abort_reason,begin_tick,end_tick,wall_us,lock_wait_ticks,lock_wait_us,replica_wait_ticks,replica_wait_us,retries";
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        out << ",lock_wait_ticks_site" << site_id << ",lock_wait_us_site" << site_id;
+    }
+    out << "\n" << std::fixed << std::setprecision(1);
+    for (const trans_report_t &report : _trans_reports) {
+        out << report.trans_id << "," << (report.is_ronly ? "read-only" : "read-write") << ","
+            << (report.committed ? "committed" : "aborted") << "," << report.abort_reason << ","
+            << report.begin_tick << "," << report.end_tick << "," << report.wall_us << ","
+            << report.lock_wait_ticks << "," << report.lock_wait_us << "," << report.replica_ticks << "," << report.replica_us << "," << report.retries;
+        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+            out << "," << report.lock_ticks[site_id] << "," << report.lock_us[site_id];
+        }
+        out << "\n";
     }
 }
 
 void
-TransMng::Recover(siteid_t site_id) {
-    DM[site_id]->Recover(_now);
-    _site_status[site_id] = true;
+TransMng::SetTracer(Tracer *tracer) {
+    _tracer = tracer;
 }
 
 void
-TransMng::DumpAll() {
-    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
-        DumpSite(site_id);
+TransMng::SetCoordinator(TransCoordinator *coordinator, int partition) {
+    _coordinator = coordinator;
+    _partition = partition;
+}
+
+bool
+TransMng::AbortDeadlockVictim(transid_t trans_id) {
+    // the waits it was picked for may be gone by now
+    auto it = _trans_table.find(trans_id);
+    if (it == _trans_table.end() || it->second.will_abort ||
+        (!_parked.count(trans_id) && it->second.queued_ops == 0)) {
+        return false;
     }
+    abort_victim(trans_id);
+    return true;
 }
 
 void
-TransMng::DumpSite(siteid_t site_id) {
-    DM[site_id]->Dump();
+TransMng::SetAdmissionControl(bool enabled) {
+    _admission = enabled;
 }
 
-void
-TransMng::DumpItem(itemid_t item_id) {
-    for (siteid_t site_id : _item_sites[item_id]) {
-        DM[site_id]->DumpItem(item_id);
-    }
+const admission_stats_t &
+TransMng::AdmissionStats() const {
+    return _admission_stats;
 }
 
-// -------------------- Transaction Execution Events -------------------------
+const std::map<int, std::vector<timestamp_t>> &
+TransMng::OpWaits() const {
+    return _op_waits;
+}
 
-void
-TransMng::TryExecuteQueue() {
-    std::list<op_t> new_queue;
-    while (!_queued_ops.empty()) {
-        op_t op = _queued_ops.front();
-        _queued_ops.pop_front();
-        if (_trans_table[op.trans_id].will_abort) {
-            // this transaction has already aborted, ignore
-            continue;
-        }
-        switch (op.op_type) {
-            case OP_READ: {
-                if (!Read(op)) {
-                    new_queue.push_back(op);
-                }
-                break;
-            }
-            case OP_WRITE: {
-                if (!Write(op)) {
-                    new_queue.push_back(op);
-                }
-                break;
-            }
-            case OP_RONLY: {
-                if (!Ronly(op)) {
-                    new_queue.push_back(op);
-                }
-                break;
-            }
-            default: {
-                std::cout << "ERROR: Invalid case\n";
-                std::exit(-1);
-            }
-        }
-    }
-    _queued_ops.swap(new_queue);
+bool
+TransMng::IsActive(transid_t trans_id) const {
+    return _trans_table.count(trans_id) > 0;
 }
 
-void
-TransMng::ReceiveReadResponse(op_t op, siteid_t site_id, int value) {
-    std::cout << "Received from Site " << site_id
-              << " READ operation result on Transaction T" << op.trans_id
-              << " | OPid: " << op.op_id
-              << " | Key = " << op.param.r_param.item_id
-              << " | Value = " << value
-              << std::endl;
+size_t
+TransMng::QueuedOps(transid_t trans_id) const {
+    auto it = _trans_table.find(trans_id);
+    return it == _trans_table.end() ? 0 : it->second.queued_ops;
+}
+
+bool
+TransMng::HasQueuedOps() const {
+    return !_queued_ops.empty();
 }
 
 void
-TransMng::ReceiveWriteResponse(op_t op, siteid_t site_id) {
-    std::cout << "Received from Site " << site_id
-              << " WRITE operation result on Transaction T" << op.trans_id
-              << " | OPid: " << op.op_id
-              << " | Key = " << op.param.w_param.item_id
-              << " | Value = " << op.param.w_param.value
-              << std::endl;
+TransMng::Disconnect(transid_t trans_id) {
+    if (!_trans_table.count(trans_id)) {
+        return;
+    }
+
+    // forget its queued ops, release its locks, then drop it like end() would
+    _queued_ops.remove_if([trans_id](const op_t &op) { return op.trans_id == trans_id; });
+    _parked.erase(trans_id);
+    Abort(trans_id, "disconnected");
+    close_report(trans_id, false);
+    if (_tracer != nullptr) {
+        _tracer->TransEnd(trans_id, "disconnected");
+    }
+    if (_trans_table[trans_id].is_ronly) {
+        release_snapshot(_trans_table[trans_id].start_ts);
+    }
+    Arena *arena = _trans_table[trans_id].arena;
+    _trans_table.erase(trans_id);
+    if (arena != nullptr) {
+        _arena_pool.Release(arena);
+    }
+}
+
+std::ostream &
+TransMng::OutFor(transid_t trans_id) {
+    return _router != nullptr ? _router->Output(trans_id) : _out;
 }
 
 void
-TransMng::Begin(transid_t trans_id, bool is_ronly) {
+TransMng::Begin(transid_t trans_id, bool is_ronly, int priority) {
     if (_trans_table.count(trans_id)) {
         print_command_error();
     }
-    _trans_table[trans_id] = trans_table_item(_now, is_ronly);
+    _trans_table[trans_id] = trans_table_item(_now, is_ronly, priority, _arena_pool.Acquire());
+    if (_tracer != nullptr) {
+        _tracer->TransBegin(trans_id, is_ronly);
+    }
+    if (is_ronly && _snapshot_cache) {
+        _snapshots[_now].refs++;
+    }
+    if (_trans_stats) {
+        trans_live_t &live = _trans_live[trans_id];
+        live = trans_live_t();
+        live.report.trans_id = trans_id;
+        live.report.is_ronly = is_ronly;
+        live.report.begin_tick = _now;
+        live.begin_wall = std::chrono::steady_clock::now();
+    }
+
+    if (_admission && !is_ronly) {
+        trans_table_item &trans = _trans_table[trans_id];
+        if (_admitted_rw < _admission_stats.cap && _admit_queue.empty()) {
+            trans.holds_slot = true;
+            _admitted_rw++;
+        } else {
+            trans.admitted = false;
+            _admit_queue.push_back(trans_id);
+            _admission_stats.deferred_begins++;
+            _window_saturated = true;
+        }
+    }
 }
 
 void
 TransMng::Finish(transid_t trans_id) {
+    // its ops have not run yet, end it once they did
+    if (!_trans_table[trans_id].admitted && _trans_table[trans_id].queued_ops > 0) {
+        _deferred_ends.push_back(trans_id);
+        return;
+    }
+    // Free running: the ops of this transaction may wait for a deadlock nobody has detected yet
+    if (_free_running && _trans_table[trans_id].queued_ops > 0) {
+        while (DetectDeadLock()) {
+            TryExecuteQueue();
+        }
+    }
+
     // The instruction assume that the next command will not arrive if there are pending operations
     if (_trans_table[trans_id].will_abort) {
-        std::cout << "Transaction T" << trans_id << " has already aborted\n";
+        FlushCommits();
+        OutFor(trans_id) << "Transaction T" << trans_id << " has already aborted\n";
     } else {
-        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
-            DM[site_id]->Commit(trans_id, _now);
-        }
-        std::cout << "Transaction T" << trans_id << " finished succesfully!\n";
+        // defer the commit, so that all the transactions ending in this tick commit together
+        _pending_commits.push_back(trans_id);
+    }
+
+    if (_tracer != nullptr) {
+        _tracer->TransEnd(trans_id, _trans_table[trans_id].will_abort ? "aborted" : "committed");
+    }
+    close_report(trans_id, !_trans_table[trans_id].will_abort);
+
+    // drop all the bookkeeping of this transaction at once
+    release_slot(_trans_table[trans_id]);
+    if (_trans_table[trans_id].is_ronly) {
+        release_snapshot(_trans_table[trans_id].start_ts);
     }
+    Arena *arena = _trans_table[trans_id].arena;
     _trans_table.erase(trans_id);
+    if (arena != nullptr) {
+        _arena_pool.Release(arena);
+    }
+}
+
+void
+TransMng::FlushCommits() {
+    if (_pending_commits.empty()) {
+        return;
+    }
+
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        _sites[site_id]->GroupCommit(_pending_commits, _now);
+    }
+    for (transid_t trans_id : _pending_commits) {
+        OutFor(trans_id) << "Transaction T" << trans_id << " finished succesfully!\n";
+    }
+    _admission_stats.commits += _pending_commits.size();
+    _pending_commits.clear();
+    if (!_commit_reports.empty()) {
+        wall_time_t wall = std::chrono::steady_clock::now();
+        for (const auto &p : _commit_reports) {
+            _trans_reports[p.first].end_tick = _now;
+            _trans_reports[p.first].wall_us = std::chrono::duration<double, std::micro>(wall - p.second).count();
+        }
+        _commit_reports.clear();
+    }
+    _queue_dirty = true;
+
+    // the embedded ones are told in the next round
+    _committed.insert(_committed.end(), _commit_waiters.begin(), _commit_waiters.end());
+    _commit_waiters.clear();
+
+    // a commit makes its items readable on the sites that recovered
+    if (std::find(_site_recovered + 1, _site_recovered + SITE_COUNT + 1, true) != _site_recovered + SITE_COUNT + 1) {
+        wake_all(true);
+    }
 }
 
 void
-TransMng::Abort(transid_t trans_id) {
+TransMng::Abort(transid_t trans_id, const char *reason) {
     if (_trans_table[trans_id].will_abort) {
         // already aborted, do nothing
     } else {
+        auto live = _trans_live.find(trans_id);
+        if (live != _trans_live.end()) {
+            // its queued ops wait for nothing from now on
+            settle_blocked(live->second);
+            live->second.report.abort_reason = reason;
+            live->second.report.end_tick = _now;
+            live->second.report.wall_us = std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - live->second.begin_wall).count();
+        }
         for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
-            DM[site_id]->Abort(trans_id);
+            _sites[site_id]->Abort(trans_id);
         }
         _trans_table[trans_id].will_abort = true;
+        _trans_table[trans_id].cache.clear();
+        release_slot(_trans_table[trans_id]);
+        _queue_dirty = true;
+        wake(trans_id);
     }
 }
 
 bool
 TransMng::Read(op_t op) {
+    if (_read_cache && ReadCached(op)) {
+        return true;
+    }
+
     itemid_t item_id = op.param.r_param.item_id;
     // for a read operation, send it to any of the sites should be fine
-    for (siteid_t site_id : _item_sites[item_id]) {
+    for (siteid_t site_id : item_sites(item_id)) {
         if (!_site_status[site_id]) {
             // this site is down, try next one
             continue;
         }
 
-        if (DM[site_id]->GetReadLock(op.trans_id, item_id)) {
+        if (_sites[site_id]->GetReadLock(op.trans_id, item_id)) {
             // let DM execute it
-            if (DM[site_id]->Read(op)) {
+            if (_sites[site_id]->Read(op)) {
                 _trans_table[op.trans_id].visited_sites.insert(site_id);
                 return true;
             } else {
-                err_inconsist();
+                err_inconsist(_out);
             }
         }
     }
@@ -485,92 +2047,461 @@ TransMng::Read(op_t op) {
     return false;
 }
 
+bool
+TransMng::ReadCached(op_t op) {
+    itemid_t item_id = op.param.r_param.item_id;
+    trans_table_item &trans = _trans_table[op.trans_id];
+    auto cached = trans.cache.find(item_id);
+    if (cached == trans.cache.end()) {
+        return false;
+    }
+
+    // a read goes to the first up site that grants it, find out which one it would be
+    siteid_t site_id = 0;
+    for (siteid_t candidate : item_sites(item_id)) {
+        if (_site_status[candidate]) {
+            site_id = candidate;
+            break;
+        }
+    }
+    if (site_id == 0) {
+        return false;
+    }
+
+    // 1. it read the item from this very site and still holds the S lock there
+    // 2. it wrote the item here, and the item is readable unless the site has ever recovered
+    bool written_here = (cached->second.written_sites >> site_id) & 1u;
+    bool grants = cached->second.read_site == site_id ||
+                  (written_here && (item_id % 2 == 1 || !_site_recovered[site_id]));
+    if (!grants) {
+        return false;
+    }
+
+    _cache_hits++;
+    ReceiveReadResponse(op, site_id, cached->second.value);
+    trans.visited_sites.insert(site_id);
+    return true;
+}
+
 bool
 TransMng::Ronly(op_t op) {
     itemid_t item_id = op.param.r_param.item_id;
     transid_t trans_id = op.trans_id;
     timestamp_t start_ts = _trans_table[trans_id].start_ts;
+
+    // the snapshot can be cached once its tick is over, until then a commit of the tick may still land in it
+    snapshot_item_t *cached = nullptr;
+    if (_snapshot_cache && start_ts < _now) {
+        auto snapshot = _snapshots.find(start_ts);
+        if (snapshot != _snapshots.end()) {
+            cached = &snapshot->second.items[item_id];
+        }
+    }
+
     // for a read operation, send it to any of the sites should be fine
-    for (siteid_t site_id : _item_sites[item_id]) {
+    for (siteid_t site_id : item_sites(item_id)) {
         if (!_site_status[site_id]) {
             // this site is down, try next one
             continue;
         }
 
+        if (cached != nullptr) {
+            // answer like this site would, so the read is reported from the same site as without the cache
+            unsigned bit = 1u << site_id;
+            if (cached->served_sites & bit) {
+                _snapshot_hits++;
+                ReceiveReadResponse(op, site_id, cached->value);
+                return true;
+            }
+            if (cached->refused_sites & bit) {
+                continue;
+            }
+        }
+
         // let DM execute it
-        if (DM[site_id]->Ronly(op, start_ts)) {
+        if (_sites[site_id]->Ronly(op, start_ts)) {
+            if (cached != nullptr) {
+                cached->value = _ronly_value;
+                cached->served_sites |= 1u << site_id;
+                _snapshot_misses++;
+            }
             return true;
         }
+        if (cached != nullptr) {
+            cached->refused_sites |= 1u << site_id;
+        }
     }
 
     // If not success, then all the sites are down or not readable, we need to queue this operation
     return false;
 }
 
+bool
+TransMng::Scan(op_t op) {
+    itemid_t first = op.param.s_param.first;
+    itemid_t last = op.param.s_param.last;
+    timestamp_t start_ts = _trans_table[op.trans_id].start_ts;
+    bool with_values = op.op_type == OP_SCAN;
+
+    // what the sites served: the sum, and for SCAN every item with its site and value
+    long long sum = 0;
+    std::vector<std::pair<itemid_t, std::pair<siteid_t, int>>> served;
+    auto add = [&](siteid_t site_id, const snapshot_t &snapshot) {
+        sum += snapshot.sum;
+        for (size_t i = 0; i < snapshot.items.size(); ++i) {
+            served.push_back(std::make_pair(snapshot.items[i], std::make_pair(site_id, snapshot.values[i])));
+        }
+    };
+
+    // 1. an unreplicated item can only be served by its own site
+    for (siteid_t site_id = 2; site_id <= SITE_COUNT; site_id += 2) {
+        if (!holds_unreplicated(site_id, first, last)) {
+            continue;
+        }
+        if (!_site_status[site_id]) {
+            // wait for the site to come back, like a read of the item would
+            return false;
+        }
+        add(site_id, _sites[site_id]->SnapshotScan(first, last, false, start_ts, with_values));
+    }
+
+    // 2. the replicated items: the first up site serves what it can, the following ones what is still missing
+    if (first % 2 == 0 || first < last) {
+        bool asked = false;
+        std::vector<itemid_t> missed;
+        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+            if (!_site_status[site_id]) {
+                // this site is down, try next one
+                continue;
+            }
+            if (!asked) {
+                snapshot_t snapshot = _sites[site_id]->SnapshotScan(first, last, true, start_ts, with_values);
+                add(site_id, snapshot);
+                missed.swap(snapshot.missed);
+                asked = true;
+            } else {
+                std::vector<itemid_t> still_missed;
+                for (itemid_t item_id : missed) {
+                    snapshot_t snapshot = _sites[site_id]->SnapshotScan(item_id, item_id, true, start_ts, with_values);
+                    add(site_id, snapshot);
+                    still_missed.insert(still_missed.end(), snapshot.missed.begin(), snapshot.missed.end());
+                }
+                missed.swap(still_missed);
+            }
+            if (missed.empty()) {
+                break;
+            }
+        }
+        if (!asked || !missed.empty()) {
+            // nothing is served until the whole range can be
+            return false;
+        }
+    }
+
+    // 3. report it, SCAN like a read of each item in item order
+    if (with_values) {
+        std::sort(served.begin(), served.end());
+        for (const auto &item : served) {
+            op_param_t read_param;
+            read_param.r_param.item_id = item.first;
+            ReceiveReadResponse(op_t(op.op_id, op.trans_id, OP_RONLY, read_param), item.second.first,
+                                item.second.second);
+        }
+    } else {
+        OutFor(op.trans_id) << "Received SUM operation result on Transaction T" << op.trans_id
+                            << " | OPid: " << op.op_id
+                            << " | Keys = " << first << ".." << last
+                            << " | Value = " << sum
+                            << std::endl;
+    }
+    return true;
+}
+
 bool
 TransMng::Write(op_t op) {
-    transid_t trans_id = op.trans_id;
+    return WriteBatch(std::vector<op_t>(1, op)).front();
+}
+
+std::vector<bool>
+TransMng::WriteBatch(const std::vector<op_t> &ops) {
+    std::vector<bool> success = BroadcastWrites(ops);
+
+    // 6. a write is done once all the replicas have granted it
+    for (size_t i = 0; i < ops.size(); ++i) {
+        if (success[i]) {
+            AckWrite(ops[i]);
+        } else if (_read_cache) {
+            // the replicas that granted it already hold the new value, whatever was cached is stale
+            _trans_table[ops[i].trans_id].cache.erase(ops[i].param.w_param.item_id);
+        }
+    }
+    return success;
+}
+
+std::vector<bool>
+TransMng::BroadcastWrites(const std::vector<op_t> &ops) {
+    // 5. broadcast to all the sites, one lock-and-write request per site
+    std::vector<bool> success(ops.size(), true);
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+        if (!_site_status[site_id]) {
+            // this site is down, try next one
+            continue;
+        }
+
+        std::vector<op_t> site_ops;
+        std::vector<size_t> site_idx;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            if (hosts(site_id, ops[i].param.w_param.item_id)) {
+                site_ops.push_back(ops[i]);
+                site_idx.push_back(i);
+            }
+        }
+        if (site_ops.empty()) {
+            continue;
+        }
+
+        std::vector<bool> granted = _sites[site_id]->LockAndWriteBatch(site_ops);
+        for (size_t i = 0; i < site_idx.size(); ++i) {
+            if (!granted[i]) {
+                success[site_idx[i]] = false;
+            }
+        }
+    }
+    return success;
+}
+
+void
+TransMng::AckWrite(op_t op) {
     itemid_t item_id = op.param.w_param.item_id;
-    int value = op.param.w_param.value;
+    trans_table_item &trans = _trans_table[op.trans_id];
+    unsigned written_sites = 0;
+    for (siteid_t site_id : item_sites(item_id)) {
+        if (!_site_status[site_id]) {
+            // this site is down, try next one
+            continue;
+        }
+
+        ReceiveWriteResponse(op, site_id);
+        trans.visited_sites.insert(site_id);
+        written_sites |= 1u << site_id;
+    }
+    if (_read_cache) {
+        cached_item_t &cached = trans.cache[item_id];
+        cached.value = op.param.w_param.value;
+        cached.written_sites |= written_sites;
+    }
+}
 
-    // 5. broadcase to all the sites
+bool
+TransMng::Increment(op_t op) {
+    itemid_t item_id = op.param.w_param.item_id;
+    trans_table_item &trans = _trans_table[op.trans_id];
+    unsigned &applied = _inc_sites[op.op_id];
     bool success = true;
-    for (siteid_t site_id : _item_sites[item_id]) {
+    for (siteid_t site_id : item_sites(item_id)) {
+        if (!_site_status[site_id] || (applied & (1u << site_id))) {
+            // this site is down, or has it already
+            continue;
+        }
+        switch (_sites[site_id]->LockAndIncrement(op)) {
+            case INC_APPLIED:
+                // its delta is lost if the site fails, like a write
+                applied |= 1u << site_id;
+                trans.visited_sites.insert(site_id);
+                break;
+            case INC_WAIT:
+                success = false;
+                break;
+            case INC_STALE:
+                break;
+        }
+    }
+    if (_read_cache) {
+        // the value cached is the one before the increment
+        trans.cache.erase(item_id);
+    }
+
+    // with no readable replica up it waits, like a read
+    if (!success || applied == 0) {
+        return false;
+    }
+    for (siteid_t site_id : item_sites(item_id)) {
+        if (applied & (1u << site_id)) {
+            OutFor(op.trans_id) << "Received from Site " << site_id
+                                << " INC operation result on Transaction T" << op.trans_id
+                                << " | OPid: " << op.op_id
+                                << " | Key = " << item_id
+                                << " | Delta = " << op.param.w_param.value
+                                << std::endl;
+        }
+    }
+    _inc_sites.erase(op.op_id);
+    return true;
+}
+
+void
+TransMng::QueueMulti(op_t op, std::vector<op_t> items) {
+    // every site is then locked in item order
+    std::sort(items.begin(), items.end(), [](const op_t &a, const op_t &b) { return op_item(a) < op_item(b); });
+
+    multi_op_t &multi = _multi_ops[op.op_id];
+    multi.items.swap(items);
+    if (op.op_type == OP_READ_RANGE) {
+        multi.read_sites.assign(multi.items.size(), 0);
+        multi.values.assign(multi.items.size(), 0);
+    }
+
+    _queued_ops.push_back(op);
+    _trans_table[op.trans_id].queued_ops++;
+}
+
+bool
+TransMng::ReadRange(op_t op) {
+    multi_op_t &multi = _multi_ops[op.op_id];
+    trans_table_item &trans = _trans_table[op.trans_id];
+
+    // one lock-and-read request per site for the items still missing, like a single read an item is read from
+    // the first up site that grants it. The results are collected by ReceiveReadResponse
+    _collecting = &multi;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
         if (!_site_status[site_id]) {
             // this site is down, try next one
             continue;
         }
 
-        success &= DM[site_id]->GetWriteLock(trans_id, item_id);
+        std::vector<op_t> site_ops;
+        for (size_t i = 0; i < multi.items.size(); ++i) {
+            if (multi.read_sites[i] == 0 && hosts(site_id, multi.items[i].param.r_param.item_id)) {
+                site_ops.push_back(multi.items[i]);
+            }
+        }
+        if (site_ops.empty()) {
+            continue;
+        }
+
+        std::vector<bool> granted = _sites[site_id]->LockAndReadBatch(site_ops);
+        if (std::find(granted.begin(), granted.end(), true) != granted.end()) {
+            trans.visited_sites.insert(site_id);
+        }
     }
+    _collecting = nullptr;
 
-    if (success) {
-        for (siteid_t site_id : _item_sites[item_id]) {
-            if (!_site_status[site_id]) {
-                // this site is down, try next one
-                continue;
-            }
+    if (std::find(multi.read_sites.begin(), multi.read_sites.end(), 0) != multi.read_sites.end()) {
+        // the locks granted so far are kept, the rest is retried later
+        return false;
+    }
+
+    // the whole range has been read, report it in item order
+    for (size_t i = 0; i < multi.items.size(); ++i) {
+        ReceiveReadResponse(multi.items[i], multi.read_sites[i], multi.values[i]);
+    }
+    return true;
+}
 
-            DM[site_id]->Write(op);
-            _trans_table[trans_id].visited_sites.insert(site_id);
+bool
+TransMng::WriteMulti(op_t op) {
+    multi_op_t &multi = _multi_ops[op.op_id];
+    std::vector<bool> success = BroadcastWrites(multi.items);
+    if (std::find(success.begin(), success.end(), false) != success.end()) {
+        // the replicas that granted some of the items already hold their new values, the whole op is retried
+        if (_read_cache) {
+            for (const op_t &item : multi.items) {
+                _trans_table[op.trans_id].cache.erase(item.param.w_param.item_id);
+            }
         }
+        return false;
     }
 
-    return success;
+    for (const op_t &item : multi.items) {
+        AckWrite(item);
+    }
+    return true;
 }
 
 
-namespace {
-    // dfs-based cycle detector
-    bool dfs_cycle(transid_t curr,
-                   transid_t root,
-                   std::unordered_map<transid_t, std::unordered_set<transid_t>> &graph,
-                   std::unordered_set<transid_t> &mark_global) {
-        mark_global.insert(curr);
-        for (transid_t child : graph[curr]) {
-            if (child == root) {
-                return true;
+// The transactions on a cycle: the members of the strongly connected components of more than one transaction,
+// and the ones that wait for themselves. Tarjan's algorithm without recursion, the graph may be large
+std::unordered_set<transid_t>
+TransMng::OnCycle(const waits_for_t &graph) {
+    static const std::unordered_set<transid_t> no_edges;
+    struct frame_t {
+        transid_t node;
+        std::unordered_set<transid_t>::const_iterator next;
+        std::unordered_set<transid_t>::const_iterator end;
+    };
+
+    std::unordered_set<transid_t> cyclic;
+    std::unordered_map<transid_t, int> index;
+    std::unordered_map<transid_t, int> low;
+    std::vector<transid_t> stack;
+    std::unordered_set<transid_t> on_stack;
+    std::vector<frame_t> frames;
+    auto visit = [&](transid_t node) {
+        int order = static_cast<int>(index.size());
+        index[node] = order;
+        low[node] = order;
+        stack.push_back(node);
+        on_stack.insert(node);
+        auto it = graph.find(node);
+        const std::unordered_set<transid_t> &edges = it == graph.end() ? no_edges : it->second;
+        frames.push_back(frame_t{node, edges.begin(), edges.end()});
+    };
+
+    for (const auto &p : graph) {
+        if (index.count(p.first)) {
+            continue;
+        }
+        visit(p.first);
+        while (!frames.empty()) {
+            frame_t &frame = frames.back();
+            transid_t node = frame.node;
+            if (frame.next != frame.end) {
+                transid_t child = *frame.next++;
+                if (child == node) {
+                    cyclic.insert(node);
+                } else if (!index.count(child)) {
+                    visit(child);
+                } else if (on_stack.count(child)) {
+                    low[node] = std::min(low[node], index[child]);
+                }
+                continue;
             }
-            if (!mark_global.count(child)) {
-                if (dfs_cycle(child, root, graph, mark_global)) {
-                    return true;
+
+            // all its children are done, it is the root of a component if nothing below reaches higher up
+            frames.pop_back();
+            if (low[node] == index[node]) {
+                size_t first = stack.size() - 1;
+                while (stack[first] != node) {
+                    --first;
                 }
+                bool cycle = stack.size() - first > 1;
+                for (size_t i = first; i < stack.size(); ++i) {
+                    on_stack.erase(stack[i]);
+                    if (cycle) {
+                        cyclic.insert(stack[i]);
+                    }
+                }
+                stack.resize(first);
+            }
+            if (!frames.empty()) {
+                transid_t parent = frames.back().node;
+                low[parent] = std::min(low[parent], low[node]);
             }
         }
-        return false;
     }
+    return cyclic;
 }
 
 bool
 TransMng::DetectDeadLock() {
 
     // 1. get all the locks waiting graphs from the DMs
-    std::unordered_map<siteid_t, std::unordered_set<siteid_t>> waiting_graph;
+    waits_for_t waiting_graph;
     for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
         if (_site_status[site_id]) {
 
             // get the waiting graph from each site
-            auto site_waiting_graph = DM[site_id]->GetWaitingGraph();
+            auto site_waiting_graph = _sites[site_id]->GetWaitingGraph();
 
             // now merge the graphs
             for (auto &p : site_waiting_graph) {
@@ -579,24 +2510,56 @@ TransMng::DetectDeadLock() {
         }
     }
 
+    // the sites are shared with other TMs: report the waits of our own transactions, the coordinator merges them with
+    // theirs and picks the victim
+    if (_coordinator != nullptr) {
+        waits_for_t waits;
+        std::unordered_map<transid_t, timestamp_t> starts;
+        for (const auto &p : waiting_graph) {
+            auto it = _trans_table.find(p.first);
+            if (it != _trans_table.end()) {
+                waits[p.first] = p.second;
+                starts[p.first] = it->second.start_ts;
+            }
+        }
+        transid_t victim = _coordinator->MergeWaits(_partition, waits, starts);
+        if (victim < 0) {
+            return false;
+        }
+        abort_victim(victim);
+        return true;
+    }
+
     // 2. find the oldest transaction that in a cycle
     int oldest = -1;
     siteid_t oldest_transid = -1;
+    std::unordered_set<transid_t> cyclic = OnCycle(waiting_graph);
     for (const auto &p : waiting_graph) {
-        std::unordered_set<transid_t> mark_global;
-        if (oldest < _trans_table[p.first].start_ts &&
-            dfs_cycle(p.first, p.first, waiting_graph, mark_global)) {
-
-            oldest = _trans_table[p.first].start_ts;
+        if (!cyclic.count(p.first)) {
+            continue;
+        }
+        // among transactions that began in the same tick, the highest id goes, like MergeWaits
+        timestamp_t start_ts = _trans_table[p.first].start_ts;
+        if (oldest < start_ts || (oldest == start_ts && p.first > oldest_transid)) {
+            oldest = start_ts;
             oldest_transid = p.first;
         }
     }
 
     if (oldest_transid != -1) {
-        std::cout << "Transaction T" << oldest_transid << " aborted because of deadlock\n";
-        Abort(oldest_transid);
+        abort_victim(oldest_transid);
         return true;
     }
 
     return false;
 }
+
+void
+TransMng::abort_victim(transid_t trans_id) {
+    OutFor(trans_id) << "Transaction T" << trans_id << " aborted because of deadlock\n";
+    if (_tracer != nullptr) {
+        _tracer->TransEvent(trans_id, "deadlock victim");
+    }
+    Abort(trans_id, "deadlock");
+    _admission_stats.deadlock_aborts++;
+}
@@ -7,55 +7,530 @@
 #pragma once
 
 #include"Common.h"
+#include"DataSite.h"
+#include"Arena.h"
+#include"Tracer.h"
+#include<chrono>
 #include<unordered_map>
 #include<unordered_set>
+#include<deque>
+#include<functional>
 #include<list>
+#include<climits>
+#include<map>
+#include<vector>
+#include<string>
+#include<istream>
+#include<ostream>
 
-class TransMng {
+// Decides where the events of a transaction (read results, commit and abort outcomes) are reported
+class TransRouter {
 public:
-    TransMng();
+    virtual ~TransRouter() {}
+
+    virtual std::ostream &Output(transid_t trans_id) = 0;
+};
+
+// Who waits for whom: a transaction and the transactions it waits for
+typedef std::unordered_map<transid_t, std::unordered_set<transid_t>> waits_for_t;
+
+// Couples the TMs that share their sites, each owning a partition of the transaction ids (see Partition.h)
+class TransCoordinator {
+public:
+    virtual ~TransCoordinator() {}
+
+    // Start a round: start_round gets the tick of the round and installs its commits. Once a TM has its tick, the
+    // commits of the earlier ticks are in place on the sites
+    virtual void NextTick(const std::function<void(timestamp_t)> &start_round) = 0;
+
+    // The waits-for edges of the transactions of this partition (waiter -> holders) and when they began, merged with
+    // those of the other partitions. Ret: a victim of this partition to abort, -1 if none (a victim of another
+    // partition is handed to its TM)
+    virtual transid_t MergeWaits(int partition, const waits_for_t &waits,
+                                 const std::unordered_map<transid_t, timestamp_t> &starts) = 0;
+};
+
+// What the admission control saw, see TransMng::SetAdmissionControl
+struct admission_stats_t {
+    long commits;
+    long deadlock_aborts;
+    long failure_aborts;
+    // begin() of read-write transactions that had to wait for a slot
+    long deferred_begins;
+    // the lock wait depth (queued ops) sampled once per tick
+    long wait_depth_sum;
+    long wait_depth_samples;
+    // the current cap and how many times it was cut
+    int cap;
+    long cap_cuts;
+
+    admission_stats_t() {
+        commits = 0;
+        deadlock_aborts = 0;
+        failure_aborts = 0;
+        deferred_begins = 0;
+        wait_depth_sum = 0;
+        wait_depth_samples = 0;
+        cap = 0;
+        cap_cuts = 0;
+    }
+};
+
+// What the embedded transactions did, see TransMng::BeginTx
+struct tx_stats_t {
+    // ops done, and how many times ops were tried (the first try included)
+    long ops;
+    long attempts;
+    // parked ops woken up to be tried again
+    long wakeups;
+
+    tx_stats_t() {
+        ops = 0;
+        attempts = 0;
+        wakeups = 0;
+    }
+};
+
+// What a transaction went through from begin() to its commit or abort, see TransMng::SetTransStats
+struct trans_report_t {
+    transid_t trans_id;
+    bool is_ronly;
+    bool committed;
+    // why it aborted: "deadlock", "site failure" or "disconnected", empty if it committed
+    std::string abort_reason;
+    timestamp_t begin_tick;
+    timestamp_t end_tick;
+    double wall_us;
+    // how long its ops waited for a lock on any site, and on each site (for simplicity 1-indexed). An op waiting on
+    // several sites at once counts once in the total, and on each of them
+    timestamp_t lock_wait_ticks;
+    double lock_wait_us;
+    timestamp_t lock_ticks[SITE_COUNT + 1];
+    double lock_us[SITE_COUNT + 1];
+    // how long its ops waited because no replica was up or readable
+    timestamp_t replica_ticks;
+    double replica_us;
+    // tries of its ops after a failed one
+    long retries;
+
+    trans_report_t() {
+        trans_id = 0;
+        is_ronly = false;
+        committed = false;
+        begin_tick = 0;
+        end_tick = 0;
+        wall_us = 0;
+        lock_wait_ticks = 0;
+        lock_wait_us = 0;
+        for (int i = 0; i <= SITE_COUNT; ++i) {
+            lock_ticks[i] = 0;
+            lock_us[i] = 0;
+        }
+        replica_ticks = 0;
+        replica_us = 0;
+        retries = 0;
+    }
+};
+
+class TransMng : public SiteListener {
+public:
+    // Everything the TM and its sites report is written to out
+    TransMng(std::ostream &out);
+
+    // Connect a site, all of them must be attached before the simulation starts
+    void AttachSite(siteid_t site_id, DataSite *site);
 
     // The main simulation loop
     void Simulate(std::istream &inputs);
 
+    // One tick of the loop, driven by the caller: StartTick() then RunTick() with the line of this tick
+    void StartTick();
+
+    void RunTick(const std::string &line);
+
     // The response of a read operation
-    void ReceiveReadResponse(op_t op, siteid_t site_id, int value);
+    void ReceiveReadResponse(op_t op, siteid_t site_id, int value) override;
 
     // The response of a write operation
-    void ReceiveWriteResponse(op_t op, siteid_t site_id);
+    void ReceiveWriteResponse(op_t op, siteid_t site_id) override;
+
+    // Send consecutive writes of one transaction to each site as a single batched request
+    void SetWriteBatching(bool enabled);
+
+    // Answer the repeated reads of a transaction from what it already read or wrote (the default)
+    void SetReadCache(bool enabled);
+
+    // Reads answered without asking a site
+    long CacheHits() const;
+
+    // Serve the reads of read-only transactions from a snapshot cache shared by all the ones that began in the same
+    // tick (the default). An entry is kept while such a transaction is active
+    void SetSnapshotCache(bool enabled);
+
+    // Reads of read-only transactions answered from the snapshot cache, and the ones that had to ask a site
+    long SnapshotHits() const;
+
+    long SnapshotMisses() const;
+
+    // dump() writes every site to this file instead of printing it, empty to print (the default). Each site writes
+    // its part on a thread of its own, at the tick of the dump, then the parts are appended in site order. The file
+    // is created by the first dump of the run, the next ones are appended to it
+    void SetDumpExport(const std::string &path, dump_format_t format);
+
+    // Print the "Time Tick" banner at the start of each tick
+    void SetTickBanner(bool enabled);
+
+    // Exit on an invalid command (the default), or report it and go on with the next one
+    void SetStrictCommands(bool strict);
+
+    // The invalid commands reported and skipped so far (never strict)
+    long InvalidCommands() const;
+
+    // Report transaction events through the router instead of the output stream
+    void SetRouter(TransRouter *router);
+
+    // Free running: ignore the line structure, every command is an event of its own with its own timestamp.
+    // A new op is tried right away, the queue is retried only when a lock is released or a site recovers
+    void SetFreeRunning(bool enabled);
+
+    // Free running: detect deadlocks every this many events while ops are queued, 0 to disable
+    void SetDeadlockInterval(int events);
+
+    // Free running: detect deadlocks once ops have waited this many events, 0 to disable
+    void SetDeadlockThreshold(int events);
+
+    // The order in which queued ops are retried and lock requests are queued on the sites (FIFO by default)
+    void SetSchedPolicy(sched_policy_t policy);
+
+    // Record how long each op waited in the queue, see OpWaits
+    void SetWaitStats(bool enabled);
+
+    // The wait in ticks of each op done so far, by the priority of its transaction
+    const std::map<int, std::vector<timestamp_t>> &OpWaits() const;
+
+    // Record the latency and the waits of every transaction, see TransReports
+    void SetTransStats(bool enabled);
+
+    // The transactions that committed or aborted so far, in the order they ended
+    const std::vector<trans_report_t> &TransReports() const;
+
+    // Count and latency percentiles of the ended transactions, read-write and read-only apart
+    void PrintTransSummary(std::ostream &out) const;
+
+    // One line per ended transaction, with a header
+    void WriteTransCsv(std::ostream &out) const;
+
+    // Admission control: at most a cap of read-write transactions run at once, a new one waits at begin() (its ops
+    // stay queued, and so does its end()) until a slot frees up. The cap is tuned every few ticks: halved when the
+    // deadlock aborts spike or the lock waits pile up, one more otherwise while transactions wait for a slot
+    void SetAdmissionControl(bool enabled);
+
+    const admission_stats_t &AdmissionStats() const;
+
+    //------------- Embedded transactions ------------------------
+    // Transactions driven from C++ instead of commands, TxCoro.h wraps them into coroutines. Their ops do not go to
+    // the queue: an op that has to wait is parked, and tried again only once a site grants one of its lock requests,
+    // its transaction aborts, or a site fails or recovers. done runs when the op is over, maybe before the call
+    // returns: ok is false if the transaction aborted, value is what a read returned. Reads and writes are not
+    // reported to the output, the outcome of the transaction is. A transaction runs one op at a time
+    typedef std::function<void(bool ok, int value)> tx_done_t;
+
+    void BeginTx(transid_t trans_id, bool is_ronly);
+
+    void ReadTx(transid_t trans_id, itemid_t item_id, tx_done_t done);
+
+    void WriteTx(transid_t trans_id, itemid_t item_id, int value, tx_done_t done);
+
+    // end(): done runs once the transaction committed, with the group of the next Pump(), or right away if it aborted
+    void EndTx(transid_t trans_id, tx_done_t done);
+
+    // One round: commit the ended transactions, then try the woken ops again. Deadlocks are detected when there is
+    // nothing else to do, and every SetDeadlockInterval rounds if set. Ret: false if nothing happened, the parked ops
+    // (if any) wait for a site to recover
+    bool Pump();
+
+    const tx_stats_t &TxStats() const;
+
+    // A lock request of the transaction may be granted now
+    void ReceiveLockGrant(transid_t trans_id, siteid_t site_id) override;
+
+    // A lock request of the transaction has to wait on the site
+    void ReceiveLockWait(transid_t trans_id, siteid_t site_id) override;
+
+    // Record the transactions, ops, deadlock victims and site failures on the timeline, null to stop (the default)
+    void SetTracer(Tracer *tracer);
+
+    //------------- Partitioned TMs -------------------------------
+    // This TM is one of several sharing their sites, partition is its index (see Partition.h). The rounds of Pump()
+    // take their ticks from the coordinator, and the deadlocks are looked for across all of them. Null: on its own
+    void SetCoordinator(TransCoordinator *coordinator, int partition);
+
+    // The coordinator picked this transaction as a deadlock victim: abort it, unless it ended or no longer waits
+    // Ret: true if it was aborted
+    bool AbortDeadlockVictim(transid_t trans_id);
+
+    // The transactions on a cycle of the graph
+    static std::unordered_set<transid_t> OnCycle(const waits_for_t &graph);
+
+    //------------- Queries for the server ------------------------
+    bool IsActive(transid_t trans_id) const;
+
+    size_t QueuedOps(transid_t trans_id) const;
+
+    bool HasQueuedOps() const;
+
+    // The client of this transaction went away, abort and forget it
+    void Disconnect(transid_t trans_id);
 
 private:
     //------------- Basic stuffs goes here -----------------------
+    std::ostream &_out;
     timestamp_t _now;
     opid_t _next_opid;
+    bool _batch_writes;
+    bool _read_cache;
+    long _cache_hits;
+    bool _tick_banner;
+    bool _strict_commands;
+    long _invalid_commands;
+    TransRouter *_router;
+    Tracer *_tracer;
+    TransCoordinator *_coordinator;
+    int _partition;
+    // the last round did nothing
+    bool _idle_round;
+
+    //------------- Free running ---------------------------------
+    bool _free_running;
+    int _deadlock_interval;
+    int _deadlock_threshold;
+    timestamp_t _last_detection;
+    // when the ops started to wait, -1 if the queue is empty
+    timestamp_t _wait_since;
+    // a lock was released or a site recovered since the last retry of the queue
+    bool _queue_dirty;
+    // ops at the tail of the queue that were not tried yet
+    size_t _fresh_ops;
+
+    //------------- Scheduling -----------------------------------
+    sched_policy_t _sched_policy;
+    bool _wait_stats;
+    // when each queued op was first tried
+    std::unordered_map<opid_t, timestamp_t> _op_since;
+    std::map<int, std::vector<timestamp_t>> _op_waits;
+
+    //------------- Transaction stats ----------------------------
+    typedef std::chrono::steady_clock::time_point wall_time_t;
+
+    // an op that failed its last try: since when it waits, and the sites its lock requests wait on (bit i for
+    // site i), none if no replica could serve it
+    struct blocked_op_t {
+        opid_t op_id;
+        timestamp_t since;
+        wall_time_t since_wall;
+        unsigned lock_sites;
+    };
+
+    struct trans_live_t {
+        trans_report_t report;
+        wall_time_t begin_wall;
+        std::vector<blocked_op_t> blocked;
+    };
+
+    bool _trans_stats;
+    std::unordered_map<transid_t, trans_live_t> _trans_live;
+    std::vector<trans_report_t> _trans_reports;
+    // the reports of the transactions waiting for the group commit, with when they began
+    std::vector<std::pair<size_t, wall_time_t>> _commit_reports;
+    // the sites that made the op being tried wait for a lock
+    unsigned _try_lock_sites;
+
+    //------------- Admission control ----------------------------
+    bool _admission;
+    // read-write transactions holding a slot
+    int _admitted_rw;
+    // the transactions waiting for a slot, in the order of their begin()
+    std::deque<transid_t> _admit_queue;
+    // end() of transactions that still wait for a slot or for their ops
+    std::vector<transid_t> _deferred_ends;
+    admission_stats_t _admission_stats;
+    // the stats at the start of the current window, and whether someone waited for a slot since then
+    admission_stats_t _window_stats;
+    timestamp_t _window_start;
+    bool _window_saturated;
+
+    //------------- Embedded transactions ------------------------
+    struct parked_op_t {
+        op_t op;
+        tx_done_t done;
+        // in _woken already
+        bool woken;
+
+        parked_op_t(op_t _op, tx_done_t _done) : op(_op), done(_done) {
+            woken = false;
+        }
+    };
+    // the op each embedded transaction waits with, and the ones to try again in the next round
+    std::unordered_map<transid_t, parked_op_t> _parked;
+    std::vector<transid_t> _woken;
+    // end() of embedded transactions, waiting for their group commit and committed (done runs in the next round)
+    std::vector<std::pair<transid_t, tx_done_t>> _commit_waiters;
+    std::vector<std::pair<transid_t, tx_done_t>> _committed;
+    // an embedded op is running: what a read returns goes to _tx_value instead of the output
+    bool _in_tx_op;
+    int _tx_value;
+    tx_stats_t _tx_stats;
+
+    std::ostream &OutFor(transid_t trans_id);
 
     //------------- Site Status ----------------------------------
     // For simplicity we deal with the annoying 1-index here
     bool _site_status[SITE_COUNT + 1];
-
-    std::unordered_map<itemid_t, std::list<siteid_t>> _item_sites;
+    // a recovered site may hold unreadable replicated items, which the TM does not track
+    bool _site_recovered[SITE_COUNT + 1];
+    DataSite *_sites[SITE_COUNT + 1];
 
     //------------- Active Transaction Table ---------------------
+    // The bookkeeping of each transaction lives in its own arena, released in one go at end()
+    ArenaPool _arena_pool;
+
+    // What a transaction read or wrote. Its next read of the item is answered from here, as long as the site
+    // the read would go to is known to grant it
+    struct cached_item_t {
+        int value;
+        // the site it read the item from, 0 if none
+        siteid_t read_site;
+        // bit i is set if it wrote the item on site i, and so holds its X lock there
+        unsigned written_sites;
+
+        cached_item_t() {
+            value = 0;
+            read_site = 0;
+            written_sites = 0;
+        }
+    };
+
     struct trans_table_item {
         timestamp_t start_ts;
         bool is_ronly;
         bool will_abort;
         bool waiting_commit;
-        std::unordered_set<siteid_t> visited_sites;
+        // ops of this transaction in _queued_ops
+        int queued_ops;
+        // ops of this transaction done so far
+        int done_ops;
+        // given by beginP
+        int priority;
+        // the rank the sites were told about, see sync_ranks
+        int sent_rank;
+        // admission control: it got in, and counts against the cap
+        bool admitted;
+        bool holds_slot;
+        Arena *arena;
+        arena_set<siteid_t> visited_sites;
+        arena_map<itemid_t, cached_item_t> cache;
 
-        trans_table_item() {}
+        trans_table_item() {
+            start_ts = 0;
+            is_ronly = false;
+            will_abort = false;
+            waiting_commit = false;
+            queued_ops = 0;
+            done_ops = 0;
+            priority = 0;
+            sent_rank = RANK_UNSENT;
+            admitted = true;
+            holds_slot = false;
+            arena = nullptr;
+        }
 
-        trans_table_item(timestamp_t ts, bool ronly) {
+        trans_table_item(timestamp_t ts, bool ronly, int _priority, Arena *_arena)
+                : visited_sites(0, std::hash<siteid_t>(), std::equal_to<siteid_t>(),
+                                arena_allocator<siteid_t>(_arena)),
+                  cache(0, std::hash<itemid_t>(), std::equal_to<itemid_t>(),
+                        arena_allocator<std::pair<const itemid_t, cached_item_t>>(_arena)) {
             start_ts = ts;
             is_ronly = ronly;
             will_abort = false;
+            waiting_commit = false;
+            queued_ops = 0;
+            done_ops = 0;
+            priority = _priority;
+            sent_rank = RANK_UNSENT;
+            admitted = true;
+            holds_slot = false;
+            arena = _arena;
         }
+
+        static const int RANK_UNSENT = INT_MIN;
     };
 
     std::unordered_map<transid_t, trans_table_item> _trans_table;
 
     // Queued Ops and Finished ops - recall that there could be no available sites
-    std::list<op_t> _queued_ops;
+    NodePool _node_pool;
+    pool_list<op_t> _queued_ops;
+
+    // The items of the RR/MW op with this op id, sorted by item id. The queue holds a single op for all of them,
+    // it is done once every item has been locked on every site it needs
+    struct multi_op_t {
+        std::vector<op_t> items;
+
+        // RR: the site each item has been read from so far (0 if not yet) and the value it returned
+        std::vector<siteid_t> read_sites;
+        std::vector<int> values;
+    };
+    std::unordered_map<opid_t, multi_op_t> _multi_ops;
+
+    // while an RR runs, the read responses of its items are kept here instead of being reported
+    multi_op_t *_collecting;
+
+    // What the sites answer to a read-only read of an item at a snapshot tick. It is fixed once that tick is over:
+    // commits and failures after it do not change which versions a site serves at it
+    struct snapshot_item_t {
+        int value;
+        // bit i is set if site i is known to serve it, or known to refuse it (it failed since that version)
+        unsigned served_sites;
+        unsigned refused_sites;
+
+        snapshot_item_t() {
+            value = 0;
+            served_sites = 0;
+            refused_sites = 0;
+        }
+    };
+
+    // The snapshot of a tick, filled by the reads of the read-only transactions that began in it
+    struct snapshot_cache_t {
+        // active read-only transactions that began in this tick
+        int refs;
+        std::unordered_map<itemid_t, snapshot_item_t> items;
+
+        snapshot_cache_t() {
+            refs = 0;
+        }
+    };
+
+    bool _snapshot_cache;
+    std::unordered_map<timestamp_t, snapshot_cache_t> _snapshots;
+    long _snapshot_hits;
+    long _snapshot_misses;
+    // the value the last read-only read got from a site
+    int _ronly_value;
+
+    // dump() export, see SetDumpExport
+    std::string _dump_path;
+    dump_format_t _dump_format;
+    // the export file has been created
+    bool _dump_started;
+
+    // The sites that applied each INC op so far (bit i for site i). A retry only goes to the others, the delta must
+    // not be added twice
+    std::unordered_map<opid_t, unsigned> _inc_sites;
+
+    // Group commit - transactions that ended in the current tick, in the order of their end().
+    // They are committed on every site in one batch by FlushCommits()
+    std::vector<transid_t> _pending_commits;
 
     //--------------------tester cause events----------------------
     void Fail(siteid_t site_id);
@@ -68,22 +543,114 @@ private:
 
     void DumpItem(itemid_t item_id);
 
+    // dump() into the export file, see SetDumpExport
+    void ExportAll();
+
     //-----------------transaction execution events----------------
     bool DetectDeadLock();
 
+    // Abort the victim of a deadlock
+    void abort_victim(transid_t trans_id);
+
     void TryExecuteQueue();
 
+    // The place of a transaction under the scheduling policy, lower first
+    int rank_of(transid_t trans_id) const;
+
+    // Tell the up sites about the ranks that changed since the last time
+    void sync_ranks();
+
+    // Record the wait of an op leaving the queue
+    void note_op_done(op_t op, int priority);
+
+    // An op of the transaction is about to be tried, its wait so far is over
+    void note_try(const op_t &op);
+
+    // The op was tried, it waits from now on unless done
+    void note_tried(const op_t &op, bool done);
+
+    // Charge the wait of a blocked op up to now
+    void charge_wait(trans_report_t &report, const blocked_op_t &blocked);
+
+    // ... of every blocked op of the transaction
+    void settle_blocked(trans_live_t &live);
+
+    // The transaction ended: keep its report, the end of a commit is set by FlushCommits
+    void close_report(transid_t trans_id, bool committed);
+
+    // Admission control, once per tick: tune the cap, let waiting transactions in and run their deferred end()
+    void RunAdmission();
+
+    void adapt_cap();
+
+    // The transaction no longer counts against the cap
+    void release_slot(trans_table_item &trans);
+
+    // A read-only transaction that began in this tick ended, the snapshot goes once nobody reads it any more
+    void release_snapshot(timestamp_t start_ts);
+
+    // Run an embedded op, or park it if it has to wait
+    void run_tx(op_t op, tx_done_t done);
+
+    // Try the parked op of the transaction again in the next round
+    void wake(transid_t trans_id);
+
+    // reads_only: only the parked reads, which may wait for an item to become readable
+    void wake_all(bool reads_only);
+
+    bool ExecuteOp(op_t op);
+
     void ExecuteCommand(std::string line);
 
-    void Begin(transid_t trans_id, bool is_ronly);
+    void RunCommand(const std::string &command);
+
+    void SimulateFree(std::istream &inputs);
+
+    // more_writes: the next command is a write of the same transaction, hold the write back to batch them
+    void RunEvent(const std::string &command, bool more_writes);
+
+    void TryExecuteFresh();
+
+    void Begin(transid_t trans_id, bool is_ronly, int priority);
 
     void Finish(transid_t trans_id);
 
-    void Abort(transid_t trans_id);
+    void FlushCommits();
+
+    // reason: why, for the transaction stats
+    void Abort(transid_t trans_id, const char *reason);
 
     bool Read(op_t op);
 
+    // Answer a read from the cache of its transaction, Ret: false if it has to go to a site
+    bool ReadCached(op_t op);
+
     bool Ronly(op_t op);
 
     bool Write(op_t op);
+
+    std::vector<bool> WriteBatch(const std::vector<op_t> &ops);
+
+    // Lock and write every op on all the up replicas, one request per site. Ret: whether each op has been granted
+    // by all of them
+    std::vector<bool> BroadcastWrites(const std::vector<op_t> &ops);
+
+    // Report a write every replica has granted
+    void AckWrite(op_t op);
+
+    // INC: lock and add the delta on all the up replicas that are readable, Ret: true once all of them have done
+    // it, and there was at least one
+    bool Increment(op_t op);
+
+    // RR: read all the items of the op, Ret: true once all of them have been read
+    bool ReadRange(op_t op);
+
+    // MW: write all the items of the op, Ret: true once all of them have been written
+    bool WriteMulti(op_t op);
+
+    // SUM/SCAN of a read-only transaction at its snapshot, Ret: true once every item has been served
+    bool Scan(op_t op);
+
+    // Queue an RR or MW of items (in any order, op type and trans id already set)
+    void QueueMulti(op_t op, std::vector<op_t> items);
 };
@@ -0,0 +1,141 @@
+/**
+ * Date: 2026-10-18
+ * Description: C++20 coroutines on top of the embedded transactions of the TM (see TransMng::BeginTx). A transaction
+ * program co_awaits its reads and writes, it is suspended while an op is parked and resumed by TransMng::Pump() once
+ * the op is done. This header needs C++20, the rest of the tree does not include it.
+ *
+**/
+#pragma once
+
+#include"Common.h"
+#include"TransMng.h"
+#include<coroutine>
+#include<exception>
+
+// A coroutine that starts right away and frees itself once it returns
+struct tx_program_t {
+    struct promise_type {
+        tx_program_t get_return_object() {
+            return tx_program_t();
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {
+        }
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+// What co_await of an op gives back: ok is false once the transaction aborted, value is what a read returned
+struct tx_result_t {
+    bool ok;
+    int value;
+};
+
+// One op of a transaction, suspends the caller unless the op is done right away
+class TxOp {
+public:
+    enum kind_t {
+        TX_READ,
+        TX_WRITE,
+        TX_END
+    };
+
+    TxOp(TransMng &tm, kind_t kind, transid_t trans_id, itemid_t item_id, int value) : _tm(tm) {
+        _kind = kind;
+        _trans_id = trans_id;
+        _item_id = item_id;
+        _value = value;
+        _suspended = false;
+        _done = false;
+        _result.ok = false;
+        _result.value = 0;
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // Ret: false if the op is already done, the caller goes on without suspending
+    bool await_suspend(std::coroutine_handle<> handle) {
+        _handle = handle;
+        TransMng::tx_done_t done = [this](bool ok, int value) {
+            _result.ok = ok;
+            _result.value = value;
+            if (_suspended) {
+                _handle.resume();
+            } else {
+                _done = true;
+            }
+        };
+        switch (_kind) {
+            case TX_READ:
+                _tm.ReadTx(_trans_id, _item_id, done);
+                break;
+            case TX_WRITE:
+                _tm.WriteTx(_trans_id, _item_id, _value, done);
+                break;
+            case TX_END:
+                _tm.EndTx(_trans_id, done);
+                break;
+        }
+        _suspended = !_done;
+        return _suspended;
+    }
+
+    tx_result_t await_resume() const noexcept {
+        return _result;
+    }
+
+private:
+    TransMng &_tm;
+    kind_t _kind;
+    transid_t _trans_id;
+    itemid_t _item_id;
+    int _value;
+
+    std::coroutine_handle<> _handle;
+    bool _suspended;
+    bool _done;
+    tx_result_t _result;
+};
+
+// A transaction, begun when it is made: co_await tx.read(x), tx.write(x, v), then tx.commit()
+class Tx {
+public:
+    Tx(TransMng &tm, transid_t trans_id, bool is_ronly = false) : _tm(tm) {
+        _trans_id = trans_id;
+        _tm.BeginTx(trans_id, is_ronly);
+    }
+
+    TxOp read(itemid_t item_id) {
+        return TxOp(_tm, TxOp::TX_READ, _trans_id, item_id, 0);
+    }
+
+    TxOp write(itemid_t item_id, int value) {
+        return TxOp(_tm, TxOp::TX_WRITE, _trans_id, item_id, value);
+    }
+
+    // end(), ok is true if it committed
+    TxOp commit() {
+        return TxOp(_tm, TxOp::TX_END, _trans_id, 0, 0);
+    }
+
+    transid_t id() const {
+        return _trans_id;
+    }
+
+private:
+    TransMng &_tm;
+    transid_t _trans_id;
+};
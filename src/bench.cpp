@@ -0,0 +1,1476 @@
+/**
+ * Date: 2026-10-18
+ * Description: Microbenchmarks of the lock manager, commit/abort, lock escalation, deadlock detection, read-only reads,
+ * the cold tier of the versions, snapshot aggregates, recovery, dump() and its export, startup, the scheduling
+ * policies, admission control, hot counters, fail/recover churn, the TM read cache, the TM snapshot cache and the
+ * multi-item commands.
+ * Everything runs in this process against DataMng/TransMng directly, and the results are written as JSON so that
+ * they can be compared between releases. This target is built with a larger ITEM_COUNT (see CMakeLists.txt).
+ *
+ * usage: repcrec_bench [--filter <substring>] [--min-time <ms>] [--chaos-rate <n>] [--chaos-down <ticks>]
+ *                      [--out <file>]
+**/
+#include "DataMng.h"
+#include "TransMng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <malloc.h>
+
+// every heap allocation of the process is counted, from any thread, and so are the bytes in use
+static std::atomic<unsigned long> alloc_count(0);
+static std::atomic<unsigned long> alloc_bytes(0);
+static std::atomic<long> live_bytes(0);
+
+void *operator new(size_t size) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    void *p = std::malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    live_bytes.fetch_add(static_cast<long>(malloc_usable_size(p)), std::memory_order_relaxed);
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p != nullptr) {
+        live_bytes.fetch_sub(static_cast<long>(malloc_usable_size(p)), std::memory_order_relaxed);
+    }
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    operator delete(p);
+}
+
+namespace {
+    typedef std::chrono::steady_clock bench_clock;
+
+    // results are thrown away
+    class NullListener : public SiteListener {
+    public:
+        void ReceiveReadResponse(op_t /*op*/, siteid_t /*site_id*/, int /*value*/) override {}
+
+        void ReceiveWriteResponse(op_t /*op*/, siteid_t /*site_id*/) override {}
+    };
+
+    NullListener null_listener;
+    std::ostream null_out(nullptr);
+
+    struct result_t {
+        std::string name;
+        std::vector<std::pair<std::string, long>> params;
+        long iterations;
+        double ns_per_op;
+        std::vector<std::pair<std::string, double>> counters;
+    };
+
+    struct bench_config_t {
+        std::string filter;
+        double min_time_ms;
+        // the chaos benchmark: site failures per 1000 ticks (-1 runs a few rates) and how long a site stays down
+        long chaos_rate;
+        long chaos_down;
+    };
+
+    bench_config_t config;
+    std::vector<result_t> results;
+
+    bool selected(const std::string &name) {
+        return config.filter.empty() || name.find(config.filter) != std::string::npos;
+    }
+
+    void record(const std::string &name, const std::vector<std::pair<std::string, long>> &params,
+                long iterations, double total_ns) {
+        result_t result;
+        result.name = name;
+        result.params = params;
+        result.iterations = iterations;
+        result.ns_per_op = total_ns / iterations;
+        results.push_back(result);
+        std::cerr << name;
+        for (const auto &p : params) {
+            std::cerr << " " << p.first << "=" << p.second;
+        }
+        std::cerr << ": " << result.ns_per_op << " ns/op\n";
+    }
+
+    // Time op as a whole, op must leave the state unchanged
+    void measure_loop(const std::string &name, const std::vector<std::pair<std::string, long>> &params,
+                      const std::function<void()> &op) {
+        long iterations = 0;
+        double total_ns = 0;
+        long batch = 1;
+        while (total_ns < config.min_time_ms * 1e6) {
+            auto start = bench_clock::now();
+            for (long i = 0; i < batch; ++i) {
+                op();
+            }
+            auto end = bench_clock::now();
+            total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+            iterations += batch;
+            batch *= 2;
+        }
+        record(name, params, iterations, total_ns);
+    }
+
+    // Only time op, setup prepares the state of each iteration. Gives up early if the setup dominates
+    void measure_each(const std::string &name, const std::vector<std::pair<std::string, long>> &params,
+                      const std::function<void(long)> &setup, const std::function<void(long)> &op) {
+        long iterations = 0;
+        double total_ns = 0;
+        auto first = bench_clock::now();
+        while (total_ns < config.min_time_ms * 1e6 &&
+               (iterations < 10 ||
+                std::chrono::duration<double, std::milli>(bench_clock::now() - first).count() <
+                10 * config.min_time_ms)) {
+            setup(iterations);
+            auto start = bench_clock::now();
+            op(iterations);
+            auto end = bench_clock::now();
+            total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+            iterations++;
+        }
+        record(name, params, iterations, total_ns);
+    }
+
+    op_t make_read(opid_t op_id, transid_t trans_id, itemid_t item_id, op_type_t op_type) {
+        op_param_t param;
+        param.r_param.item_id = item_id;
+        return op_t(op_id, trans_id, op_type, param);
+    }
+
+    op_t make_write(opid_t op_id, transid_t trans_id, itemid_t item_id, int value) {
+        op_param_t param;
+        param.w_param.item_id = item_id;
+        param.w_param.value = value;
+        return op_t(op_id, trans_id, OP_WRITE, param);
+    }
+
+    // every replicated item lives on site 1
+    const siteid_t SITE = 1;
+    const itemid_t HOT_ITEM = 2;
+
+    //----------------------------- lock manager ---------------------------------
+    // A writer holds the hot item and depth transactions wait behind it, alternating S and X.
+    // The requester is already queued, so this is what TryExecuteQueue pays on every tick
+    void bench_lock_queue() {
+        for (long depth : {0L, 4L, 64L, 1024L}) {
+            for (int is_write = 0; is_write < 2; ++is_write) {
+                std::string name = is_write ? "lock.write_queued" : "lock.read_queued";
+                if (!selected(name)) {
+                    continue;
+                }
+
+                DataMng dm(SITE, &null_listener, null_out);
+                dm.GetWriteLock(1, HOT_ITEM);
+                for (long i = 0; i < depth; ++i) {
+                    transid_t waiter = static_cast<transid_t>(2 + i);
+                    if (i % 2) {
+                        dm.GetWriteLock(waiter, HOT_ITEM);
+                    } else {
+                        dm.GetReadLock(waiter, HOT_ITEM);
+                    }
+                }
+
+                transid_t requester = static_cast<transid_t>(depth + 2);
+                measure_loop(name, {{"queue_depth", depth}}, [&]() {
+                    if (is_write) {
+                        dm.GetWriteLock(requester, HOT_ITEM);
+                    } else {
+                        dm.GetReadLock(requester, HOT_ITEM);
+                    }
+                });
+            }
+        }
+    }
+
+    // holders transactions share an S lock and the queue is empty, a new reader is granted
+    void bench_lock_grant() {
+        std::string name = "lock.read_granted";
+        if (!selected(name)) {
+            return;
+        }
+        for (long holders : {0L, 4L, 64L, 1024L}) {
+            DataMng dm(SITE, &null_listener, null_out);
+            for (long i = 0; i < holders; ++i) {
+                dm.GetReadLock(static_cast<transid_t>(1 + i), HOT_ITEM);
+            }
+
+            transid_t requester = static_cast<transid_t>(holders + 1);
+            measure_each(name, {{"holders", holders}}, [&](long) {
+                dm.Abort(requester);
+            }, [&](long) {
+                dm.GetReadLock(requester, HOT_ITEM);
+            });
+        }
+    }
+
+    //----------------------------- commit / abort -------------------------------
+    // A transaction writes locked_items replicated items of the site, then commits or aborts
+    void bench_commit_abort() {
+        for (long locked_items : {1L, 16L, 128L, static_cast<long>(ITEM_COUNT / 2)}) {
+            for (int is_commit = 0; is_commit < 2; ++is_commit) {
+                std::string name = is_commit ? "commit" : "abort";
+                if (!selected(name)) {
+                    continue;
+                }
+
+                DataMng dm(SITE, &null_listener, null_out);
+                measure_each(name, {{"locked_items", locked_items}}, [&](long iter) {
+                    transid_t trans_id = static_cast<transid_t>(iter + 1);
+                    std::vector<op_t> ops;
+                    for (long i = 0; i < locked_items; ++i) {
+                        itemid_t item_id = static_cast<itemid_t>(2 * (i + 1));
+                        ops.push_back(make_write(static_cast<opid_t>(i), trans_id, item_id, static_cast<int>(iter)));
+                    }
+                    dm.LockAndWriteBatch(ops);
+                }, [&](long iter) {
+                    transid_t trans_id = static_cast<transid_t>(iter + 1);
+                    if (is_commit) {
+                        dm.GroupCommit(std::vector<transid_t>(1, trans_id), static_cast<timestamp_t>(iter));
+                    } else {
+                        dm.Abort(trans_id);
+                    }
+                });
+            }
+        }
+    }
+
+    //----------------------------- lock escalation ------------------------------
+    // A bulk update writes items replicated items of a fresh site in one transaction, then commits.
+    // Timed is the commit, reported are also the lock phase and the lock table it leaves behind
+    void bench_escalation() {
+        std::string name = "escalation.bulk_update";
+        if (!selected(name)) {
+            return;
+        }
+        for (long items : {64L, 256L, static_cast<long>(ITEM_COUNT / 2)}) {
+            for (long threshold : {0L, 32L}) {
+                std::vector<op_t> ops;
+                for (long i = 0; i < items; ++i) {
+                    ops.push_back(make_write(static_cast<opid_t>(i), 1, static_cast<itemid_t>(2 * (i + 1)), 1));
+                }
+
+                long iterations = 0;
+                double commit_ns = 0, lock_ns = 0;
+                unsigned long lock_bytes = 0;
+                size_t entries = 0;
+                auto first = bench_clock::now();
+                while (commit_ns < config.min_time_ms * 1e6 &&
+                       (iterations < 10 ||
+                        std::chrono::duration<double, std::milli>(bench_clock::now() - first).count() <
+                        10 * config.min_time_ms)) {
+                    DataMng dm(SITE, &null_listener, null_out);
+                    dm.SetEscalationThreshold(static_cast<int>(threshold));
+
+                    unsigned long bytes_before = alloc_bytes;
+                    auto start = bench_clock::now();
+                    dm.LockAndWriteBatch(ops);
+                    auto locked = bench_clock::now();
+                    lock_bytes += alloc_bytes - bytes_before;
+                    entries = dm.LockTableSize();
+                    dm.GroupCommit(std::vector<transid_t>(1, 1), 1);
+                    auto end = bench_clock::now();
+
+                    lock_ns += std::chrono::duration<double, std::nano>(locked - start).count();
+                    commit_ns += std::chrono::duration<double, std::nano>(end - locked).count();
+                    iterations++;
+                }
+                record(name, {{"items", items}, {"escalate", threshold}}, iterations, commit_ns);
+                results.back().counters.push_back(std::make_pair("lock_ns", lock_ns / iterations));
+                results.back().counters.push_back(std::make_pair("lock_table_entries", double(entries)));
+                results.back().counters.push_back(std::make_pair("lock_bytes", double(lock_bytes) / iterations));
+                std::cerr << "  lock " << lock_ns / iterations << " ns, " << entries << " lock table entries, "
+                          << double(lock_bytes) / iterations << " bytes allocated\n";
+            }
+        }
+    }
+
+    //----------------------------- deadlock detection ---------------------------
+    // A site that only reports a prepared waits-for graph
+    class SyntheticSite : public DataSite {
+    public:
+        std::unordered_map<siteid_t, std::unordered_set<siteid_t>> graph;
+
+        void Fail(timestamp_t /*_ts*/) override {}
+
+        void Recover(timestamp_t /*_ts*/) override {}
+
+        void Dump() override {}
+
+        void DumpItem(itemid_t /*item_id*/) override {}
+
+        long Export(timestamp_t /*ts*/, const std::string &/*path*/, dump_format_t /*format*/) override { return 0; }
+
+        void Abort(transid_t trans_id) override {
+            graph.erase(trans_id);
+            for (auto &p : graph) {
+                p.second.erase(trans_id);
+            }
+        }
+
+        void SetTransRank(transid_t /*trans_id*/, int /*rank*/) override {}
+
+        bool GetReadLock(transid_t /*trans_id*/, itemid_t /*item_id*/) override { return false; }
+
+        bool Read(op_t /*op*/) override { return false; }
+
+        bool Ronly(op_t /*op*/, timestamp_t /*ts*/) override { return false; }
+
+        snapshot_t SnapshotScan(itemid_t /*first*/, itemid_t /*last*/, bool /*replicated*/, timestamp_t /*ts*/,
+                                bool /*with_values*/) override {
+            return snapshot_t();
+        }
+
+        std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) override {
+            return std::vector<bool>(ops.size(), false);
+        }
+
+        std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) override {
+            return std::vector<bool>(ops.size(), false);
+        }
+
+        inc_result_t LockAndIncrement(op_t /*op*/) override {
+            return INC_WAIT;
+        }
+
+        void GroupCommit(const std::vector<transid_t> &/*trans_ids*/, timestamp_t /*commit_time*/) override {}
+
+        std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() override {
+            return graph;
+        }
+    };
+
+    // Build a graph over [first, first + n): a chain (no deadlock), or a chain closed into a cycle.
+    // Each edge is reported by one site, round robin
+    void build_graph(SyntheticSite *sites, transid_t first, long n, bool cycle) {
+        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+            sites[site_id].graph.clear();
+        }
+        for (long i = 0; i + 1 < n; ++i) {
+            sites[1 + i % SITE_COUNT].graph[first + i].insert(static_cast<transid_t>(first + i + 1));
+        }
+        if (cycle && n > 1) {
+            sites[1 + (n - 1) % SITE_COUNT].graph[static_cast<transid_t>(first + n - 1)].insert(first);
+        }
+    }
+
+    // One tick of the TM with nothing queued: gather the graphs of all the sites and look for a cycle
+    void bench_deadlock() {
+        for (long n : {16L, 128L, 1024L}) {
+            for (int cycle = 0; cycle < 2; ++cycle) {
+                std::string name = cycle ? "deadlock.cycle" : "deadlock.chain";
+                if (!selected(name)) {
+                    continue;
+                }
+
+                SyntheticSite sites[SITE_COUNT + 1];
+                TransMng tm(null_out);
+                for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                    tm.AttachSite(site_id, &sites[site_id]);
+                }
+
+                // every iteration needs fresh transactions, the victims stay aborted
+                transid_t next_trans = 1;
+                measure_each(name, {{"transactions", n}}, [&](long) {
+                    // all the transactions begin in one tick
+                    build_graph(sites, next_trans, 0, false);
+                    std::stringstream begins;
+                    for (long i = 0; i < n; ++i) {
+                        begins << "begin(T" << next_trans + i << ");";
+                    }
+                    begins << "\n";
+                    tm.Simulate(begins);
+                    build_graph(sites, next_trans, n, cycle != 0);
+                    next_trans += static_cast<transid_t>(n);
+                }, [&](long) {
+                    std::stringstream empty;
+                    tm.Simulate(empty);
+                });
+            }
+        }
+    }
+
+    // Waits-for graph of a real site: every item is held by one writer with waiters queued behind it
+    void bench_waiting_graph() {
+        std::string name = "waiting_graph";
+        if (!selected(name)) {
+            return;
+        }
+        for (long items : {1L, 64L, static_cast<long>(ITEM_COUNT / 2)}) {
+            for (long waiters : {1L, 16L}) {
+                DataMng dm(SITE, &null_listener, null_out);
+                transid_t next_trans = 1;
+                for (long i = 0; i < items; ++i) {
+                    itemid_t item_id = static_cast<itemid_t>(2 * (i + 1));
+                    dm.GetWriteLock(next_trans++, item_id);
+                    for (long w = 0; w < waiters; ++w) {
+                        dm.GetWriteLock(next_trans++, item_id);
+                    }
+                }
+                measure_loop(name, {{"items", items}, {"waiters", waiters}}, [&]() {
+                    dm.GetWaitingGraph();
+                });
+            }
+        }
+    }
+
+    //----------------------------- read-only reads ------------------------------
+    // versions of the hot item are committed at 1..versions; read the newest one or the initial value
+    void bench_ronly() {
+        for (long versions : {1L, 100L, 10000L}) {
+            for (int oldest = 0; oldest < 2; ++oldest) {
+                std::string name = oldest ? "ronly.oldest" : "ronly.newest";
+                if (!selected(name)) {
+                    continue;
+                }
+
+                DataMng dm(SITE, &null_listener, null_out);
+                for (long v = 1; v <= versions; ++v) {
+                    std::vector<op_t> ops(1, make_write(0, static_cast<transid_t>(v), HOT_ITEM, static_cast<int>(v)));
+                    dm.LockAndWriteBatch(ops);
+                    dm.GroupCommit(std::vector<transid_t>(1, static_cast<transid_t>(v)),
+                                   static_cast<timestamp_t>(v));
+                }
+
+                op_t op = make_read(0, 0, HOT_ITEM, OP_RONLY);
+                timestamp_t ts = oldest ? 0 : static_cast<timestamp_t>(versions);
+                measure_loop(name, {{"versions", versions}}, [&]() {
+                    dm.Ronly(op, ts);
+                });
+            }
+        }
+    }
+
+    //----------------------------- tiered versions ---------------------------------
+    // A deep history: every item of a site has versions committed at 1..versions. All of them in memory (hot=0)
+    // against the newest few in memory and the rest in the cold tier. Reported is the heap the site holds, the bytes
+    // mapped by the cold tier, and the latency of a read-only read at the newest snapshot and at an old one
+    void bench_tiered() {
+        const long VERSIONS = 512;
+        for (long hot : {0L, 4L}) {
+            std::string name = "tiered.ronly";
+            if (!selected(name)) {
+                continue;
+            }
+            long heap_before = live_bytes.load();
+            DataMng *dm = new DataMng(SITE, &null_listener, null_out);
+            dm->SetColdTier("/tmp", static_cast<int>(hot));
+            std::vector<itemid_t> hosted;
+            for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
+                if (item_id % 2 == 0 || 1 + (item_id % 10) == SITE) {
+                    hosted.push_back(item_id);
+                }
+            }
+            for (long v = 1; v <= VERSIONS; ++v) {
+                std::vector<op_t> ops;
+                for (itemid_t item_id : hosted) {
+                    ops.push_back(make_write(0, static_cast<transid_t>(v), item_id, static_cast<int>(v)));
+                }
+                dm->LockAndWriteBatch(ops);
+                dm->GroupCommit(std::vector<transid_t>(1, static_cast<transid_t>(v)), static_cast<timestamp_t>(v));
+            }
+            double heap_mb = (live_bytes.load() - heap_before) / 1048576.0;
+            double cold_mb = dm->GetColdStore() != nullptr ? dm->GetColdStore()->MappedBytes() / 1048576.0 : 0;
+
+            for (long ago : {0L, VERSIONS / 2}) {
+                timestamp_t ts = static_cast<timestamp_t>(VERSIONS - ago);
+                size_t next = 0;
+                measure_loop(name, {{"versions", VERSIONS}, {"hot", hot}, {"ago", ago}}, [&]() {
+                    dm->Ronly(make_read(0, 0, hosted[next], OP_RONLY), ts);
+                    next = next + 1 < hosted.size() ? next + 1 : 0;
+                });
+                results.back().counters.push_back(std::make_pair("heap_mb", heap_mb));
+                results.back().counters.push_back(std::make_pair("cold_mb", cold_mb));
+                std::cerr << "  " << heap_mb << " MB of heap, " << cold_mb << " MB mapped\n";
+            }
+            delete dm;
+        }
+    }
+
+    //----------------------------- snapshot aggregates ------------------------------
+    // Sum of every replicated item at a snapshot, by SnapshotScan over the columns (scan=1) against one Ronly per
+    // item (scan=0). Every item has versions committed at 1..versions, the snapshot is the newest or the initial one
+    void bench_snapshot() {
+        for (long versions : {1L, 16L}) {
+            for (int oldest = 0; oldest < 2; ++oldest) {
+                std::string name = oldest ? "snapshot.sum_oldest" : "snapshot.sum_newest";
+                if (!selected(name)) {
+                    continue;
+                }
+
+                DataMng dm(SITE, &null_listener, null_out);
+                for (long v = 1; v < versions; ++v) {
+                    std::vector<op_t> ops;
+                    for (itemid_t item_id = 2; item_id <= ITEM_COUNT; item_id += 2) {
+                        ops.push_back(make_write(0, static_cast<transid_t>(v), item_id, static_cast<int>(v)));
+                    }
+                    dm.LockAndWriteBatch(ops);
+                    dm.GroupCommit(std::vector<transid_t>(1, static_cast<transid_t>(v)),
+                                   static_cast<timestamp_t>(v));
+                }
+
+                timestamp_t ts = oldest ? 0 : static_cast<timestamp_t>(versions);
+                for (long scan : {0L, 1L}) {
+                    measure_loop(name, {{"items", ITEM_COUNT / 2}, {"versions", versions}, {"scan", scan}}, [&]() {
+                        if (scan) {
+                            dm.SnapshotScan(1, ITEM_COUNT, true, ts, false);
+                            return;
+                        }
+                        for (itemid_t item_id = 2; item_id <= ITEM_COUNT; item_id += 2) {
+                            dm.Ronly(make_read(0, 0, item_id, OP_RONLY), ts);
+                        }
+                    });
+                }
+            }
+        }
+    }
+
+    //----------------------------- recovery -------------------------------------
+    // fail the site (not timed) then recover it, every item of the catalog it hosts is reloaded
+    void bench_recover() {
+        std::string name = "recover";
+        if (!selected(name)) {
+            return;
+        }
+        for (long versions : {1L, 100L}) {
+            DataMng dm(SITE, &null_listener, null_out);
+            for (long v = 1; v < versions; ++v) {
+                std::vector<op_t> ops;
+                for (itemid_t item_id = 2; item_id <= ITEM_COUNT; item_id += 2) {
+                    ops.push_back(make_write(0, static_cast<transid_t>(v), item_id, static_cast<int>(v)));
+                }
+                dm.LockAndWriteBatch(ops);
+                dm.GroupCommit(std::vector<transid_t>(1, static_cast<transid_t>(v)), static_cast<timestamp_t>(v));
+            }
+
+            long hosted = 0;
+            for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
+                if ((item_id % 2 == 0) || (1 + (item_id % 10) == SITE)) {
+                    hosted++;
+                }
+            }
+
+            timestamp_t now = static_cast<timestamp_t>(versions);
+            measure_each(name, {{"items", hosted}, {"versions", versions}}, [&](long) {
+                dm.Fail(now++);
+            }, [&](long) {
+                dm.Recover(now++);
+            });
+        }
+    }
+
+    //----------------------------- dump ----------------------------------------
+    // dump() of every site with a few versions of each item: printed to a file, and exported as CSV and binary
+    void bench_dump() {
+        std::string name = "dump";
+        const long VERSIONS = 8;
+        const std::string path = "repcrec_bench_dump.tmp";
+        const std::pair<const char *, long> modes[] = {{"text", -1}, {"csv", DUMP_CSV}, {"binary", DUMP_BINARY}};
+        for (const auto &mode : modes) {
+            std::string mode_name = name + "." + mode.first;
+            if (!selected(mode_name)) {
+                continue;
+            }
+            std::ofstream text(path.c_str());
+            TransMng tm(null_out);
+            tm.SetTickBanner(false);
+            if (mode.second >= 0) {
+                tm.SetDumpExport(path, static_cast<dump_format_t>(mode.second));
+            }
+            std::vector<DataMng *> sites;
+            for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                sites.push_back(new DataMng(site_id, &tm, text));
+                tm.AttachSite(site_id, sites.back());
+                for (long v = 1; v < VERSIONS; ++v) {
+                    std::vector<op_t> ops;
+                    for (itemid_t item_id = 1; item_id <= ITEM_COUNT; item_id++) {
+                        if (item_id % 2 == 0 || 1 + (item_id % 10) == site_id) {
+                            ops.push_back(make_write(0, static_cast<transid_t>(v), item_id, static_cast<int>(v)));
+                        }
+                    }
+                    sites.back()->LockAndWriteBatch(ops);
+                    sites.back()->GroupCommit(std::vector<transid_t>(1, static_cast<transid_t>(v)),
+                                              static_cast<timestamp_t>(v));
+                }
+            }
+            // the TM clock goes past the versions, so that the dump is of the latest ones
+            for (long v = 0; v < VERSIONS; ++v) {
+                tm.StartTick();
+                tm.RunTick("");
+            }
+            tm.StartTick();
+
+            measure_loop(mode_name, {{"items", ITEM_COUNT}, {"versions", VERSIONS}}, [&]() {
+                tm.RunTick("dump()");
+            });
+
+            for (DataMng *site : sites) {
+                delete site;
+            }
+        }
+        std::remove(path.c_str());
+    }
+
+    //----------------------------- startup --------------------------------------
+    // A TM and its sites are built and torn down, before the first command. Reports the heap allocations it takes
+    void bench_startup() {
+        std::string name = "startup";
+        if (!selected(name)) {
+            return;
+        }
+        unsigned long allocs = 0;
+        unsigned long bytes = 0;
+        measure_loop(name, {{"items", ITEM_COUNT}}, [&]() {
+            unsigned long allocs_before = alloc_count;
+            unsigned long bytes_before = alloc_bytes;
+            TransMng tm(null_out);
+            std::vector<DataMng *> sites;
+            for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                sites.push_back(new DataMng(site_id, &tm, null_out));
+                tm.AttachSite(site_id, sites.back());
+            }
+            allocs = alloc_count - allocs_before;
+            bytes = alloc_bytes - bytes_before;
+            for (DataMng *site : sites) {
+                delete site;
+            }
+        });
+        results.back().counters.push_back(std::make_pair("allocs", double(allocs)));
+        results.back().counters.push_back(std::make_pair("bytes", double(bytes)));
+        std::cerr << "  " << allocs << " allocations, " << bytes << " bytes\n";
+    }
+
+    //----------------------------- scheduling policies ----------------------------
+    // Clients on a few hot items: two of them run long transactions of priority 0, the others short ones of
+    // priority 10. A client sends its next command once its previous ops are done, one command per tick.
+    // Each transaction accesses its items once and in item order, so that there is no deadlock to get in the way.
+    // Reports the wait in ticks of the ops of each class under each policy, the max being its starvation bound
+    void bench_sched() {
+        const long TICKS = 2000;
+        const int CLIENTS = 8;
+        const int LONG_CLIENTS = 2;
+        const int HOT_ITEMS = 8;
+        const std::pair<const char *, sched_policy_t> policies[] = {
+                {"fifo",     POLICY_FIFO},
+                {"oldest",   POLICY_OLDEST},
+                {"fewest",   POLICY_FEWEST_LOCKS},
+                {"priority", POLICY_PRIORITY}};
+        for (const auto &policy : policies) {
+            std::string name = std::string("sched.") + policy.first;
+            if (!selected(name)) {
+                continue;
+            }
+
+            long iterations = 0;
+            double total_ns = 0;
+            std::map<int, std::vector<timestamp_t>> waits;
+            while (total_ns < config.min_time_ms * 1e6) {
+                TransMng tm(null_out);
+                tm.SetTickBanner(false);
+                tm.SetSchedPolicy(policy.second);
+                tm.SetWaitStats(true);
+                std::vector<DataMng *> sites;
+                for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                    sites.push_back(new DataMng(site_id, &tm, null_out));
+                    tm.AttachSite(site_id, sites.back());
+                }
+
+                // the transaction of each client (0 between two of them) and the items it has left to access
+                std::vector<transid_t> trans(CLIENTS, 0);
+                std::vector<std::vector<itemid_t>> items_left(CLIENTS);
+                transid_t next_trans = 1;
+                unsigned seed = 1;
+                auto next_random = [&seed]() {
+                    seed = seed * 1103515245 + 12345;
+                    return (seed >> 16) & 0x7fff;
+                };
+
+                auto start = bench_clock::now();
+                for (long tick = 0; tick < TICKS; ++tick) {
+                    std::string line;
+                    for (int c = 0; c < CLIENTS; ++c) {
+                        bool is_long = c < LONG_CLIENTS;
+                        std::string t = "T" + std::to_string(trans[c]);
+                        std::string command;
+                        if (trans[c] == 0) {
+                            trans[c] = next_trans++;
+                            t = "T" + std::to_string(trans[c]);
+                            // pick its items among the odd hot ones, in reverse item order
+                            int needed = is_long ? 6 : 2;
+                            for (int i = HOT_ITEMS - 1; i >= 0 && needed > 0; --i) {
+                                if (static_cast<int>(next_random() % (i + 1)) < needed) {
+                                    items_left[c].push_back(static_cast<itemid_t>(2 * i + 1));
+                                    needed--;
+                                }
+                            }
+                            command = is_long ? "begin(" + t + ")" : "beginP(" + t + ",10)";
+                        } else if (tm.QueuedOps(trans[c]) > 0) {
+                            continue;
+                        } else if (items_left[c].empty()) {
+                            command = "end(" + t + ")";
+                            trans[c] = 0;
+                        } else {
+                            std::string item = "x" + std::to_string(items_left[c].back());
+                            items_left[c].pop_back();
+                            command = next_random() % 2 ? "W(" + t + "," + item + "," + std::to_string(tick) + ")"
+                                                        : "R(" + t + "," + item + ")";
+                        }
+                        line += (line.empty() ? "" : ";") + command;
+                    }
+                    tm.StartTick();
+                    tm.RunTick(line);
+                }
+                auto end = bench_clock::now();
+                total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                iterations += TICKS;
+                waits = tm.OpWaits();
+
+                for (DataMng *site : sites) {
+                    delete site;
+                }
+            }
+            record(name, {{"clients", CLIENTS}, {"long_clients", LONG_CLIENTS}}, iterations, total_ns);
+
+            for (auto &p : waits) {
+                std::vector<timestamp_t> &ticks = p.second;
+                std::sort(ticks.begin(), ticks.end());
+                std::string prefix = "prio" + std::to_string(p.first) + "_";
+                timestamp_t p50 = ticks[ticks.size() / 2];
+                timestamp_t p99 = ticks[ticks.size() * 99 / 100];
+                timestamp_t max = ticks.back();
+                results.back().counters.push_back(std::make_pair(prefix + "ops", double(ticks.size())));
+                results.back().counters.push_back(std::make_pair(prefix + "p50_ticks", double(p50)));
+                results.back().counters.push_back(std::make_pair(prefix + "p99_ticks", double(p99)));
+                results.back().counters.push_back(std::make_pair(prefix + "max_ticks", double(max)));
+                std::cerr << "  priority " << p.first << ": " << ticks.size() << " ops, wait p50 " << p50
+                          << " p99 " << p99 << " max " << max << " ticks\n";
+            }
+        }
+    }
+
+    //----------------------------- admission control ----------------------------
+    // Clients running transactions of 4 reads and writes on a few hot items (a skewed pick among the first 64), in
+    // any order, so that they deadlock more and more as clients are added. A client sends its next command once its
+    // previous ops are done, one command per tick. Reports the commits and the deadlock aborts per 1000 ticks, with
+    // and without admission control
+    void bench_admission() {
+        const long TICKS = 4000;
+        const int OPS = 4;
+        for (long admission : {0L, 1L}) {
+            std::string name = admission ? "admission.on" : "admission.off";
+            if (!selected(name)) {
+                continue;
+            }
+            for (long clients : {4L, 8L, 16L, 32L, 64L}) {
+                long iterations = 0;
+                double total_ns = 0;
+                admission_stats_t stats;
+                while (total_ns < config.min_time_ms * 1e6) {
+                    TransMng tm(null_out);
+                    tm.SetTickBanner(false);
+                    tm.SetAdmissionControl(admission != 0);
+                    std::vector<DataMng *> sites;
+                    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                        sites.push_back(new DataMng(site_id, &tm, null_out));
+                        tm.AttachSite(site_id, sites.back());
+                    }
+
+                    // the transaction of each client (0 between two of them) and the ops it has left to send
+                    std::vector<transid_t> trans(clients, 0);
+                    std::vector<int> ops_left(clients, 0);
+                    transid_t next_trans = 1;
+                    unsigned seed = 1;
+                    auto next_random = [&seed]() {
+                        seed = seed * 1103515245 + 12345;
+                        return (seed >> 16) & 0x7fff;
+                    };
+
+                    auto start = bench_clock::now();
+                    for (long tick = 0; tick < TICKS; ++tick) {
+                        std::string line;
+                        for (long c = 0; c < clients; ++c) {
+                            std::string t = "T" + std::to_string(trans[c]);
+                            std::string command;
+                            if (trans[c] == 0) {
+                                trans[c] = next_trans++;
+                                ops_left[c] = OPS;
+                                command = "begin(T" + std::to_string(trans[c]) + ")";
+                            } else if (tm.QueuedOps(trans[c]) > 0) {
+                                continue;
+                            } else if (ops_left[c] == 0) {
+                                command = "end(" + t + ")";
+                                trans[c] = 0;
+                            } else {
+                                ops_left[c]--;
+                                // cubing a uniform pick skews it towards the first items
+                                double u = next_random() / 32768.0;
+                                std::string item = "x" + std::to_string(1 + static_cast<int>(64 * u * u * u));
+                                command = next_random() % 2 ? "W(" + t + "," + item + "," + std::to_string(tick) + ")"
+                                                            : "R(" + t + "," + item + ")";
+                            }
+                            line += (line.empty() ? "" : ";") + command;
+                        }
+                        tm.StartTick();
+                        tm.RunTick(line);
+                    }
+                    auto end = bench_clock::now();
+                    total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                    iterations += TICKS;
+                    stats = tm.AdmissionStats();
+
+                    for (DataMng *site : sites) {
+                        delete site;
+                    }
+                }
+                record(name, {{"clients", clients}}, iterations, total_ns);
+                double commits = 1000.0 * stats.commits / TICKS;
+                double aborts = 1000.0 * stats.deadlock_aborts / TICKS;
+                results.back().counters.push_back(std::make_pair("commits_per_1k_ticks", commits));
+                results.back().counters.push_back(std::make_pair("deadlock_aborts_per_1k_ticks", aborts));
+                if (admission) {
+                    results.back().counters.push_back(std::make_pair("final_cap", double(stats.cap)));
+                    results.back().counters.push_back(std::make_pair("cap_cuts", double(stats.cap_cuts)));
+                }
+                std::cerr << "  " << commits << " commits, " << aborts << " deadlock aborts per 1000 ticks";
+                if (admission) {
+                    std::cerr << ", cap " << stats.cap << " after " << stats.cap_cuts << " cuts";
+                }
+                std::cerr << "\n";
+            }
+        }
+    }
+
+    //----------------------------- hot counters ----------------------------------
+    // Clients that each add to the same replicated item, one transaction after another: either as a read-modify-write
+    // (R, then W of the item) or as a single INC. A client sends its next command once its previous ops are done, one
+    // command per tick. The readers upgrading to X deadlock each other, the increments share their lock. Reports the
+    // commits and the deadlock aborts per 1000 ticks of each
+    void bench_counter() {
+        const long TICKS = 4000;
+        for (long inc : {0L, 1L}) {
+            std::string name = inc ? "counter.inc" : "counter.rmw";
+            if (!selected(name)) {
+                continue;
+            }
+            for (long clients : {1L, 4L, 16L}) {
+                long iterations = 0;
+                double total_ns = 0;
+                admission_stats_t stats;
+                while (total_ns < config.min_time_ms * 1e6) {
+                    TransMng tm(null_out);
+                    tm.SetTickBanner(false);
+                    std::vector<DataMng *> sites;
+                    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                        sites.push_back(new DataMng(site_id, &tm, null_out));
+                        tm.AttachSite(site_id, sites.back());
+                    }
+
+                    // the transaction of each client (0 between two of them) and the commands it has sent so far
+                    std::vector<transid_t> trans(clients, 0);
+                    std::vector<int> sent(clients, 0);
+                    transid_t next_trans = 1;
+                    std::string item = "x" + std::to_string(HOT_ITEM);
+
+                    auto start = bench_clock::now();
+                    for (long tick = 0; tick < TICKS; ++tick) {
+                        std::string line;
+                        for (long c = 0; c < clients; ++c) {
+                            std::string t = "T" + std::to_string(trans[c]);
+                            std::string command;
+                            if (trans[c] == 0) {
+                                trans[c] = next_trans++;
+                                sent[c] = 0;
+                                command = "begin(T" + std::to_string(trans[c]) + ")";
+                            } else if (tm.QueuedOps(trans[c]) > 0) {
+                                continue;
+                            } else if (sent[c] == (inc ? 1 : 2)) {
+                                command = "end(" + t + ")";
+                                trans[c] = 0;
+                            } else if (inc) {
+                                command = "INC(" + t + "," + item + ",1)";
+                                sent[c]++;
+                            } else {
+                                // the value written does not matter for the locks
+                                command = sent[c] == 0 ? "R(" + t + "," + item + ")"
+                                                       : "W(" + t + "," + item + "," + std::to_string(tick) + ")";
+                                sent[c]++;
+                            }
+                            line += (line.empty() ? "" : ";") + command;
+                        }
+                        tm.StartTick();
+                        tm.RunTick(line);
+                    }
+                    auto end = bench_clock::now();
+                    total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                    iterations += TICKS;
+                    stats = tm.AdmissionStats();
+
+                    for (DataMng *site : sites) {
+                        delete site;
+                    }
+                }
+                record(name, {{"clients", clients}}, iterations, total_ns);
+                double commits = 1000.0 * stats.commits / TICKS;
+                double aborts = 1000.0 * stats.deadlock_aborts / TICKS;
+                results.back().counters.push_back(std::make_pair("commits_per_1k_ticks", commits));
+                results.back().counters.push_back(std::make_pair("deadlock_aborts_per_1k_ticks", aborts));
+                std::cerr << "  " << commits << " commits, " << aborts << " deadlock aborts per 1000 ticks\n";
+            }
+        }
+    }
+
+    //----------------------------- chaos -----------------------------------------
+    // Clients running transactions of 4 reads and writes on random items, like admission control but spread over
+    // the whole catalog, while sites fail and recover: every tick one of the sites that are up fails with a
+    // probability of rate per 1000 ticks, and recovers down ticks later. Reports the commits per 1000 ticks, the
+    // transactions aborted because a site they had accessed failed, how long the replicated items stayed unreadable
+    // after a recovery (item-ticks per recovery), and how long the ops of the transactions that ended waited because
+    // no replica was up or readable. The reads of a replicated item that no site may serve wait until it is written,
+    // so the clients still waiting when the run is over are reported too
+    void bench_chaos() {
+        std::string name = "chaos.churn";
+        if (!selected(name)) {
+            return;
+        }
+        const long TICKS = 4000;
+        const long CLIENTS = 16;
+        const int OPS = 4;
+        std::vector<long> rates = {0, 10, 50, 200};
+        if (config.chaos_rate >= 0) {
+            rates.assign(1, config.chaos_rate);
+        }
+        for (long rate : rates) {
+            long iterations = 0;
+            double total_ns = 0;
+            admission_stats_t stats;
+            long failures = 0;
+            long recoveries = 0;
+            long unreadable_ticks = 0;
+            long replica_ticks = 0;
+            long ended = 0;
+            long waiting = 0;
+            while (total_ns < config.min_time_ms * 1e6) {
+                TransMng tm(null_out);
+                tm.SetTickBanner(false);
+                tm.SetTransStats(true);
+                std::vector<DataMng *> sites;
+                for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                    sites.push_back(new DataMng(site_id, &tm, null_out));
+                    tm.AttachSite(site_id, sites.back());
+                }
+
+                // the transaction of each client (0 between two of them) and the ops it has left to send
+                std::vector<transid_t> trans(CLIENTS, 0);
+                std::vector<int> ops_left(CLIENTS, 0);
+                transid_t next_trans = 1;
+                // the tick at which each down site recovers, -1 while it is up
+                std::vector<long> down_until(SITE_COUNT + 1, -1);
+                unsigned seed = 1;
+                auto next_random = [&seed]() {
+                    seed = seed * 1103515245 + 12345;
+                    return (seed >> 16) & 0x7fff;
+                };
+                failures = 0;
+                recoveries = 0;
+                unreadable_ticks = 0;
+
+                auto start = bench_clock::now();
+                for (long tick = 0; tick < TICKS; ++tick) {
+                    std::string line;
+                    std::vector<siteid_t> up;
+                    for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                        if (down_until[site_id] == tick) {
+                            line += (line.empty() ? "" : ";") + ("recover(" + std::to_string(site_id) + ")");
+                            down_until[site_id] = -1;
+                            recoveries++;
+                        } else if (down_until[site_id] < 0) {
+                            up.push_back(site_id);
+                        }
+                    }
+                    if (!up.empty() && static_cast<long>(next_random() % 1000) < rate) {
+                        siteid_t site_id = up[next_random() % up.size()];
+                        line += (line.empty() ? "" : ";") + ("fail(" + std::to_string(site_id) + ")");
+                        down_until[site_id] = tick + config.chaos_down;
+                        failures++;
+                    }
+
+                    for (long c = 0; c < CLIENTS; ++c) {
+                        // a transaction aborted by a failure is over, the client begins the next one
+                        if (trans[c] != 0 && !tm.IsActive(trans[c])) {
+                            trans[c] = 0;
+                        }
+                        std::string t = "T" + std::to_string(trans[c]);
+                        std::string command;
+                        if (trans[c] == 0) {
+                            trans[c] = next_trans++;
+                            ops_left[c] = OPS;
+                            command = "begin(T" + std::to_string(trans[c]) + ")";
+                        } else if (tm.QueuedOps(trans[c]) > 0) {
+                            continue;
+                        } else if (ops_left[c] == 0) {
+                            command = "end(" + t + ")";
+                            trans[c] = 0;
+                        } else {
+                            ops_left[c]--;
+                            std::string item = "x" + std::to_string(1 + next_random() % ITEM_COUNT);
+                            command = next_random() % 2 ? "W(" + t + "," + item + "," + std::to_string(tick) + ")"
+                                                        : "R(" + t + "," + item + ")";
+                        }
+                        line += (line.empty() ? "" : ";") + command;
+                    }
+                    tm.StartTick();
+                    tm.RunTick(line);
+
+                    for (DataMng *site : sites) {
+                        unreadable_ticks += static_cast<long>(site->UnreadableReplicas());
+                    }
+                }
+                auto end = bench_clock::now();
+                total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                iterations += TICKS;
+                stats = tm.AdmissionStats();
+                replica_ticks = 0;
+                for (const trans_report_t &report : tm.TransReports()) {
+                    replica_ticks += report.replica_ticks;
+                }
+                ended = static_cast<long>(tm.TransReports().size());
+                waiting = 0;
+                for (long c = 0; c < CLIENTS; ++c) {
+                    waiting += trans[c] != 0 && tm.QueuedOps(trans[c]) > 0 ? 1 : 0;
+                }
+
+                for (DataMng *site : sites) {
+                    delete site;
+                }
+            }
+            record(name, {{"rate", rate}, {"down", config.chaos_down}, {"clients", CLIENTS}}, iterations, total_ns);
+            double commits = 1000.0 * stats.commits / TICKS;
+            double failure_aborts = 1000.0 * stats.failure_aborts / TICKS;
+            double unreadable = recoveries > 0 ? double(unreadable_ticks) / recoveries : 0;
+            double replica_wait = ended > 0 ? double(replica_ticks) / ended : 0;
+            double txn_per_s = stats.commits / (total_ns / iterations * TICKS / 1e9);
+            results.back().counters.push_back(std::make_pair("failures", double(failures)));
+            results.back().counters.push_back(std::make_pair("commits_per_1k_ticks", commits));
+            results.back().counters.push_back(std::make_pair("txn_per_s", txn_per_s));
+            results.back().counters.push_back(std::make_pair("failure_aborts_per_1k_ticks", failure_aborts));
+            results.back().counters.push_back(std::make_pair("unreadable_item_ticks_per_recovery", unreadable));
+            results.back().counters.push_back(std::make_pair("replica_wait_ticks_per_txn", replica_wait));
+            results.back().counters.push_back(std::make_pair("waiting_at_end", double(waiting)));
+            std::cerr << "  " << failures << " failures: " << commits << " commits, " << failure_aborts
+                      << " failure aborts per 1000 ticks, " << unreadable << " unreadable item-ticks per recovery, "
+                      << replica_wait << " ticks waiting for a replica per transaction, " << waiting << " of "
+                      << CLIENTS << " clients still waiting at the end\n";
+        }
+    }
+
+    //----------------------------- whole transactions ---------------------------
+    // Transactions that each write 4 items and read 2, one after another through the whole TM.
+    // Reports the heap allocations per committed transaction (including the command parsing)
+    void bench_workload() {
+        std::string name = "workload.txn";
+        if (!selected(name)) {
+            return;
+        }
+        const long TRANSACTIONS = 2000;
+        std::string script;
+        for (long t = 1; t <= TRANSACTIONS; ++t) {
+            std::string trans = "T" + std::to_string(t);
+            itemid_t base = static_cast<itemid_t>(2 * (t % (ITEM_COUNT / 2 - 4)) + 1);
+            script += "begin(" + trans + ")\n";
+            for (itemid_t i = 0; i < 4; ++i) {
+                script += "W(" + trans + ",x" + std::to_string(base + 2 * i) + "," + std::to_string(t) + ");";
+            }
+            script += "R(" + trans + ",x" + std::to_string(base + 1) + ");";
+            script += "R(" + trans + ",x" + std::to_string(base + 3) + ")\n";
+            script += "end(" + trans + ")\n";
+        }
+
+        long iterations = 0;
+        double total_ns = 0;
+        unsigned long total_allocs = 0;
+        while (total_ns < config.min_time_ms * 1e6) {
+            TransMng tm(null_out);
+            std::vector<DataMng *> sites;
+            for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                sites.push_back(new DataMng(site_id, &tm, null_out));
+                tm.AttachSite(site_id, sites.back());
+            }
+            std::stringstream input(script);
+
+            unsigned long allocs_before = alloc_count;
+            auto start = bench_clock::now();
+            tm.Simulate(input);
+            auto end = bench_clock::now();
+            total_allocs += alloc_count - allocs_before;
+            total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+            iterations += TRANSACTIONS;
+
+            for (DataMng *site : sites) {
+                delete site;
+            }
+        }
+        record(name, {{"transactions", TRANSACTIONS}}, iterations, total_ns);
+        results.back().counters.push_back(std::make_pair("allocs_per_txn", double(total_allocs) / iterations));
+        results.back().counters.push_back(std::make_pair("txn_per_s", iterations / (total_ns / 1e9)));
+        std::cerr << "  " << double(total_allocs) / iterations << " allocations per transaction\n";
+    }
+
+    //----------------------------- multi-item commands -----------------------------
+    // Forwards every request to a DataMng and counts them, each would be a message in multi-process mode
+    class CountingSite : public DataSite {
+    public:
+        DataMng dm;
+        long calls;
+
+        CountingSite(siteid_t site_id, SiteListener *listener) : dm(site_id, listener, null_out) {
+            calls = 0;
+        }
+
+        void Fail(timestamp_t _ts) override { calls++; dm.Fail(_ts); }
+
+        void Recover(timestamp_t _ts) override { calls++; dm.Recover(_ts); }
+
+        void Dump() override { calls++; dm.Dump(); }
+
+        void DumpItem(itemid_t item_id) override { calls++; dm.DumpItem(item_id); }
+
+        long Export(timestamp_t ts, const std::string &path, dump_format_t format) override {
+            calls++;
+            return dm.Export(ts, path, format);
+        }
+
+        void Abort(transid_t trans_id) override { calls++; dm.Abort(trans_id); }
+
+        void SetTransRank(transid_t trans_id, int rank) override { calls++; dm.SetTransRank(trans_id, rank); }
+
+        bool GetReadLock(transid_t trans_id, itemid_t item_id) override {
+            calls++;
+            return dm.GetReadLock(trans_id, item_id);
+        }
+
+        bool Read(op_t op) override { calls++; return dm.Read(op); }
+
+        bool Ronly(op_t op, timestamp_t ts) override { calls++; return dm.Ronly(op, ts); }
+
+        snapshot_t SnapshotScan(itemid_t first, itemid_t last, bool replicated, timestamp_t ts,
+                                bool with_values) override {
+            calls++;
+            return dm.SnapshotScan(first, last, replicated, ts, with_values);
+        }
+
+        std::vector<bool> LockAndReadBatch(const std::vector<op_t> &ops) override {
+            calls++;
+            return dm.LockAndReadBatch(ops);
+        }
+
+        std::vector<bool> LockAndWriteBatch(const std::vector<op_t> &ops) override {
+            calls++;
+            return dm.LockAndWriteBatch(ops);
+        }
+
+        inc_result_t LockAndIncrement(op_t op) override {
+            calls++;
+            return dm.LockAndIncrement(op);
+        }
+
+        void GroupCommit(const std::vector<transid_t> &trans_ids, timestamp_t commit_time) override {
+            calls++;
+            dm.GroupCommit(trans_ids, commit_time);
+        }
+
+        std::unordered_map<siteid_t, std::unordered_set<siteid_t>> GetWaitingGraph() override {
+            calls++;
+            return dm.GetWaitingGraph();
+        }
+    };
+
+    // Transactions that read (RR) or write (MW) items x1..xn, against the same transactions written as n single-item
+    // ops on one line. Reported is the time per transaction and the number of site requests
+    void bench_multi_item() {
+        const long TRANSACTIONS = 100;
+        for (bool write : {false, true}) {
+            std::string name = write ? "multi_item.bulk_write" : "multi_item.range_read";
+            if (!selected(name)) {
+                continue;
+            }
+            for (long items : {16L, 64L, 256L}) {
+                for (long multi : {0L, 1L}) {
+                    std::string script;
+                    for (long t = 1; t <= TRANSACTIONS; ++t) {
+                        std::string trans = "T" + std::to_string(t);
+                        script += "begin(" + trans + ")\n";
+                        if (multi && write) {
+                            script += "MW(" + trans + ",[";
+                            for (long i = 1; i <= items; ++i) {
+                                script += (i > 1 ? ",x" : "x") + std::to_string(i) + "=" + std::to_string(t);
+                            }
+                            script += "])";
+                        } else if (multi) {
+                            script += "RR(" + trans + ",x1,x" + std::to_string(items) + ")";
+                        } else {
+                            for (long i = 1; i <= items; ++i) {
+                                script += i > 1 ? ";" : "";
+                                script += write ? "W(" + trans + ",x" + std::to_string(i) + "," + std::to_string(t) + ")"
+                                                : "R(" + trans + ",x" + std::to_string(i) + ")";
+                            }
+                        }
+                        script += "\nend(" + trans + ")\n";
+                    }
+
+                    long iterations = 0;
+                    double total_ns = 0;
+                    long calls = 0;
+                    while (total_ns < config.min_time_ms * 1e6) {
+                        TransMng tm(null_out);
+                        std::vector<CountingSite *> sites;
+                        for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                            sites.push_back(new CountingSite(site_id, &tm));
+                            tm.AttachSite(site_id, sites.back());
+                        }
+                        std::stringstream input(script);
+
+                        auto start = bench_clock::now();
+                        tm.Simulate(input);
+                        auto end = bench_clock::now();
+                        total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                        iterations += TRANSACTIONS;
+
+                        calls = 0;
+                        for (CountingSite *site : sites) {
+                            calls += site->calls;
+                            delete site;
+                        }
+                    }
+                    record(name, {{"items", items}, {"multi", multi}}, iterations, total_ns);
+                    results.back().counters.push_back(std::make_pair("site_calls_per_txn",
+                                                                     double(calls) / TRANSACTIONS));
+                    std::cerr << "  " << double(calls) / TRANSACTIONS << " site requests per transaction\n";
+                }
+            }
+        }
+    }
+
+    //----------------------------- read cache --------------------------------------
+    // Read-modify-write transactions that look at their items again after writing them, with the TM read cache on
+    // and off. Reported is how many of the reads were answered without asking a site
+    void bench_read_cache() {
+        std::string name = "read_cache.reread";
+        if (!selected(name)) {
+            return;
+        }
+        const long TRANSACTIONS = 2000;
+        std::string script;
+        long reads = 0;
+        for (long t = 1; t <= TRANSACTIONS; ++t) {
+            std::string trans = "T" + std::to_string(t);
+            itemid_t base = static_cast<itemid_t>(t % (ITEM_COUNT - 4) + 1);
+            script += "begin(" + trans + ")\n";
+            for (itemid_t i = 0; i < 4; ++i) {
+                script += "R(" + trans + ",x" + std::to_string(base + i) + ");";
+                script += "W(" + trans + ",x" + std::to_string(base + i) + "," + std::to_string(t) + ");";
+                script += "R(" + trans + ",x" + std::to_string(base + i) + ")";
+                script += i < 3 ? ";" : "\n";
+                reads += 2;
+            }
+            script += "end(" + trans + ")\n";
+        }
+
+        for (long cache : {0L, 1L}) {
+            long iterations = 0;
+            double total_ns = 0;
+            long hits = 0;
+            while (total_ns < config.min_time_ms * 1e6) {
+                TransMng tm(null_out);
+                tm.SetReadCache(cache != 0);
+                std::vector<DataMng *> sites;
+                for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                    sites.push_back(new DataMng(site_id, &tm, null_out));
+                    tm.AttachSite(site_id, sites.back());
+                }
+                std::stringstream input(script);
+
+                auto start = bench_clock::now();
+                tm.Simulate(input);
+                auto end = bench_clock::now();
+                total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                iterations += TRANSACTIONS;
+                hits = tm.CacheHits();
+
+                for (DataMng *site : sites) {
+                    delete site;
+                }
+            }
+            record(name, {{"transactions", TRANSACTIONS}, {"cache", cache}}, iterations, total_ns);
+            results.back().counters.push_back(std::make_pair("site_reads_per_txn",
+                                                             double(reads - hits) / TRANSACTIONS));
+            results.back().counters.push_back(std::make_pair("cached_reads_per_txn", double(hits) / TRANSACTIONS));
+            std::cerr << "  " << double(reads - hits) / TRANSACTIONS << " site reads, "
+                      << double(hits) / TRANSACTIONS << " cached reads per transaction\n";
+        }
+    }
+
+    //----------------------------- snapshot cache ----------------------------------
+    // Reports: read-only transactions that begin together and read the same items, while a writer keeps adding
+    // versions of them between the rounds. Run with the TM snapshot cache on and off, reported is the share of the
+    // read-only reads answered without asking a site and the reads per second
+    void bench_snapshot_cache() {
+        std::string name = "snapshot_cache.report";
+        if (!selected(name)) {
+            return;
+        }
+        const long ROUNDS = 50;
+        const long REPORTS = 8;
+        const itemid_t ITEMS = 64;
+        std::string script;
+        transid_t next_trans = 1;
+        long reads = 0;
+        for (long round = 0; round < ROUNDS; ++round) {
+            std::string writer = "T" + std::to_string(next_trans++);
+            script += "begin(" + writer + ")\n";
+            for (itemid_t i = 1; i <= ITEMS; i += 4) {
+                script += "W(" + writer + ",x" + std::to_string(i) + "," + std::to_string(round) + ")";
+                script += i + 4 <= ITEMS ? ";" : "\n";
+            }
+            script += "end(" + writer + ")\n";
+
+            std::vector<std::string> reports;
+            for (long r = 0; r < REPORTS; ++r) {
+                reports.push_back("T" + std::to_string(next_trans++));
+            }
+            for (long r = 0; r < REPORTS; ++r) {
+                script += "beginRO(" + reports[r] + ")" + (r + 1 < REPORTS ? ";" : "\n");
+            }
+            for (itemid_t i = 1; i <= ITEMS; ++i) {
+                for (long r = 0; r < REPORTS; ++r) {
+                    script += "R(" + reports[r] + ",x" + std::to_string(i) + ")";
+                    script += r + 1 < REPORTS ? ";" : "\n";
+                    reads++;
+                }
+            }
+            for (long r = 0; r < REPORTS; ++r) {
+                script += "end(" + reports[r] + ")" + (r + 1 < REPORTS ? ";" : "\n");
+            }
+        }
+
+        for (long cache : {0L, 1L}) {
+            long iterations = 0;
+            double total_ns = 0;
+            long hits = 0;
+            while (total_ns < config.min_time_ms * 1e6) {
+                TransMng tm(null_out);
+                tm.SetSnapshotCache(cache != 0);
+                std::vector<DataMng *> sites;
+                for (siteid_t site_id = 1; site_id <= SITE_COUNT; site_id++) {
+                    sites.push_back(new DataMng(site_id, &tm, null_out));
+                    tm.AttachSite(site_id, sites.back());
+                }
+                std::stringstream input(script);
+
+                auto start = bench_clock::now();
+                tm.Simulate(input);
+                auto end = bench_clock::now();
+                total_ns += std::chrono::duration<double, std::nano>(end - start).count();
+                iterations += reads;
+                hits = tm.SnapshotHits();
+
+                for (DataMng *site : sites) {
+                    delete site;
+                }
+            }
+            record(name, {{"reports", REPORTS}, {"items", ITEMS}, {"cache", cache}}, iterations, total_ns);
+            double hit_rate = double(hits) / reads;
+            double reads_per_s = iterations / (total_ns / 1e9);
+            results.back().counters.push_back(std::make_pair("hit_rate", hit_rate));
+            results.back().counters.push_back(std::make_pair("reads_per_s", reads_per_s));
+            std::cerr << "  hit rate " << hit_rate << ", " << reads_per_s << " reads/s\n";
+        }
+    }
+
+    void write_json(std::ostream &out) {
+        out << "{\n  \"config\": {\"site_count\": " << SITE_COUNT << ", \"item_count\": " << ITEM_COUNT
+            << ", \"min_time_ms\": " << config.min_time_ms << "},\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const result_t &result = results[i];
+            out << "    {\"name\": \"" << result.name << "\", \"params\": {";
+            for (size_t j = 0; j < result.params.size(); ++j) {
+                out << (j ? ", " : "") << "\"" << result.params[j].first << "\": " << result.params[j].second;
+            }
+            out << "}, \"iterations\": " << result.iterations << ", \"ns_per_op\": " << result.ns_per_op;
+            for (const auto &counter : result.counters) {
+                out << ", \"" << counter.first << "\": " << counter.second;
+            }
+            out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+    }
+} // helper functions
+
+int main(int argc, char **argv) {
+    config.min_time_ms = 200;
+    config.chaos_rate = -1;
+    config.chaos_down = 20;
+    std::string out_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            config.filter = argv[++i];
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            config.min_time_ms = std::atof(argv[++i]);
+        } else if (arg == "--chaos-rate" && i + 1 < argc) {
+            config.chaos_rate = std::atol(argv[++i]);
+        } else if (arg == "--chaos-down" && i + 1 < argc) {
+            config.chaos_down = std::max(1L, std::atol(argv[++i]));
+        } else if (arg == "--out" && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            std::cerr << "usage: repcrec_bench [--filter <substring>] [--min-time <ms>] [--chaos-rate <n>] "
+                         "[--chaos-down <ticks>] [--out <file>]\n";
+            return -1;
+        }
+    }
+
+    bench_lock_queue();
+    bench_lock_grant();
+    bench_commit_abort();
+    bench_escalation();
+    bench_deadlock();
+    bench_waiting_graph();
+    bench_ronly();
+    bench_tiered();
+    bench_snapshot();
+    bench_recover();
+    bench_dump();
+    bench_startup();
+    bench_sched();
+    bench_admission();
+    bench_counter();
+    bench_chaos();
+    bench_workload();
+    bench_read_cache();
+    bench_snapshot_cache();
+    bench_multi_item();
+
+    if (out_path.empty()) {
+        write_json(std::cout);
+    } else {
+        std::ofstream out(out_path.c_str());
+        write_json(out);
+    }
+    return 0;
+}
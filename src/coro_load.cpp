@@ -0,0 +1,224 @@
+/**
+ * Date: 2026-10-18
+ * Description: A load generator written as coroutines against the embedded transactions (see TxCoro.h). Every client
+ * is a coroutine running one transaction of random reads and writes after another, so the transactions in flight are
+ * the clients, and a parked op costs nothing until a site grants its lock. Everything runs in this process against
+ * DataMng/TransMng directly. This target needs C++20 and is built with a larger ITEM_COUNT (see CMakeLists.txt).
+ * With several coordinators, as many TMs share the sites (see Partition.h), each on its own thread with its share
+ * of the clients and of the transactions.
+ *
+ * usage: repcrec_coro [--clients <n>] [--txns <n>] [--ops <n>] [--writes <percent>] [--seed <n>]
+ *                     [--coordinators <n>]
+**/
+#include "DataMng.h"
+#include "Partition.h"
+#include "TransMng.h"
+#include "TxCoro.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    struct load_options_t {
+        int clients;
+        int txns;
+        int ops;
+        int writes;
+        unsigned seed;
+        int coordinators;
+
+        load_options_t() {
+            clients = 1024;
+            txns = 16384;
+            ops = 4;
+            writes = 5;
+            seed = 1;
+            coordinators = 1;
+        }
+    };
+
+    // a partition that has not moved for that long is stuck, and how long it sleeps between two rounds that did
+    // nothing unless another partition wakes it up
+    const double STALL_SECONDS = 5;
+    const std::chrono::microseconds IDLE_WAIT(200);
+
+    struct load_state_t {
+        // the next transaction id to begin (the ids of a partition are step apart), and what came out of the ones
+        // that ended
+        int next_trans;
+        int step;
+        long commits;
+        long aborts;
+        std::mt19937 rng;
+
+        load_state_t(unsigned seed, int first_trans, int _step) : rng(seed) {
+            next_trans = first_trans;
+            step = _step;
+            commits = 0;
+            aborts = 0;
+        }
+    };
+
+    tx_program_t client(TransMng &tm, const load_options_t &options, load_state_t &state) {
+        std::uniform_int_distribution<int> item_dist(1, ITEM_COUNT);
+        std::uniform_int_distribution<int> percent_dist(0, 99);
+        while (state.next_trans <= options.txns) {
+            Tx tx(tm, state.next_trans);
+            state.next_trans += state.step;
+            bool ok = true;
+            for (int i = 0; i < options.ops && ok; ++i) {
+                itemid_t item_id = item_dist(state.rng);
+                if (percent_dist(state.rng) < options.writes) {
+                    ok = (co_await tx.write(item_id, tx.id())).ok;
+                } else {
+                    ok = (co_await tx.read(item_id)).ok;
+                }
+            }
+            tx_result_t end = co_await tx.commit();
+            if (end.ok) {
+                state.commits++;
+            } else {
+                state.aborts++;
+            }
+        }
+    }
+
+    // The same load over partitioned TMs, one thread each: partition p runs every coordinators-th client, from the
+    // p-th one, and the transactions it owns
+    int run_partitioned(const load_options_t &options) {
+        int n = options.coordinators;
+        PartitionGroup group(n);
+        std::vector<std::unique_ptr<load_state_t>> states;
+        for (int p = 0; p < n; ++p) {
+            states.emplace_back(new load_state_t(options.seed + p, p + 1, n));
+        }
+        std::vector<long> rounds(n, 0);
+        std::vector<bool> stalled(n, false);
+
+        auto start = std::chrono::steady_clock::now();
+        group.Run([&](int p) {
+            TransMng &tm = group.Partition(p);
+            load_state_t &state = *states[p];
+            long txns = options.txns > p ? (options.txns - p - 1) / n + 1 : 0;
+            for (int i = p; i < options.clients; i += n) {
+                client(tm, options, state);
+            }
+            // the other partitions may still hold the locks it waits for, it only stops once its own are over
+            auto moved = std::chrono::steady_clock::now();
+            while (state.commits + state.aborts < txns) {
+                if (group.Pump(p)) {
+                    rounds[p]++;
+                    moved = std::chrono::steady_clock::now();
+                    continue;
+                }
+                if (std::chrono::duration<double>(std::chrono::steady_clock::now() - moved).count() > STALL_SECONDS) {
+                    stalled[p] = true;
+                    break;
+                }
+                group.Wait(p, IDLE_WAIT);
+            }
+        });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        long commits = 0;
+        long aborts = 0;
+        long total_rounds = 0;
+        tx_stats_t stats;
+        for (int p = 0; p < n; ++p) {
+            commits += states[p]->commits;
+            aborts += states[p]->aborts;
+            total_rounds += rounds[p];
+            const tx_stats_t &partition_stats = group.Partition(p).TxStats();
+            stats.ops += partition_stats.ops;
+            stats.attempts += partition_stats.attempts;
+            stats.wakeups += partition_stats.wakeups;
+        }
+        std::cout << "clients: " << options.clients << "\n"
+                  << "coordinators: " << n << "\n"
+                  << "transactions: " << commits + aborts << " (committed " << commits << ", aborted " << aborts
+                  << ")\n"
+                  << "rounds: " << total_rounds << "\n"
+                  << "ops: " << stats.ops << ", tries per op: "
+                  << (stats.ops > 0 ? 1.0 * stats.attempts / stats.ops : 0) << ", wakeups: " << stats.wakeups << "\n"
+                  << "deadlock victims across partitions: " << group.DeadlockVictims() << "\n"
+                  << "wall time: " << seconds << " s, " << (commits + aborts) / seconds << " transactions/s\n";
+        for (int p = 0; p < n; ++p) {
+            if (stalled[p]) {
+                std::cout << "stalled: partition " << p << " never ended all its transactions\n";
+            }
+        }
+        return 0;
+    }
+} // helper functions
+
+int main(int argc, char **argv) {
+    load_options_t options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc) {
+            options.clients = std::atoi(argv[++i]);
+        } else if (arg == "--txns" && i + 1 < argc) {
+            options.txns = std::atoi(argv[++i]);
+        } else if (arg == "--ops" && i + 1 < argc) {
+            options.ops = std::atoi(argv[++i]);
+        } else if (arg == "--writes" && i + 1 < argc) {
+            options.writes = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--coordinators" && i + 1 < argc) {
+            options.coordinators = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "usage: repcrec_coro [--clients <n>] [--txns <n>] [--ops <n>] [--writes <percent>] "
+                         "[--seed <n>] [--coordinators <n>]\n";
+            return -1;
+        }
+    }
+    if (options.coordinators > 1) {
+        return run_partitioned(options);
+    }
+
+    // the outcomes are counted here, not printed
+    std::ostream null_out(nullptr);
+    TransMng tm(null_out);
+    std::vector<DataMng *> sites;
+    for (siteid_t site_id = 1; site_id <= SITE_COUNT; ++site_id) {
+        sites.push_back(new DataMng(site_id, &tm, null_out));
+        tm.AttachSite(site_id, sites.back());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    load_state_t state(options.seed, 1, 1);
+    for (int i = 0; i < options.clients; ++i) {
+        client(tm, options, state);
+    }
+    long rounds = 0;
+    while (tm.Pump()) {
+        rounds++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const tx_stats_t &stats = tm.TxStats();
+    std::cout << "clients: " << options.clients << "\n"
+              << "transactions: " << state.commits + state.aborts
+              << " (committed " << state.commits << ", aborted " << state.aborts << ")\n"
+              << "rounds: " << rounds << "\n"
+              << "ops: " << stats.ops << ", tries per op: " << (stats.ops > 0 ? 1.0 * stats.attempts / stats.ops : 0)
+              << ", wakeups: " << stats.wakeups << "\n"
+              << "wall time: " << seconds << " s, " << (state.commits + state.aborts) / seconds
+              << " transactions/s\n";
+    if (state.commits + state.aborts < options.txns) {
+        std::cout << "stalled: " << options.txns - (state.commits + state.aborts) << " transactions never ended\n";
+    }
+
+    for (DataMng *site : sites) {
+        delete site;
+    }
+    return 0;
+}
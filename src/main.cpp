@@ -1,39 +1,255 @@
-#include "DataMng.h"
-#include "TransMng.h"
+#include "Cluster.h"
+#include "Runner.h"
+#include "Server.h"
 
+#include<chrono>
+#include<cstdlib>
 #include<iostream>
 #include<fstream>
+#include<string>
 
-DataMng *DM[SITE_COUNT + 1];
-TransMng *TM;
+namespace {
+    void print_usage() {
+        std::cout << "usage: repcrec [options] [input-file]\n"
+                  << "       repcrec [options] --run-dir <input-dir> <output-dir> [--golden <dir>] [--jobs <n>]\n"
+                  << "       repcrec [options] --serve <socket>\n"
+                  << "       repcrec --load <socket> [--clients <n>] [--seconds <s>] [--ops <n>] [--id-base <n>]\n";
+        std::exit(-1);
+    }
+}
 
 int main(int argc, char **argv) {
-    // initialize TM
-    TM = new TransMng();
+    // parse the options, the remaining argument is the input file
+    const char *input_file = nullptr;
+    cluster_options_t options;
+    runner_options_t runner_options;
+    server_options_t server_options;
+    load_options_t load_options;
+    bool run_dir = false;
+    bool serve = false;
+    bool load = false;
+    const char *trace_file = nullptr;
+    const char *trans_csv_file = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-write-batch") {
+            options.write_batch = false;
+        } else if (arg == "--no-read-cache") {
+            options.read_cache = false;
+        } else if (arg == "--no-snapshot-cache") {
+            options.snapshot_cache = false;
+        } else if (arg == "--multi-process") {
+            options.multi_process = true;
+        } else if (arg == "--free-run") {
+            options.free_running = true;
+        } else if (arg == "--admission") {
+            options.admission_control = true;
+        } else if (arg == "--escalate") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            options.escalation_threshold = std::atoi(argv[++i]);
+        } else if (arg == "--hot-versions") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            options.hot_versions = std::atoi(argv[++i]);
+        } else if (arg == "--cold-dir") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            options.cold_dir = argv[++i];
+        } else if (arg == "--sched") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            std::string policy = argv[++i];
+            if (policy == "fifo") {
+                options.sched_policy = POLICY_FIFO;
+            } else if (policy == "oldest") {
+                options.sched_policy = POLICY_OLDEST;
+            } else if (policy == "fewest") {
+                options.sched_policy = POLICY_FEWEST_LOCKS;
+            } else if (policy == "priority") {
+                options.sched_policy = POLICY_PRIORITY;
+            } else {
+                print_usage();
+            }
+        } else if (arg == "--deadlock-interval" || arg == "--deadlock-threshold") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            int events = std::atoi(argv[++i]);
+            if (arg == "--deadlock-interval") {
+                options.deadlock_interval = events;
+            } else {
+                options.deadlock_threshold = events;
+            }
+        } else if (arg == "--trace") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            trace_file = argv[++i];
+        } else if (arg == "--dump-to") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            options.dump_path = argv[++i];
+        } else if (arg == "--dump-format") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            std::string format = argv[++i];
+            if (format == "csv") {
+                options.dump_format = DUMP_CSV;
+            } else if (format == "binary") {
+                options.dump_format = DUMP_BINARY;
+            } else {
+                print_usage();
+            }
+        } else if (arg == "--trans-stats") {
+            options.trans_stats = true;
+        } else if (arg == "--trans-csv") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            options.trans_stats = true;
+            trans_csv_file = argv[++i];
+        } else if (arg == "--run-dir") {
+            if (i + 2 >= argc) {
+                print_usage();
+            }
+            run_dir = true;
+            runner_options.input_dir = argv[++i];
+            runner_options.output_dir = argv[++i];
+        } else if (arg == "--golden") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            runner_options.golden_dir = argv[++i];
+        } else if (arg == "--jobs") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            runner_options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--serve") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            serve = true;
+            server_options.socket_path = argv[++i];
+        } else if (arg == "--load") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            load = true;
+            load_options.socket_path = argv[++i];
+        } else if (arg == "--clients" || arg == "--seconds" || arg == "--ops" || arg == "--id-base") {
+            if (i + 1 >= argc) {
+                print_usage();
+            }
+            const char *value = argv[++i];
+            if (arg == "--clients") {
+                load_options.clients = std::atoi(value);
+            } else if (arg == "--seconds") {
+                load_options.seconds = std::atof(value);
+            } else if (arg == "--ops") {
+                load_options.ops = std::atoi(value);
+            } else {
+                load_options.id_base = std::atoi(value);
+            }
+        } else if (arg.compare(0, 2, "--") == 0) {
+            print_usage();
+        } else {
+            input_file = argv[i];
+        }
+    }
+
+    SiteProcStats site_stats;
+    options.site_stats = &site_stats;
+
+    // the scenarios of a directory run on several threads, one timeline cannot follow them
+    std::ofstream trace_out;
+    Tracer *tracer = nullptr;
+    if (trace_file != nullptr) {
+        if (run_dir || load) {
+            print_usage();
+        }
+        trace_out.open(trace_file);
+        if (!trace_out.is_open()) {
+            std::cout << "ERROR Open Trace File\n";
+            std::exit(-1);
+        }
+        tracer = new Tracer(trace_out);
+        options.tracer = tracer;
+    }
+
+    // the report is of a single run
+    if (options.trans_stats && (run_dir || serve || load)) {
+        print_usage();
+    }
+
+    // the scenarios of a directory would all write the same file
+    if (!options.dump_path.empty() && (run_dir || load)) {
+        print_usage();
+    }
+
+    // generate load against a running server
+    if (load) {
+        return RunLoad(load_options, std::cout);
+    }
+
+    // serve clients until interrupted
+    if (serve) {
+        int ret = RunServer(server_options, options, std::cerr);
+        delete tracer;
+        if (options.multi_process) {
+            site_stats.Print(std::cerr, 0);
+        }
+        return ret;
+    }
 
-    // initialize DM(s)
-    DM[0] = nullptr;
-    for (int i = 1; i <= SITE_COUNT; ++i) {
-        DM[i] = new DataMng(i);
+    // run a directory of scenarios
+    if (run_dir) {
+        return RunScenarios(runner_options, options, std::cout);
     }
 
+    // initialize TM and DM(s)
+    Cluster *cluster = new Cluster(options, std::cout);
+
     // begin main loop
-    if (argc > 1) {
-        std::ifstream infile(argv[1]);
+    auto start = std::chrono::steady_clock::now();
+    if (input_file != nullptr) {
+        std::ifstream infile(input_file);
         if (!infile.is_open()) {
             std::cout << "ERROR Open Input File\n";
         } else {
-            TM->Simulate(infile);
+            cluster->GetTM().Simulate(infile);
         }
     } else {
-        TM->Simulate(std::cin);
+        cluster->GetTM().Simulate(std::cin);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if (options.trans_stats) {
+        cluster->GetTM().PrintTransSummary(std::cerr);
+    }
+    if (trans_csv_file != nullptr) {
+        std::ofstream csv_out(trans_csv_file);
+        if (!csv_out.is_open()) {
+            std::cout << "ERROR Open Transaction CSV File\n";
+            std::exit(-1);
+        }
+        cluster->GetTM().WriteTransCsv(csv_out);
     }
 
     // clean up
-    delete TM;
-    for (int i = 1; i <= SITE_COUNT; ++i) {
-        delete DM[i];
+    delete cluster;
+    delete tracer;
+
+    if (options.multi_process) {
+        site_stats.Print(std::cerr, std::chrono::duration<double>(end - start).count());
     }
 
     return 0;
-}
\ No newline at end of file
+}